@@ -0,0 +1,697 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <vector>
+
+#include "../pde_solver/pde_solver_heat_equation.h"
+#include "../pde_solver/pde_solver_wave_equation.h"
+#include "../pde_solver/pde_solver_poisson_equation.h"
+#include "../math_module/math_module.h"
+#include "../math_module/sparse_matrix.h"
+
+using namespace PdeSolver;
+
+/**
+ * @brief Exposes the steps of the heat equation solver to the benchmarks.
+ */
+class HeatEquationBenchmark : public PdeSolverHeatEquation
+{
+public:
+    using PdeSolverHeatEquation::alternating_direction_method;
+    using PdeSolverHeatEquation::crank_nicolson_method;
+    using PdeSolverHeatEquation::douglas_gottlieb_method;
+    using PdeSolverHeatEquation::explicit_method;
+    using PdeSolverHeatEquation::explicit_steps;
+    using PdeSolverHeatEquation::get_initial_conditions_in_cartesian_coords;
+};
+
+/**
+ * @brief Exposes the steps of the wave equation solver to the benchmarks.
+ */
+class WaveEquationBenchmark : public PdeSolverWaveEquation
+{
+public:
+    using PdeSolverWaveEquation::crank_nicolson_method;
+    using PdeSolverWaveEquation::leapfrog_method;
+    using PdeSolverWaveEquation::adi_method;
+    using PdeSolverWaveEquation::get_initial_conditions_in_polar_coords;
+
+    /**
+     * @brief The initial conditions as radial profiles (R.count x 1 fields), the levels the solver steps.
+     */
+    GraphDataSlice_t get_initial_profiles(const PdeSettings& set)
+    {
+        PdeSettings::CoordGridSet_t coordF = *set.get_coord_by_label("F1");
+        coordF.count = 1;
+        return get_initial_conditions(set, *set.get_coord_by_label("R"), coordF);
+    }
+};
+
+/**
+ * @brief Exposes the multigrid levels of the Poisson equation solver to the benchmarks.
+ */
+class PoissonEquationBenchmark : public PdeSolverPoissonEquation
+{
+public:
+    using PdeSolverPoissonEquation::build_levels;
+    using PdeSolverPoissonEquation::cycle;
+    using PdeSolverPoissonEquation::m_Levels;
+};
+
+/**
+ * @brief A kernel measured on an n x n grid (or a radial profile of n nodes, or an n x n x n grid).
+ */
+struct Benchmark_t
+{
+    QString name;
+    QString description;
+    double bytes_per_node = 0;  /**< The memory traffic of a node the kernel cannot avoid (reads and writes of the fields) */
+    bool radial = false;        /**< The kernel steps a radial profile of n nodes instead of the n x n grid */
+    bool volume = false;        /**< The kernel steps an n x n x n grid instead of the n x n one (only up to n = MaxVolumeSize) */
+
+    /**
+     * @brief Prepares the data for the grid size n and returns the kernel to be timed (the setup is not timed).
+     */
+    std::function<std::function<void()>(int n)> setup;
+};
+
+/**
+ * @brief The timings of a kernel on a grid size.
+ */
+struct BenchmarkResult_t
+{
+    QString name;
+    int size = 0;
+    qint64 nodes = 0;
+    double bytes_per_node = 0;
+    std::vector<double> times_ns;   /**< The times of the repetitions (sorted) */
+
+    double median_ns() const { return times_ns[times_ns.size() / 2]; }
+    double min_ns() const { return times_ns.front(); }
+    double mean_ns() const
+    {
+        double sum = 0;
+        for (double time : times_ns) sum += time;
+        return sum / times_ns.size();
+    }
+    double stddev_ns() const
+    {
+        const double mean = mean_ns();
+        double sum = 0;
+        for (double time : times_ns) sum += (time - mean) * (time - mean);
+        return (times_ns.size() > 1) ? std::sqrt(sum / (times_ns.size() - 1)) : 0.0;
+    }
+};
+
+// the largest n of the kernels on n x n x n grids (the levels of n = 512 would take 1.5 GB)
+static const int MaxVolumeSize = 256;
+
+// the results of the kernels are summed here, so the compiler cannot drop them
+static volatile float g_Sink = 0.0f;
+
+/**
+ * @brief Sets the number of nodes along both space axes (the T axis is kept).
+ */
+static void set_grid_size(PdeSettings& set, int n)
+{
+    QVariantMap map = set.toQVariantMap();
+    for (const auto& coord : set.m_Coords)
+    {
+        if (coord.label != "T") map.insert("count" + coord.label, n);
+    }
+    set.reset(map);
+}
+
+static std::vector<Benchmark_t> make_benchmarks()
+{
+    std::vector<Benchmark_t> benchmarks;
+
+    Benchmark_t tridiagonal;
+    tridiagonal.name = "solve_tridiagonal_equation";
+    tridiagonal.description = "n systems of size n (the right parts and c are restored before every system)";
+    tridiagonal.bytes_per_node = 6 * sizeof(float);
+    tridiagonal.setup = [](int n) -> std::function<void()>
+    {
+        auto a = std::make_shared<std::vector<float>>(n, -1.0f);
+        auto b = std::make_shared<std::vector<float>>(n, 4.0f);
+        auto c = std::make_shared<std::vector<float>>(n, -1.0f);
+        auto d = std::make_shared<std::vector<float>>(n);
+        auto c_work = std::make_shared<std::vector<float>>(n);
+        auto d_work = std::make_shared<std::vector<float>>(n);
+        for (int i = 0; i < n; ++i) (*d)[i] = std::sin(0.1f * i);
+        return [=]()
+        {
+            for (int system = 0; system < n; ++system)
+            {
+                *c_work = *c;
+                *d_work = *d;
+                MathModule::solve_tridiagonal_equation(*a, *b, *c_work, *d_work, n);
+            }
+            g_Sink = g_Sink + (*d_work)[n / 2];
+        };
+    };
+    benchmarks.push_back(tridiagonal);
+
+    Benchmark_t tridiagonal_batch;
+    tridiagonal_batch.name = "TridiagonalFactorization::solve_batch";
+    tridiagonal_batch.description = "n interleaved systems of size n with a cached factorization (what the ADI half-steps use)";
+    tridiagonal_batch.bytes_per_node = 2 * sizeof(float);
+    tridiagonal_batch.setup = [](int n) -> std::function<void()>
+    {
+        std::vector<float> a(n, -1.0f), b(n, 4.0f), c(n, -1.0f);
+        auto factorization = std::make_shared<MathModule::TridiagonalFactorization<float>>();
+        factorization->factorize(a.data(), b.data(), c.data(), n);
+        auto d = std::make_shared<Field_t>(n, n);
+        auto x = std::make_shared<Field_t>(n, n);
+        for (int i = 0; i < n; ++i)
+        {
+            for (int j = 0; j < n; ++j) (*d)(i, j) = std::sin(0.1f * (i + j));
+        }
+        return [=]()
+        {
+            factorization->solve_batch(d->data(), x->data(), n, d->stride());
+            g_Sink = g_Sink + (*x)(n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(tridiagonal_batch);
+
+    Benchmark_t tridiagonal_mixed;
+    tridiagonal_mixed.name = "TridiagonalFactorization<float, double>::solve_batch";
+    tridiagonal_mixed.description = "the systems of TridiagonalFactorization::solve_batch eliminated in fp64 (the \"mixed\" precision)";
+    tridiagonal_mixed.bytes_per_node = 2 * sizeof(float);
+    tridiagonal_mixed.setup = [](int n) -> std::function<void()>
+    {
+        std::vector<double> a(n, -1.0), b(n, 4.0), c(n, -1.0);
+        auto factorization = std::make_shared<MathModule::TridiagonalFactorization<float, double>>();
+        factorization->factorize(a.data(), b.data(), c.data(), n);
+        auto d = std::make_shared<Field_t>(n, n);
+        auto x = std::make_shared<Field_t>(n, n);
+        for (int i = 0; i < n; ++i)
+        {
+            for (int j = 0; j < n; ++j) (*d)(i, j) = std::sin(0.1f * (i + j));
+        }
+        return [=]()
+        {
+            factorization->solve_batch(d->data(), x->data(), n, d->stride());
+            g_Sink = g_Sink + (*x)(n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(tridiagonal_mixed);
+
+    Benchmark_t cyclic_batch;
+    cyclic_batch.name = "CyclicTridiagonalBatch::solve";
+    cyclic_batch.description = "n interleaved cyclic systems of size n, a matrix per system (what the rings of the wave ADI use)";
+    cyclic_batch.bytes_per_node = 2 * sizeof(float);
+    cyclic_batch.setup = [](int n) -> std::function<void()>
+    {
+        std::vector<float> a(size_t(n) * n), b(size_t(n) * n);
+        for (int k = 0; k < n; ++k)
+        {
+            for (int s = 0; s < n; ++s)
+            {
+                a[size_t(k) * n + s] = -1.0f - s;
+                b[size_t(k) * n + s] = 3.0f + 2 * s;
+            }
+        }
+        auto factorization = std::make_shared<MathModule::CyclicTridiagonalBatch<float>>();
+        factorization->factorize(a.data(), b.data(), a.data(), n, n);
+        auto d = std::make_shared<Field_t>(n, n);
+        auto x = std::make_shared<Field_t>(n, n);
+        for (int i = 0; i < n; ++i)
+        {
+            for (int j = 0; j < n; ++j) (*d)(i, j) = std::sin(0.1f * (i + j));
+        }
+        return [=]()
+        {
+            factorization->solve(d->data(), x->data(), d->stride(), 0, n);
+            g_Sink = g_Sink + (*x)(n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(cyclic_batch);
+
+    for (char stencil : {'x', 'y'})
+    {
+        Benchmark_t adi;
+        adi.name = (stencil == 'x') ? "alternating_direction_method 'x'" : "alternating_direction_method 'y'";
+        adi.description = "a half-step of the heat equation on an n x n grid (one thread)";
+        adi.bytes_per_node = 2 * sizeof(float);
+        adi.setup = [stencil](int n) -> std::function<void()>
+        {
+            auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Cartesian);
+            set_grid_size(*set, n);
+            auto solver = std::make_shared<HeatEquationBenchmark>();
+            auto prev_field = std::make_shared<Field_t>(*solver->get_initial_conditions_in_cartesian_coords(*set).u);
+            auto new_field = std::make_shared<Field_t>(n, n);
+            const double t_step = set->get_coord_by_label("T")->step;
+            return [=]()
+            {
+                solver->alternating_direction_method(*set, *prev_field, *new_field, stencil, 0.0, t_step);
+                g_Sink = g_Sink + (*new_field)(n / 2, n / 2);
+            };
+        };
+        benchmarks.push_back(adi);
+    }
+
+    Benchmark_t douglas_gottlieb;
+    douglas_gottlieb.name = "douglas_gottlieb_method";
+    douglas_gottlieb.description = "a step of the heat equation (three sweeps) on an n x n x n grid (one thread)";
+    douglas_gottlieb.bytes_per_node = 2 * sizeof(float);
+    douglas_gottlieb.volume = true;
+    douglas_gottlieb.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Cartesian, 3);
+        set_grid_size(*set, n);
+        auto solver = std::make_shared<HeatEquationBenchmark>();
+        auto prev_field = std::make_shared<Field_t>(*solver->get_initial_conditions_in_cartesian_coords(*set).u);
+        auto new_field = std::make_shared<Field_t>(n * n, n);
+        const double t_step = set->get_coord_by_label("T")->step;
+        return [=]()
+        {
+            solver->douglas_gottlieb_method(*set, *prev_field, *new_field, 0.0, t_step);
+            g_Sink = g_Sink + (*new_field)(n * n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(douglas_gottlieb);
+
+    Benchmark_t sparse_multiply;
+    sparse_multiply.name = "SparseMatrix::multiply";
+    sparse_multiply.description = "y = A x with the 5-point matrix of an n x n grid (kept by diagonals, one thread)";
+    sparse_multiply.bytes_per_node = 7 * sizeof(double);
+    sparse_multiply.setup = [](int n) -> std::function<void()>
+    {
+        std::vector<MathModule::SparseMatrix::Entry_t> entries;
+        for (int k = 0; k < n * n; ++k)
+        {
+            if (k >= n) entries.push_back({ k, k - n, -1.0 });
+            if (k % n > 0) entries.push_back({ k, k - 1, -1.0 });
+            entries.push_back({ k, k, 4.5 });
+            if (k % n < n - 1) entries.push_back({ k, k + 1, -1.0 });
+            if (k < n * n - n) entries.push_back({ k, k + n, -1.0 });
+        }
+        auto matrix = std::make_shared<MathModule::SparseMatrix>();
+        matrix->assemble(n * n, n * n, entries);
+        auto x = std::make_shared<std::vector<double>>(size_t(n) * n, 1.0);
+        auto y = std::make_shared<std::vector<double>>(size_t(n) * n);
+        return [=]()
+        {
+            matrix->multiply(x->data(), y->data());
+            g_Sink = g_Sink + float((*y)[n / 2]);
+        };
+    };
+    benchmarks.push_back(sparse_multiply);
+
+    Benchmark_t crank_nicolson_heat;
+    crank_nicolson_heat.name = "crank_nicolson_method (heat)";
+    crank_nicolson_heat.description = "an unsplit Crank-Nicolson step of the heat equation on an n x n grid (CG with ILU(0), one thread)";
+    crank_nicolson_heat.bytes_per_node = 2 * sizeof(float);
+    crank_nicolson_heat.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Cartesian);
+        set_grid_size(*set, n);
+        auto solver = std::make_shared<HeatEquationBenchmark>();
+        auto prev_field = std::make_shared<Field_t>(*solver->get_initial_conditions_in_cartesian_coords(*set).u);
+        auto new_field = std::make_shared<Field_t>(n, n);
+        const double t_step = set->get_coord_by_label("T")->step;
+        return [=]()
+        {
+            solver->crank_nicolson_method(*set, *prev_field, *new_field, 0.0, t_step);
+            g_Sink = g_Sink + (*new_field)(n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(crank_nicolson_heat);
+
+    Benchmark_t explicit_heat;
+    explicit_heat.name = "explicit_method";
+    explicit_heat.description = "a step of the explicit heat equation scheme on an n x n grid (one thread)";
+    explicit_heat.bytes_per_node = 2 * sizeof(float);
+    explicit_heat.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Cartesian);
+        set_grid_size(*set, n);
+        auto solver = std::make_shared<HeatEquationBenchmark>();
+        auto prev_field = std::make_shared<Field_t>(*solver->get_initial_conditions_in_cartesian_coords(*set).u);
+        auto new_field = std::make_shared<Field_t>(n, n);
+        const double t_step = set->get_coord_by_label("T")->step;
+        return [=]()
+        {
+            solver->explicit_method(*set, *prev_field, *new_field, 0.0, t_step);
+            g_Sink = g_Sink + (*new_field)(n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(explicit_heat);
+
+    Benchmark_t explicit_blocked;
+    explicit_blocked.name = "explicit_steps 8";
+    explicit_blocked.description = "8 steps of the explicit heat equation scheme in cache-sized tiles on an n x n grid (one thread)";
+    explicit_blocked.bytes_per_node = 2 * sizeof(float);
+    explicit_blocked.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Cartesian);
+        set_grid_size(*set, n);
+        auto solver = std::make_shared<HeatEquationBenchmark>();
+        auto prev_field = std::make_shared<Field_t>(*solver->get_initial_conditions_in_cartesian_coords(*set).u);
+        auto new_field = std::make_shared<Field_t>(n, n);
+        return [=]()
+        {
+            solver->explicit_steps(*set, *prev_field, *new_field, 0, 8);
+            g_Sink = g_Sink + (*new_field)(n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(explicit_blocked);
+
+    Benchmark_t multigrid;
+    multigrid.name = "multigrid V-cycle";
+    multigrid.description = "a V-cycle of the Poisson equation solver from a zero guess on an n x n grid (one thread)";
+    multigrid.bytes_per_node = 3 * sizeof(double);
+    multigrid.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Cartesian);
+        set_grid_size(*set, n);
+        auto solver = std::make_shared<PoissonEquationBenchmark>();
+        solver->build_levels(*set);
+        solver->m_Levels.front().f.fill(1.0);
+        return [=]()
+        {
+            solver->m_Levels.front().u.fill(0.0);
+            solver->cycle(0, 1);
+            g_Sink = g_Sink + float(solver->m_Levels.front().u(n / 2, n / 2));
+        };
+    };
+    benchmarks.push_back(multigrid);
+
+    Benchmark_t crank_nicolson;
+    crank_nicolson.name = "crank_nicolson_method";
+    crank_nicolson.description = "a step of the wave equation on a radial profile of n nodes (an n x n polar grid, with 𝛿u/𝛿t)";
+    crank_nicolson.bytes_per_node = 3 * sizeof(float);
+    crank_nicolson.radial = true;
+    crank_nicolson.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Polar);
+        set_grid_size(*set, n);
+        auto solver = std::make_shared<WaveEquationBenchmark>();
+        GraphDataSlice_t init_slice = solver->get_initial_profiles(*set);
+        auto cur_u = init_slice.u;
+        auto init_u_t = init_slice.u_t;
+        auto prev_u = std::make_shared<Field_t>(*cur_u);
+        auto new_u = std::make_shared<Field_t>(n, 1);
+        auto new_u_t = std::make_shared<Field_t>(n, 1);
+        return [=]()
+        {
+            solver->crank_nicolson_method(*set, prev_u.get(), *cur_u, *init_u_t, *new_u, new_u_t.get(), 0.0);
+            g_Sink = g_Sink + (*new_u)(n / 2, 0);
+        };
+    };
+    benchmarks.push_back(crank_nicolson);
+
+    Benchmark_t leapfrog;
+    leapfrog.name = "leapfrog_method";
+    leapfrog.description = "a step of the explicit wave equation scheme on a radial profile of n nodes (an n x n polar grid, with 𝛿u/𝛿t)";
+    leapfrog.bytes_per_node = 3 * sizeof(float);
+    leapfrog.radial = true;
+    leapfrog.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Polar);
+        set_grid_size(*set, n);
+        auto solver = std::make_shared<WaveEquationBenchmark>();
+        GraphDataSlice_t init_slice = solver->get_initial_profiles(*set);
+        auto cur_u = init_slice.u;
+        auto init_u_t = init_slice.u_t;
+        auto prev_u = std::make_shared<Field_t>(*cur_u);
+        auto new_u = std::make_shared<Field_t>(n, 1);
+        auto new_u_t = std::make_shared<Field_t>(n, 1);
+        return [=]()
+        {
+            solver->leapfrog_method(*set, prev_u.get(), *cur_u, *init_u_t, *new_u, new_u_t.get(), 0.0);
+            g_Sink = g_Sink + (*new_u)(n / 2, 0);
+        };
+    };
+    benchmarks.push_back(leapfrog);
+
+    Benchmark_t wave_adi;
+    wave_adi.name = "adi_method";
+    wave_adi.description = "a step of the wave equation ADI scheme on an n x n polar grid (with 𝛿u/𝛿t, one thread)";
+    wave_adi.bytes_per_node = 4 * sizeof(float);
+    wave_adi.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Polar);
+        set_grid_size(*set, n);
+        QVariantMap map = set->toQVariantMap();
+        map.insert("stepF1", float(2 * M_PI / n));
+        set->reset(map);
+        auto solver = std::make_shared<WaveEquationBenchmark>();
+        GraphDataSlice_t init_slice = solver->get_initial_conditions_in_polar_coords(*set);
+        auto cur_u = init_slice.u;
+        auto init_u_t = init_slice.u_t;
+        auto prev_u = std::make_shared<Field_t>(*cur_u);
+        auto new_u = std::make_shared<Field_t>(n, n);
+        auto new_u_t = std::make_shared<Field_t>(n, n);
+        return [=]()
+        {
+            solver->adi_method(*set, prev_u.get(), *cur_u, *init_u_t, *new_u, new_u_t.get(), 0.0);
+            g_Sink = g_Sink + (*new_u)(n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(wave_adi);
+
+    for (auto coords_type : {PdeSettings::CoordsType::Cartesian, PdeSettings::CoordsType::Polar})
+    {
+        const bool cartesian = (coords_type == PdeSettings::CoordsType::Cartesian);
+        Benchmark_t initial_conditions;
+        initial_conditions.name = cartesian ? "get_initial_conditions_in_cartesian_coords" : "get_initial_conditions_in_polar_coords";
+        initial_conditions.description = "u(x, 0) and 𝛿u/𝛿t(x, 0) on an n x n grid with the default expressions";
+        initial_conditions.bytes_per_node = 2 * sizeof(float);
+        initial_conditions.setup = [coords_type, cartesian](int n) -> std::function<void()>
+        {
+            auto set = std::make_shared<PdeSettings>(coords_type);
+            set_grid_size(*set, n);
+            auto heat_solver = std::make_shared<HeatEquationBenchmark>();
+            auto wave_solver = std::make_shared<WaveEquationBenchmark>();
+            return [=]()
+            {
+                GraphDataSlice_t slice = cartesian ? heat_solver->get_initial_conditions_in_cartesian_coords(*set)
+                                                   : wave_solver->get_initial_conditions_in_polar_coords(*set);
+                g_Sink = g_Sink + (*slice.u)(n / 2, n / 2);
+            };
+        };
+        benchmarks.push_back(initial_conditions);
+    }
+
+    Benchmark_t expression;
+    expression.name = "PdeSettings::evaluate_expression";
+    expression.description = "V1 at the n x n nodes one by one (the scalar path)";
+    expression.bytes_per_node = sizeof(float);
+    expression.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Cartesian);
+        set_grid_size(*set, n);
+        auto x1 = std::make_shared<std::vector<float>>(set->get_coord_by_label("X1")->nodes());
+        auto x2 = std::make_shared<std::vector<float>>(set->get_coord_by_label("X2")->nodes());
+        auto out = std::make_shared<Field_t>(n, n);
+        return [=]()
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                float* row = out->row(i);
+                for (int j = 0; j < n; ++j) row[j] = set->V1(QVector2D((*x1)[i], (*x2)[j]));
+            }
+            g_Sink = g_Sink + (*out)(n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(expression);
+
+    Benchmark_t expression_grid;
+    expression_grid.name = "PdeSettings::evaluate_expression_grid";
+    expression_grid.description = "V1 on the n x n grid with the vectorized kernels";
+    expression_grid.bytes_per_node = sizeof(float);
+    expression_grid.setup = [](int n) -> std::function<void()>
+    {
+        auto set = std::make_shared<PdeSettings>(PdeSettings::CoordsType::Cartesian);
+        set_grid_size(*set, n);
+        auto x1 = std::make_shared<std::vector<float>>(set->get_coord_by_label("X1")->nodes());
+        auto x2 = std::make_shared<std::vector<float>>(set->get_coord_by_label("X2")->nodes());
+        auto out = std::make_shared<Field_t>(n, n);
+        return [=]()
+        {
+            set->V1_grid(x1->data(), n, x2->data(), n, out->data(), out->stride());
+            g_Sink = g_Sink + (*out)(n / 2, n / 2);
+        };
+    };
+    benchmarks.push_back(expression_grid);
+
+    return benchmarks;
+}
+
+/**
+ * @brief Runs the kernel once to warm up the caches, then at least min_repetitions times and for at least min_time_ms.
+ */
+static BenchmarkResult_t run_benchmark(const Benchmark_t& benchmark, int n, int min_repetitions, double min_time_ms)
+{
+    const int max_repetitions = 1000;
+
+    BenchmarkResult_t result;
+    result.name = benchmark.name;
+    result.size = n;
+    result.nodes = benchmark.radial ? n : (benchmark.volume ? qint64(n) * n * n : qint64(n) * n);
+    result.bytes_per_node = benchmark.bytes_per_node;
+
+    std::function<void()> kernel = benchmark.setup(n);
+    kernel();
+
+    QElapsedTimer timer;
+    double total_ns = 0;
+    while ((int(result.times_ns.size()) < min_repetitions) ||
+           ((total_ns < min_time_ms * 1e6) && (int(result.times_ns.size()) < max_repetitions)))
+    {
+        timer.start();
+        kernel();
+        const double time_ns = double(timer.nsecsElapsed());
+        result.times_ns.push_back(time_ns);
+        total_ns += time_ns;
+    }
+    std::sort(result.times_ns.begin(), result.times_ns.end());
+
+    return result;
+}
+
+static QJsonObject to_json(const BenchmarkResult_t& result)
+{
+    const double nodes = double(result.nodes);
+
+    QJsonObject object;
+    object.insert("kernel", result.name);
+    object.insert("size", result.size);
+    object.insert("nodes", double(result.nodes));
+    object.insert("repetitions", int(result.times_ns.size()));
+    object.insert("time_ms_median", result.median_ns() / 1e6);
+    object.insert("time_ms_min", result.min_ns() / 1e6);
+    object.insert("ns_per_node", result.median_ns() / nodes);
+    object.insert("ns_per_node_min", result.min_ns() / nodes);
+    object.insert("ns_per_node_mean", result.mean_ns() / nodes);
+    object.insert("ns_per_node_stddev", result.stddev_ns() / nodes);
+    object.insert("variance_ns2_per_node2", std::pow(result.stddev_ns() / nodes, 2));
+    object.insert("relative_stddev", result.stddev_ns() / result.mean_ns());
+    object.insert("bytes_per_node", result.bytes_per_node);
+    object.insert("gb_per_s", result.bytes_per_node * nodes / result.median_ns());
+    return object;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("pde_benchmarks");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the numerical kernels of the solvers on n x n grids and writes the results as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption output_option(QStringList() << "o" << "output", "The results file (benchmarks.json by default).", "file", "benchmarks.json");
+    QCommandLineOption min_size_option("min-size", "The smallest n (32 by default).", "n", "32");
+    QCommandLineOption max_size_option("max-size", "The largest n (4096 by default), n is doubled from min-size.", "n", "4096");
+    QCommandLineOption repetitions_option(QStringList() << "r" << "repetitions", "The minimum number of timed runs (5 by default).", "count", "5");
+    QCommandLineOption min_time_option("min-time", "The minimum total time of the timed runs in ms (200 by default).", "ms", "200");
+    QCommandLineOption filter_option(QStringList() << "f" << "filter", "Runs only the kernels whose names contain the text.", "text");
+    QCommandLineOption list_option(QStringList() << "l" << "list", "Lists the kernels and exits.");
+    parser.addOption(output_option);
+    parser.addOption(min_size_option);
+    parser.addOption(max_size_option);
+    parser.addOption(repetitions_option);
+    parser.addOption(min_time_option);
+    parser.addOption(filter_option);
+    parser.addOption(list_option);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    try
+    {
+        std::vector<Benchmark_t> benchmarks = make_benchmarks();
+        if (parser.isSet(list_option))
+        {
+            for (const auto& benchmark : benchmarks) out << benchmark.name << ": " << benchmark.description << endl;
+            return 0;
+        }
+
+        const int min_size = parser.value(min_size_option).toInt();
+        const int max_size = parser.value(max_size_option).toInt();
+        const int min_repetitions = parser.value(repetitions_option).toInt();
+        const double min_time_ms = parser.value(min_time_option).toDouble();
+        if ((min_size < 4) || (max_size < min_size)) throw("Wrong grid sizes");
+        if (min_repetitions < 1) throw("The number of repetitions must be positive");
+
+        QJsonArray results;
+        for (const auto& benchmark : benchmarks)
+        {
+            if (parser.isSet(filter_option) && !benchmark.name.contains(parser.value(filter_option))) continue;
+
+            for (int n = min_size; n <= max_size; n *= 2)
+            {
+                if (benchmark.volume && (n > MaxVolumeSize)) break;
+                BenchmarkResult_t result = run_benchmark(benchmark, n, min_repetitions, min_time_ms);
+                QJsonObject object = to_json(result);
+                results.append(object);
+
+                out << benchmark.name.leftJustified(44) << QString::number(n).rightJustified(6)
+                    << "  " << QString::number(object.value("ns_per_node").toDouble(), 'f', 3) << " ns/node"
+                    << "  +-" << QString::number(100 * object.value("relative_stddev").toDouble(), 'f', 1) << "%"
+                    << "  " << QString::number(object.value("gb_per_s").toDouble(), 'f', 2) << " GB/s" << endl;
+            }
+        }
+
+        QJsonObject document;
+        document.insert("benchmarks", results);
+        document.insert("min_repetitions", min_repetitions);
+        document.insert("min_time_ms", min_time_ms);
+
+        QFile file(parser.value(output_option));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) throw("Cannot open the results file");
+        file.write(QJsonDocument(document).toJson());
+        file.close();
+
+        out << "results written to " << parser.value(output_option) << endl;
+    }
+    catch (const char* msg)
+    {
+        err << "Error: " << msg << endl;
+        return 1;
+    }
+    catch (const std::exception& e)
+    {
+        err << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,25 @@
+lessThan(QT_MAJOR_VERSION, 5): error("Qt5 or newer is required")
+TEMPLATE = app
+QT = core
+CONFIG += console
+CONFIG -= app_bundle
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../pde_solver/pde_solver.pri)
+
+TARGET = pde_benchmarks
+
+CONFIG(release, debug|release) 
+{
+	CONFIGURATION = release
+}
+CONFIG(debug, debug|release) 
+{
+	CONFIGURATION = debug
+}
+
+OBJECTS_DIR = $${CONFIGURATION}/.obj
+MOC_DIR = $${CONFIGURATION}/.moc
+DESTDIR = $${CONFIGURATION}
+
+SOURCES += main.cpp
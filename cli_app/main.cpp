@@ -0,0 +1,293 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <csignal>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+#include "../pde_solver/pde_solver_heat_equation.h"
+#include "../pde_solver/pde_solver_wave_equation.h"
+#include "../pde_solver/pde_solver_poisson_equation.h"
+#include "../pde_solver/pde_sweep.h"
+
+static QVariantMap read_json_file(const QString& filename)
+{
+    QFile json_file(filename);
+    if (!json_file.open(QIODevice::ReadOnly | QIODevice::Text)) throw std::runtime_error("Cannot open " + filename.toStdString());
+
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(json_file.readAll(), &error);
+    json_file.close();
+    if (document.isNull()) throw std::runtime_error(filename.toStdString() + " is not a valid JSON document");
+
+    return document.object().toVariantMap();
+}
+
+/**
+ * @brief Reads the settings in the format of gui_app/pde_settings.json (see MainWindow::init_pde_settings).
+ */
+static PdeSettings read_pde_settings(const QString& filename)
+{
+    QVariantMap map = read_json_file(filename);
+    return PdeSettings(map);
+}
+
+// the solver or the sweep a Ctrl+C cancels (their cancel() only sets an atomic flag, so it is safe in a signal handler)
+static PdeSolverBase* g_RunningSolver = NULL;
+static PdeSolver::Sweep* g_RunningSweep = NULL;
+static volatile std::sig_atomic_t g_Interrupted = 0;
+
+static void interrupt_handler(int)
+{
+    g_Interrupted = 1;
+    if (g_RunningSolver) g_RunningSolver->cancel();
+    if (g_RunningSweep) g_RunningSweep->cancel();
+}
+
+static std::shared_ptr<PdeSolverBase> make_pde_solver(const QString& equation,
+                                                     const std::shared_ptr<PdeSolver::SolutionCache>& cache = std::shared_ptr<PdeSolver::SolutionCache>())
+{
+    std::shared_ptr<PdeSolverBase> solver;
+    if (equation == "heat") solver = std::make_shared<PdeSolverHeatEquation>();
+    else if (equation == "wave") solver = std::make_shared<PdeSolverWaveEquation>();
+    else if (equation == "poisson") solver = std::make_shared<PdeSolverPoissonEquation>();
+    else throw("Wrong equation. Must be \"heat\", \"wave\" or \"poisson\"");
+
+    solver->set_solution_cache(cache);
+    return solver;
+}
+
+/**
+ * @brief Solves the runs of a sweep (see PdeSolver::Sweep), writes summary.json and prints a line per run.
+ */
+static int run_sweep(const PdeSettings& set, const QVariantMap& description, const QString& equation,
+                     const PdeSolver::SolutionMethod_t& method, const QString& output_dir, int jobs,
+                     const std::shared_ptr<PdeSolver::SolutionCache>& cache)
+{
+    QTextStream out(stdout);
+
+    PdeSolver::Sweep sweep(set, description);
+    g_RunningSweep = &sweep;
+    std::signal(SIGINT, interrupt_handler);
+    sweep.run([&equation, &cache]() { return make_pde_solver(equation, cache); }, method, output_dir, jobs);
+    std::signal(SIGINT, SIG_DFL);
+    g_RunningSweep = NULL;
+
+    QJsonObject summary = sweep.summary();
+    QString summary_filename = QDir(output_dir).filePath("summary.json");
+    QFile summary_file(summary_filename);
+    if (!summary_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) throw("Cannot write the sweep summary");
+    summary_file.write(QJsonDocument(summary).toJson());
+    summary_file.close();
+
+    out << "equation: " << equation << ", method: " << method.name << " (" << method.coord_system << ")" << endl;
+    bool all_done = true;
+    for (const auto& run : sweep.runs())
+    {
+        out << "run " << run.index << ": " << run.status;
+        if (run.status == "failed") out << " (" << run.error << ")";
+        else if (run.status != "skipped") out << ", " << run.slices << " slices to " << run.output_file << ", " << run.solve_ms << " ms";
+        out << endl;
+        all_done = all_done && (run.status == "done");
+    }
+    out << sweep.runs().size() << " runs, " << summary["jobs"].toInt() << " at a time, " << summary["wallMs"].toDouble() << " ms, summary written to "
+        << summary_filename << endl;
+
+    return all_done ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("pde_solver_cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Solves a pde equation without the GUI and writes the solution to a solution file.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("settings", "The settings file (the format of pde_settings.json).", "[settings]");
+    QCommandLineOption equation_option(QStringList() << "e" << "equation",
+        "The equation: heat, wave or poisson (by default the one for the coordinates of the settings).", "equation");
+    QCommandLineOption method_option(QStringList() << "m" << "method",
+        "The solution method (by default the first one for the coordinates of the settings).", "method");
+    QCommandLineOption output_option(QStringList() << "o" << "output",
+        "The solution file (by default outputFile of the settings, solution.pdesol or solution.pdesnap if compressed).", "file");
+    QCommandLineOption trace_option(QStringList() << "t" << "trace",
+        "Times the phases of the solve, prints a summary and writes a Chrome trace to the file (traceFile of the settings).", "file");
+    QCommandLineOption checkpoint_option(QStringList() << "c" << "checkpoint",
+        "Saves checkpoints to the file (every checkpointEvery steps and on Ctrl+C) and resumes from it if it holds the same problem.", "file");
+    QCommandLineOption sweep_option(QStringList() << "s" << "sweep",
+        "Solves the runs of the sweep file (\"runs\": a list of settings overrides, \"grid\": lists of values of settings entries) "
+        "several at a time and writes them and summary.json to the output directory (by default sweep).", "file");
+    QCommandLineOption jobs_option(QStringList() << "j" << "jobs",
+        "The number of sweep runs solved at the same time (by default one per hardware thread).", "n");
+    QCommandLineOption cache_option(QStringList() << "cache",
+        "Loads the solution from the cache directory if it holds the same problem, otherwise stores it there.", "dir");
+    QCommandLineOption list_option(QStringList() << "l" << "list-methods", "Lists the methods of the equation and exits.");
+    parser.addOption(equation_option);
+    parser.addOption(method_option);
+    parser.addOption(output_option);
+    parser.addOption(trace_option);
+    parser.addOption(checkpoint_option);
+    parser.addOption(sweep_option);
+    parser.addOption(jobs_option);
+    parser.addOption(cache_option);
+    parser.addOption(list_option);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    try
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        QString settings_filename = parser.positionalArguments().isEmpty() ? QString("pde_settings.json") : parser.positionalArguments().first();
+        PdeSettings set = parser.isSet(list_option) ? PdeSettings() : read_pde_settings(settings_filename);
+
+        QString coord_system = (set.m_CoordsType == PdeSettings::CoordsType::Cartesian) ? "Cartesian" : "Polar";
+        QString equation = parser.isSet(equation_option) ? parser.value(equation_option) : ((coord_system == "Cartesian") ? "heat" : "wave");
+        std::shared_ptr<PdeSolver::SolutionCache> cache;
+        if (parser.isSet(cache_option)) cache = std::make_shared<PdeSolver::SolutionCache>(parser.value(cache_option));
+        std::shared_ptr<PdeSolverBase> solver = make_pde_solver(equation, cache);
+
+        QVector<PdeSolver::SolutionMethod_t> methods = solver->get_implemented_methods();
+        if (parser.isSet(list_option))
+        {
+            for (const auto& method : methods) out << method.name << " (" << method.coord_system << ", " << method.dim << "d)" << endl;
+            return 0;
+        }
+
+        PdeSolver::SolutionMethod_t method;
+        bool method_found = false;
+        for (const auto& candidate : methods)
+        {
+            // by default the first method for the coordinates and the dimension of the grid
+            bool matches = parser.isSet(method_option) ? (candidate.name == parser.value(method_option))
+                                                       : ((candidate.coord_system == coord_system) && (candidate.dim == set.m_Dim));
+            if (matches)
+            {
+                method = candidate;
+                method_found = true;
+                break;
+            }
+        }
+        if (!method_found) throw("No such method for the equation (see --list-methods)");
+
+        if (parser.isSet(sweep_option))
+        {
+            if (parser.isSet(trace_option) || parser.isSet(checkpoint_option)) throw("--trace and --checkpoint cannot be used with --sweep");
+            QString output_dir = parser.isSet(output_option) ? parser.value(output_option) : QString("sweep");
+            int jobs = parser.isSet(jobs_option) ? parser.value(jobs_option).toInt() : 0;
+            return run_sweep(set, read_json_file(parser.value(sweep_option)), equation, method, output_dir, jobs, cache);
+        }
+
+        QString stability_error = solver->check_stability(set, method);
+        if (!stability_error.isEmpty())
+        {
+            err << "Error: " << stability_error << endl;
+            return 1;
+        }
+
+        // the solver appends the output slices to a solution file while it runs, unless the compression is on:
+        // then the slices are kept in a snapshot store which is saved when the solver is done
+        const bool compressed = (set.compression != "none");
+        QString output_filename = parser.isSet(output_option) ? parser.value(output_option) : set.output_file;
+        if (output_filename.isEmpty()) output_filename = compressed ? "solution.pdesnap" : "solution.pdesol";
+        set.output_file = compressed ? QString() : output_filename;
+        if (parser.isSet(trace_option)) set.trace_file = parser.value(trace_option);
+        if (parser.isSet(checkpoint_option))
+        {
+            set.checkpoint_file = parser.value(checkpoint_option);
+            set.resume = true;
+        }
+
+        qint64 load_ms = timer.restart();
+
+        // the solver lives in this thread, so solve() runs get_solution() and emits the result right away
+        PdeSolver::GraphSolution_t solution;
+        QObject::connect(solver.get(), &PdeSolverBase::solution_generated,
+                         [&solution](PdeSolver::GraphSolution_t generated) { solution = generated; });
+        QObject::connect(solver.get(), &PdeSolverBase::solution_cancelled, [&solution]() { solution = PdeSolver::GraphSolution_t(); });
+        QString solve_error;
+        QObject::connect(solver.get(), &PdeSolverBase::solution_failed, [&solve_error](QString error) { solve_error = error; });
+        // the last progress text (e.g. the cycles and the residual of the Poisson equation) is printed with the summary
+        QString last_progress;
+        QObject::connect(solver.get(), &PdeSolverBase::solution_progress_update,
+                         [&last_progress](QString text, int) { last_progress = text; });
+        g_RunningSolver = solver.get();
+        std::signal(SIGINT, interrupt_handler);
+        solver->solve(set, method);
+        std::signal(SIGINT, SIG_DFL);
+        g_RunningSolver = NULL;
+        if (!solve_error.isEmpty())
+        {
+            err << "Error: " << solve_error << endl;
+            return 1;
+        }
+
+        qint64 solve_ms = timer.restart();
+
+        if (compressed && solution.graph_data.store) solution.graph_data.store->save(output_filename, solution.set);
+
+        qint64 write_ms = timer.restart();
+
+        out << "equation: " << equation << ", method: " << method.name << " (" << method.coord_system << ")" << endl;
+        if (g_Interrupted)
+        {
+            out << "cancelled" << (set.checkpoint_file.isEmpty() ? QString() : ", run the same command to resume from " + set.checkpoint_file) << endl;
+        }
+        if (!last_progress.isEmpty()) out << "progress: " << last_progress << endl;
+        out << "slices written: " << solution.graph_data.t_list.size() << " to " << output_filename << endl;
+        if (compressed && solution.graph_data.store)
+        {
+            out << "compression: " << set.compression << ", " << solution.graph_data.store->compressed_bytes() << " of "
+                << solution.graph_data.store->raw_bytes() << " bytes" << endl;
+        }
+        out << "load: " << load_ms << " ms, solve: " << solve_ms << " ms, write: " << write_ms << " ms" << endl;
+        if (!solution.profile_summary.isEmpty()) out << solution.profile_summary;
+        if (!set.trace_file.isEmpty()) out << "trace written to " << set.trace_file << endl;
+    }
+    catch (const char* msg)
+    {
+        err << "Error: " << msg << endl;
+        return 1;
+    }
+    catch (const std::exception& e)
+    {
+        err << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -26,8 +26,9 @@ SOFTWARE.
 #include <memory>
 
 #include <QtCore/qmath.h>
-#include <QScriptEngine>
 #include <QSlider>
+#include <QStandardPaths>
+#include <stdexcept>
 
 using namespace QtDataVisualization;
 
@@ -46,6 +47,16 @@ MainWindow::MainWindow(QWidget *parent)
 	m_PdeSettingsFilename = "pde_settings.json";
 	m_PdeSettings = init_pde_settings(m_PdeSettingsFilename);
 
+	// without the cache every Evaluate solves again
+	try
+	{
+		m_SolutionCache = std::make_shared<PdeSolver::SolutionCache>(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/solutions");
+	}
+	catch (const char* msg)
+	{
+		qDebug() << "MainWindow: the solution cache is off:" << msg;
+	}
+
 	init_EquationComboBox();
 	init_graph();
 	set_PdeSettingsTableWidget(*m_PdeSettings);
@@ -57,6 +68,7 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+	if (m_PdeSolver) m_PdeSolver->cancel();
 	m_GraphThread.quit();
 	m_GraphThread.wait();
 
@@ -68,6 +80,11 @@ MainWindow::~MainWindow()
 	delete m_GraphCurrentTimeSlider;
 	delete m_GraphCurrentTimeLayout;
 
+	delete m_GraphCutLabel;
+	delete m_GraphCutAxisComboBox;
+	delete m_GraphCutSlider;
+	delete m_GraphCutLayout;
+
 	delete m_PlayStopPushButton;
 	delete m_NextSlidePushButton;
 	delete m_PrevSlidePushButton;
@@ -87,7 +104,21 @@ void MainWindow::start()
 
 	m_GraphThread.start();
 	change_pde_solver("Wave equation");
-	m_PdeSolver->solve(get_pde_settings_from_TableWidget(), ui.MethodsComboBox->currentData().value<PdeSolver::SolutionMethod_t>());
+
+	PdeSettings set;
+	try
+	{
+		set = get_pde_settings_from_TableWidget();
+	}
+	catch (const std::invalid_argument& e)
+	{
+		solution_progress_updated(QString::fromStdString(e.what()), 0);
+		set_solving(false);
+		return;
+	}
+
+	set_solving(true);
+	m_PdeSolver->solve(set, ui.MethodsComboBox->currentData().value<PdeSolver::SolutionMethod_t>());
 }
 
 void MainWindow::init_graph()
@@ -166,13 +197,41 @@ void MainWindow::init_graph()
 	m_GraphCurrentTimeLayout->addWidget(m_LastSlidePushButton);
 	m_GraphCurrentTimeLayout->addWidget(m_GraphCurrentTimeSlider);
 
+	//setting graph cut layout (a 3d solution is shown by its cuts across an axis)
+	m_GraphCutLabel = new QLabel("Cut:");
+	m_GraphCutAxisComboBox = new QComboBox();
+	m_GraphCutSlider = new QSlider(Qt::Horizontal);
+	m_GraphCutLayout = new QHBoxLayout();
+
+	m_GraphCutLabel->setMinimumWidth(200);
+
+	m_GraphCutAxisComboBox->addItem("across X1");
+	m_GraphCutAxisComboBox->addItem("across X2");
+	m_GraphCutAxisComboBox->addItem("across X3");
+	m_GraphCutAxisComboBox->setCurrentIndex(m_CutAxis);
+
+	m_GraphCutSlider->setMinimum(0);
+	m_GraphCutSlider->setMaximum(0);
+	m_GraphCutSlider->setSingleStep(1);
+
+	m_GraphCutLayout->addWidget(m_GraphCutLabel);
+	m_GraphCutLayout->addWidget(m_GraphCutAxisComboBox);
+	m_GraphCutLayout->addWidget(m_GraphCutSlider);
+
+	m_GraphCutLabel->setVisible(false);
+	m_GraphCutAxisComboBox->setVisible(false);
+	m_GraphCutSlider->setVisible(false);
+
 	m_GraphWidget = QWidget::createWindowContainer(m_Graph);
 
 	ui.GraphLayout->addWidget(m_GraphWidget);
 	ui.GraphLayout->addLayout(m_GraphTimeSpeedLayout);
 	ui.GraphLayout->addLayout(m_GraphCurrentTimeLayout);
+	ui.GraphLayout->addLayout(m_GraphCutLayout);
 
 	connect(m_GraphTimeSpeedSlider, SIGNAL(actionTriggered(int)), this, SLOT(GraphTimeSpeedSlider_changed(int)));
+	connect(m_GraphCutAxisComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(GraphCut_changed()));
+	connect(m_GraphCutSlider, SIGNAL(valueChanged(int)), this, SLOT(GraphCut_changed()));
 
 	//set the current value of EquationComboBox
 	int i;
@@ -211,7 +270,7 @@ void MainWindow::PlayStopPushButton_clicked()
 void MainWindow::NextSlidePushButton_clicked()
 {
 	if (!m_GraphIsValid) return;
-	set_TimeSlice((m_CurrentTimeSlice < m_PdeSettings->get_coord_by_label("T")->count - 1) ? m_CurrentTimeSlice + 1 : m_CurrentTimeSlice);
+	set_TimeSlice((m_CurrentTimeSlice < time_slice_count() - 1) ? m_CurrentTimeSlice + 1 : m_CurrentTimeSlice);
 }
 
 void MainWindow::PrevSlidePushButton_clicked()
@@ -229,7 +288,7 @@ void MainWindow::FirstSlidePushButton_clicked()
 void MainWindow::LastSlidePushButton_clicked()
 {
 	if (!m_GraphIsValid) return;
-	set_TimeSlice(m_PdeSettings->get_coord_by_label("T")->count - 1);
+	set_TimeSlice(time_slice_count() - 1);
 }
 
 void MainWindow::GraphTimeSpeedSlider_changed(int action)
@@ -245,6 +304,15 @@ void MainWindow::GraphTimeSpeedSlider_changed(int action)
 	}
 }
 
+void MainWindow::GraphCut_changed()
+{
+	m_CutAxis = m_GraphCutAxisComboBox->currentIndex();
+	m_CutIndex = m_GraphCutSlider->value();
+	update_GraphCut();
+
+	if (m_GraphIsValid) set_TimeSlice(m_CurrentTimeSlice);
+}
+
 void MainWindow::set_PdeSettingsTableWidget(const PdeSettings& set)
 {
 	ui.PdeSettingsTableWidget->verticalHeader()->setVisible(false);
@@ -289,9 +357,20 @@ std::shared_ptr<PdeSettings> MainWindow::init_pde_settings(QString pde_settings_
 		QJsonObject json_obj = document.object();
 		QVariantMap map = json_obj.toVariantMap();
 
-		PdeSettings set(map);
+		// an expression which does not compile any more must not keep the app from starting
+		try
+		{
+			PdeSettings set(map);
+			return std::make_shared<PdeSettings>(set);
+		}
+		catch (const std::invalid_argument& e)
+		{
+			qDebug() << "MainWindow: the settings file is not valid, using the default settings:" << e.what();
 
-		return std::make_shared<PdeSettings>(set);
+			PdeSettings set;
+			set.set_coords_type(PdeSettings::CoordsType::Polar, 2);
+			return std::make_shared<PdeSettings>(set);
+		}
 	}
 	else
 	{
@@ -315,8 +394,10 @@ void MainWindow::init_EquationComboBox()
 {
 	ui.EquationComboBox->addItem("Wave equation");
 	ui.EquationComboBox->addItem("Heat equation");
+	ui.EquationComboBox->addItem("Poisson equation");
 
 	connect(ui.EquationComboBox, SIGNAL(currentIndexChanged(QString)), this, SLOT(change_pde_solver(QString)));
+	connect(ui.MethodsComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(change_method(int)));
 }
 
 void MainWindow::graph_solution_generated(PdeSolver::GraphSolution_t solution)
@@ -330,6 +411,25 @@ void MainWindow::graph_solution_generated(PdeSolver::GraphSolution_t solution)
 	m_GraphData = solution.graph_data;
 	*m_PdeSettings = solution.set;
 
+	// a solution written to a file is replayed from a mapping, only the current slice is loaded
+	m_SolutionFile.reset();
+	if (!solution.solution_file.isEmpty())
+	{
+		try
+		{
+			m_SolutionFile = std::make_shared<PdeSolver::SolutionFileReader>();
+			m_SolutionFile->open(solution.solution_file);
+		}
+		catch (const char* msg)
+		{
+			m_SolutionFile.reset();
+			m_GraphIsValid = false;
+			solution_progress_updated(msg, 0);
+			set_solving(false);
+			return;
+		}
+	}
+
 	//setting graph ranges:
 	if (solution.set.m_CoordsType == PdeSettings::CoordsType::Polar)
 	{
@@ -348,15 +448,14 @@ void MainWindow::graph_solution_generated(PdeSolver::GraphSolution_t solution)
 		m_Graph->axisX()->setRange(m_PdeSettings->get_coord_by_label("X2")->min,
 			m_PdeSettings->get_coord_by_label("X2")->max);
 	}
+	update_GraphCut();
 
 	qDebug() << "Update timer started";
 	m_CurrentTimeSlice = 0;
 
 	toggle_graph_playing(true);
 
-	ui.EvaluatePushButton->setDisabled(false);
-	ui.MethodsComboBox->setDisabled(false);
-	ui.EquationComboBox->setDisabled(false);
+	set_solving(false);
 	if (!m_GraphIsValid)
 	{
 		m_GraphIsValid = true;
@@ -364,7 +463,31 @@ void MainWindow::graph_solution_generated(PdeSolver::GraphSolution_t solution)
 	}
 
 	m_GraphCurrentTimeSlider->setMinimum(0);
-	m_GraphCurrentTimeSlider->setMaximum(m_PdeSettings->get_coord_by_label("T")->count);
+	m_GraphCurrentTimeSlider->setMaximum(time_slice_count() - 1);
+}
+
+void MainWindow::graph_solution_cancelled()
+{
+	qDebug() << "MainWindow::graph_solution_cancelled invoked";
+
+	set_solving(false);
+}
+
+void MainWindow::graph_solution_failed(QString error)
+{
+	qDebug() << "MainWindow::graph_solution_failed invoked:" << error;
+
+	solution_progress_updated(error, 0);
+	set_solving(false);
+}
+
+void MainWindow::set_solving(bool solving)
+{
+	m_Solving = solving;
+	ui.EvaluatePushButton->setText(solving ? "Stop" : "Evaluate");
+	ui.EvaluatePushButton->setDisabled(false);
+	ui.MethodsComboBox->setDisabled(solving);
+	ui.EquationComboBox->setDisabled(solving);
 }
 
 void MainWindow::solution_progress_updated(QString msg, int value)
@@ -383,12 +506,19 @@ void MainWindow::change_pde_solver(QString new_solver)
 	{
 		m_PdeSolver.reset(new PdeSolverWaveEquation());
 	}
-	else throw("Wrong value. Must be \"Heat equation\" or \"Wave equation\"");
+	else if (new_solver == "Poisson equation")
+	{
+		m_PdeSolver.reset(new PdeSolverPoissonEquation());
+	}
+	else throw("Wrong value. Must be \"Heat equation\", \"Wave equation\" or \"Poisson equation\"");
 
+	m_PdeSolver->set_solution_cache(m_SolutionCache);
 	m_PdeSolver->moveToThread(&m_GraphThread);
 
 	connect(m_PdeSolver.get(), SIGNAL(solution_progress_update(QString, int)), this, SLOT(solution_progress_updated(QString, int)), Qt::QueuedConnection);
 	connect(m_PdeSolver.get(), SIGNAL(solution_generated(PdeSolver::GraphSolution_t)), this, SLOT(graph_solution_generated(PdeSolver::GraphSolution_t)), Qt::QueuedConnection);
+	connect(m_PdeSolver.get(), SIGNAL(solution_cancelled()), this, SLOT(graph_solution_cancelled()), Qt::QueuedConnection);
+	connect(m_PdeSolver.get(), SIGNAL(solution_failed(QString)), this, SLOT(graph_solution_failed(QString)), Qt::QueuedConnection);
 
 	//set methods combo box:
 	QVector<PdeSolver::SolutionMethod_t> methods = m_PdeSolver->get_implemented_methods();
@@ -399,57 +529,120 @@ void MainWindow::change_pde_solver(QString new_solver)
 		qvar.setValue(method);
 		ui.MethodsComboBox->addItem(method.name, qvar);
 	}
+	// the table is fit to the first method by change_method
+}
+
+void MainWindow::change_method(int index)
+{
+	if (index < 0) return;
 
-	QString new_coords_system = ui.MethodsComboBox->currentData().value<PdeSolver::SolutionMethod_t>().coord_system;
-	auto pde_settings_from_table = get_pde_settings_from_TableWidget();
-	if ((new_coords_system == "Cartesian") && (pde_settings_from_table.m_CoordsType != PdeSettings::CoordsType::Cartesian))  set_PdeSettingsTableWidget(PdeSettings(PdeSettings::CoordsType::Cartesian, 2));
-	else if ((new_coords_system == "Polar") && (pde_settings_from_table.m_CoordsType != PdeSettings::CoordsType::Polar))  set_PdeSettingsTableWidget(PdeSettings(PdeSettings::CoordsType::Polar, 2));
+	PdeSolver::SolutionMethod_t method = ui.MethodsComboBox->itemData(index).value<PdeSolver::SolutionMethod_t>();
+	PdeSettings::CoordsType new_coords_type;
+	if (method.coord_system == "Cartesian") new_coords_type = PdeSettings::CoordsType::Cartesian;
+	else if (method.coord_system == "Polar") new_coords_type = PdeSettings::CoordsType::Polar;
+	else return;
 
+	PdeSettings pde_settings_from_table;
+	try
+	{
+		pde_settings_from_table = get_pde_settings_from_TableWidget();
+	}
+	catch (const std::invalid_argument& e)
+	{
+		solution_progress_updated(QString::fromStdString(e.what()), 0);
+		return;
+	}
+	if ((pde_settings_from_table.m_CoordsType != new_coords_type) || (pde_settings_from_table.m_Dim != method.dim))
+		set_PdeSettingsTableWidget(PdeSettings(new_coords_type, method.dim));
 }
 
 void MainWindow::clear_graph_data(PdeSolver::GraphData_t& graph_data)
 {
-	for (auto& array_ptr : graph_data.u_list)
-	{
-		for (auto& row_ptr : *array_ptr)
-		{
-			delete row_ptr;
-		}
-		delete array_ptr;
-	}
 	graph_data.u_list.clear();
+	graph_data.u_t_list.clear();
+	graph_data.t_list.clear();
+	graph_data.store.reset();
+}
+
+/**
+ * @brief The axes along the rows and along the columns of a cut of a 3d grid across cut_axis (0, 1, 2 for X1, X2, X3).
+ */
+static void get_cut_coords(const PdeSettings& set, int cut_axis, const PdeSettings::CoordGridSet_t*& coord_row, const PdeSettings::CoordGridSet_t*& coord_col)
+{
+	coord_row = set.get_coord_by_label((cut_axis == 0) ? "X2" : "X1");
+	coord_col = set.get_coord_by_label((cut_axis == 2) ? "X2" : "X3");
+}
+
+/**
+ * @brief Creates a QtDataVisualization array from a cut of a 3d field: the nodes with the index cut_index along cut_axis.
+ * The rows of the field are the (X1, X2) nodes, so only the cut across X3 is gathered with a stride.
+ */
+static QSurfaceDataArray* newSurfaceDataArrayFromVolume(const PdeSolver::Field_t& field, const PdeSettings& set, int cut_axis, int cut_index)
+{
+	const PdeSettings::CoordGridSet_t* coord_row;
+	const PdeSettings::CoordGridSet_t* coord_col;
+	get_cut_coords(set, cut_axis, coord_row, coord_col);
+	const int n2 = set.get_coord_by_label("X2")->count;
 
-	for (auto& array_ptr : graph_data.u_t_list)
+	auto newArray = new QSurfaceDataArray();
+	newArray->reserve(coord_row->count);
+
+	for (int a = 0; a < coord_row->count; a++)
 	{
-		for (auto& row_ptr : *array_ptr)
+		newArray->append(new QSurfaceDataRow(coord_col->count));
+		QSurfaceDataRow& row = *(*newArray)[a];
+		float z_val = coord_row->node(a);
+		for (int b = 0; b < coord_col->count; b++)
 		{
-			delete row_ptr;
+			float value;
+			if (cut_axis == 0) value = field(cut_index * n2 + a, b);
+			else if (cut_axis == 1) value = field(a * n2 + cut_index, b);
+			else value = field(a * n2 + b, cut_index);
+			row[b].setPosition(QVector3D(coord_col->node(b), value, z_val));
 		}
-		delete array_ptr;
 	}
-	graph_data.u_t_list.clear();
+	return newArray;
 }
 
-QSurfaceDataArray* newSurfaceDataArrayFromSource(QSurfaceDataArray& source_surface_data_array,
-	std::function<void(QSurfaceDataItem&)> modifier)
+/**
+ * @brief Creates a QtDataVisualization array from a field. The node positions are restored from the grid settings.
+ * A radially symmetric solution is stored as a profile (a single column), it is expanded along the angle here.
+ * A 3d solution is shown by its cut (see newSurfaceDataArrayFromVolume).
+ */
+QSurfaceDataArray* newSurfaceDataArrayFromField(const PdeSolver::Field_t& field, const PdeSettings& set, int cut_axis, int cut_index)
 {
-	if (source_surface_data_array.empty()) return new QSurfaceDataArray();
+	const PdeSettings::CoordGridSet_t* coord_row;
+	const PdeSettings::CoordGridSet_t* coord_col;
+	if (set.m_CoordsType == PdeSettings::CoordsType::Polar)
+	{
+		coord_row = set.get_coord_by_label("R");
+		coord_col = set.get_coord_by_label("F1");
+	}
+	else if (set.get_coord_by_label("X3"))
+	{
+		return newSurfaceDataArrayFromVolume(field, set, cut_axis, cut_index);
+	}
+	else
+	{
+		coord_row = set.get_coord_by_label("X1");
+		coord_col = set.get_coord_by_label("X2");
+	}
 
-	int sampleCount = source_surface_data_array.size();
-	int countX = source_surface_data_array[0]->size();
+	const bool radial_profile = (field.cols() == 1) && (coord_col->count > 1);
+	const int cols = radial_profile ? coord_col->count : field.cols();
 
 	auto newArray = new QSurfaceDataArray();
-	newArray->reserve(sampleCount);
+	newArray->reserve(field.rows());
 
-	for (int i = 0; i < sampleCount; i++)
+	for (int i = 0; i < field.rows(); i++)
 	{
-		newArray->append(new QSurfaceDataRow(countX));
-		const QSurfaceDataRow& sourceRow = *(source_surface_data_array.at(i));
+		newArray->append(new QSurfaceDataRow(cols));
 		QSurfaceDataRow& row = *(*newArray)[i];
-		for (int j = 0; j < countX; j++)
+		const float* values = field.row(i);
+		float z_val = coord_row->node(i);
+		for (int j = 0; j < cols; j++)
 		{
-			row[j].setPosition(sourceRow.at(j).position());
-			modifier(row[j]);
+			row[j].setPosition(QVector3D(coord_col->node(j), values[radial_profile ? 0 : j], z_val));
 		}
 	}
 	return newArray;
@@ -459,19 +652,59 @@ void MainWindow::set_TimeSlice(int new_time_slice)
 {
 	m_CurrentTimeSlice = new_time_slice;
 
-	auto qsurface_data_array = m_GraphData.u_list.at(m_CurrentTimeSlice);
-	auto modifier = [](QSurfaceDataItem item) -> void { item.position(); };
-
-	m_Series->dataProxy()->resetArray(newSurfaceDataArrayFromSource(*qsurface_data_array, modifier));
+	if (m_SolutionFile)
+	{
+		m_SolutionFile->read_u(m_CurrentTimeSlice, m_CurrentSlice);
+		m_Series->dataProxy()->resetArray(newSurfaceDataArrayFromField(m_CurrentSlice, *m_PdeSettings, m_CutAxis, m_CutIndex));
+	}
+	else if (m_GraphData.store)
+	{
+		m_GraphData.store->read_u(m_CurrentTimeSlice, m_CurrentSlice);
+		m_Series->dataProxy()->resetArray(newSurfaceDataArrayFromField(m_CurrentSlice, *m_PdeSettings, m_CutAxis, m_CutIndex));
+	}
+	else m_Series->dataProxy()->resetArray(newSurfaceDataArrayFromField(*m_GraphData.u_list.at(m_CurrentTimeSlice), *m_PdeSettings, m_CutAxis, m_CutIndex));
 	//m_GraphOccuracyLabel->setText("Occuracy : " + QString::number(m_graph_solution.occuracy[m_current_time]));
 
 	m_GraphCurrentTimeSlider->setValue(m_CurrentTimeSlice);
-	m_GraphCurrentTimeLabel->setText("Current time slice: " + QString::number(m_CurrentTimeSlice));
+	m_GraphCurrentTimeLabel->setText("Current time slice: " + QString::number(m_CurrentTimeSlice) +
+		" (T = " + QString::number(m_GraphData.t_list.at(m_CurrentTimeSlice)) + ")");
+}
+
+void MainWindow::update_GraphCut()
+{
+	const bool volume = (m_PdeSettings->m_CoordsType == PdeSettings::CoordsType::Cartesian) && m_PdeSettings->get_coord_by_label("X3");
+	m_GraphCutLabel->setVisible(volume);
+	m_GraphCutAxisComboBox->setVisible(volume);
+	m_GraphCutSlider->setVisible(volume);
+	if (!volume) return;
+
+	const PdeSettings::CoordGridSet_t& coord_cut = *m_PdeSettings->get_coord_by_label("X" + QString::number(m_CutAxis + 1));
+	m_CutIndex = qBound(0, m_CutIndex, coord_cut.count - 1);
+
+	// the slider is only fit here, it must not call GraphCut_changed back
+	m_GraphCutSlider->blockSignals(true);
+	m_GraphCutSlider->setMaximum(coord_cut.count - 1);
+	m_GraphCutSlider->setValue(m_CutIndex);
+	m_GraphCutSlider->blockSignals(false);
+	m_GraphCutLabel->setText("Cut: X" + QString::number(m_CutAxis + 1) + " = " + QString::number(coord_cut.node(m_CutIndex)));
+
+	const PdeSettings::CoordGridSet_t* coord_row;
+	const PdeSettings::CoordGridSet_t* coord_col;
+	get_cut_coords(*m_PdeSettings, m_CutAxis, coord_row, coord_col);
+	m_Graph->axisZ()->setRange(coord_row->min, coord_row->max);
+	m_Graph->axisX()->setRange(coord_col->min, coord_col->max);
+}
+
+int MainWindow::time_slice_count() const
+{
+	if (m_SolutionFile) return m_SolutionFile->slice_count();
+	else if (m_GraphData.store) return m_GraphData.store->slice_count();
+	else return m_GraphData.u_list.size();
 }
 
 void MainWindow::update_TimeSlice()
 {
-	set_TimeSlice((m_CurrentTimeSlice < m_PdeSettings->get_coord_by_label("T")->count - 1) ? m_CurrentTimeSlice + 1 : 0);
+	set_TimeSlice((m_CurrentTimeSlice < time_slice_count() - 1) ? m_CurrentTimeSlice + 1 : 0);
 }
 
 PdeSettings MainWindow::get_pde_settings_from_TableWidget()
@@ -499,9 +732,37 @@ PdeSettings MainWindow::get_pde_settings_from_TableWidget()
 
 void MainWindow::EvaluatePushButton_clicked()
 {
-	ui.EvaluatePushButton->setDisabled(true);
-	ui.MethodsComboBox->setDisabled(true);
-	ui.EquationComboBox->setDisabled(true);
+	// while a solve runs the button stops it; the solver finishes the current time step first
+	if (m_Solving)
+	{
+		m_PdeSolver->cancel();
+		ui.EvaluatePushButton->setDisabled(true);
+		return;
+	}
+
+	set_solving(true);
+
+	PdeSettings set;
+	try
+	{
+		set = get_pde_settings_from_TableWidget();
+	}
+	catch (const std::invalid_argument& e)
+	{
+		solution_progress_updated(QString::fromStdString(e.what()), 0);
+		set_solving(false);
+		return;
+	}
+
+	// the explicit schemes refuse the steps they are unstable with
+	PdeSolver::SolutionMethod_t method = ui.MethodsComboBox->currentData().value<PdeSolver::SolutionMethod_t>();
+	QString stability_error = m_PdeSolver->check_stability(set, method);
+	if (!stability_error.isEmpty())
+	{
+		solution_progress_updated(stability_error, 0);
+		set_solving(false);
+		return;
+	}
 
-	m_PdeSolver->solve(get_pde_settings_from_TableWidget(), ui.MethodsComboBox->currentData().value<PdeSolver::SolutionMethod_t>());
+	m_PdeSolver->solve(set, method);
 }
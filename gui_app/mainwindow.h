@@ -34,6 +34,7 @@
 #include <QTimer>
 #include <QTableWidgetItem>
 #include <QLabel>
+#include <QComboBox>
 #include <QThread>
 
 #include <QJsonValue>
@@ -58,6 +59,7 @@
 #include "../pde_solver/pde_solver_base.h"
 #include "../pde_solver/pde_solver_heat_equation.h"
 #include "../pde_solver/pde_solver_wave_equation.h"
+#include "../pde_solver/pde_solver_poisson_equation.h"
 #include "../pde_solver/pde_solver_structs.h"
 
 
@@ -88,10 +90,15 @@ public slots:
 
     void toggle_graph_playing(bool play);
     void change_pde_solver(QString new_solver);
+    void change_method(int index);  /**< Resets the table to a grid of the coordinates and the dimension of the method if they differ */
+
+    void GraphCut_changed();  /**< Shows the cut chosen by the cut axis and the cut slider (3d solutions only) */
 
     void GraphTimeSpeedSlider_changed(int);
 
     void graph_solution_generated(PdeSolver::GraphSolution_t);
+    void graph_solution_cancelled();
+    void graph_solution_failed(QString);
     void solution_progress_updated(QString, int);
 
 private:
@@ -102,7 +109,11 @@ private:
 
     PdeSettings get_pde_settings_from_TableWidget();
 
+    void set_solving(bool solving);  /**< Turns the Evaluate button into the Stop button while a solve runs */
+
     void set_TimeSlice(int new_time_slice);
+    void update_GraphCut();  /**< Fits the cut controls and the graph axes to the solution in m_PdeSettings */
+    int time_slice_count() const;  /**< The number of output time slices (in memory or in the solution file) */
 
 	Ui::MainWindowClass ui;
 
@@ -114,11 +125,17 @@ private:
     QtDataVisualization::QSurface3DSeries *m_Series;
     QtDataVisualization::Q3DSurface *m_Graph;
     std::shared_ptr<PdeSolverBase> m_PdeSolver;
+    std::shared_ptr<PdeSolver::SolutionCache> m_SolutionCache;     /**< The solves of the same problems are loaded from here (also after a restart) */
     PdeSolver::GraphData_t m_GraphData;
+    std::shared_ptr<PdeSolver::SolutionFileReader> m_SolutionFile;  /**< The mapped slices if the solver wrote them to a file */
+    PdeSolver::Field_t m_CurrentSlice;                               /**< The current slice read from m_SolutionFile or decoded from the snapshot store */
 
     bool m_GraphIsValid = false;
+    bool m_Solving = false;          /**< If a solve is running (then the Evaluate button cancels it) */
 
     int m_CurrentTimeSlice = 0;
+    int m_CutAxis = 2;               /**< The axis across the shown cut of a 3d solution (0, 1, 2 for X1, X2, X3) */
+    int m_CutIndex = 0;              /**< The node of the cut along m_CutAxis */
     int m_GraphUpdateTimeStep = 40;  // in ms
 
     QThread m_GraphThread;
@@ -135,6 +152,11 @@ private:
     QSlider* m_GraphCurrentTimeSlider;
     QLabel* m_GraphCurrentTimeLabel;
 
+    QHBoxLayout* m_GraphCutLayout;
+    QLabel* m_GraphCutLabel;
+    QComboBox* m_GraphCutAxisComboBox;
+    QSlider* m_GraphCutSlider;
+
     QPushButton* m_PlayStopPushButton;
     QPushButton* m_NextSlidePushButton;
     QPushButton* m_PrevSlidePushButton;
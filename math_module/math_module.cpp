@@ -2,8 +2,12 @@
 #include <memory>
 #include <functional>
 #include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
 
-void MathModule::solve_tridiagonal_equation(std::vector<float>& a, std::vector<float>& b, std::vector<float>& c, std::vector<float>& d, int n) {
+template<typename Scalar>
+void MathModule::solve_tridiagonal_equation(std::vector<Scalar>& a, std::vector<Scalar>& b, std::vector<Scalar>& c, std::vector<Scalar>& d, int n) {
     n--; // since we start from x0 (not x1)
     c[0] /= b[0];
     d[0] /= b[0];
@@ -19,3 +23,328 @@ void MathModule::solve_tridiagonal_equation(std::vector<float>& a, std::vector<f
         d[i] -= c[i] * d[i + 1];
     }
 }
+
+template void MathModule::solve_tridiagonal_equation<float>(std::vector<float>&, std::vector<float>&, std::vector<float>&, std::vector<float>&, int);
+template void MathModule::solve_tridiagonal_equation<double>(std::vector<double>&, std::vector<double>&, std::vector<double>&, std::vector<double>&, int);
+
+namespace
+{
+    /** The systems of a mixed precision batch solved at once through a Compute buffer: four cache lines of floats a row,
+     *  so the strided rows of the data are walked a few times only */
+    const int MixedBlock = 64;
+
+    /**
+     * The forward and the back substitution of count interleaved systems with the same matrix: the k-th element
+     * of the s-th system is d[k * d_stride + s] and x[k * x_stride + s]. The values are widened to Compute while they
+     * are solved; when Out is narrower than Compute the intermediate results are rounded, so mixed precision goes
+     * through a Compute x.
+     */
+    template<typename Compute, typename In, typename Out>
+    void substitute_batch(const Compute* a, const Compute* g, const Compute* inv, int n,
+                          const In* d, std::ptrdiff_t d_stride, Out* x, std::ptrdiff_t x_stride, int count) {
+        const Compute inv0 = inv[0];
+        #pragma omp simd
+        for (int s = 0; s < count; s++) {
+            x[s] = Out(Compute(d[s]) * inv0);
+        }
+
+        for (int i = 1; i < n; i++) {
+            const In* di = d + i * d_stride;
+            const Out* x_prev = x + (i - 1) * x_stride;
+            Out* xi = x + i * x_stride;
+            const Compute ai = a[i];
+            const Compute inv_i = inv[i];
+            #pragma omp simd
+            for (int s = 0; s < count; s++) {
+                xi[s] = Out((Compute(di[s]) - ai * Compute(x_prev[s])) * inv_i);
+            }
+        }
+
+        for (int i = n - 1; i-- > 0;) {
+            Out* xi = x + i * x_stride;
+            const Out* x_next = x + (i + 1) * x_stride;
+            const Compute gi = g[i];
+            #pragma omp simd
+            for (int s = 0; s < count; s++) {
+                xi[s] = Out(Compute(xi[s]) - gi * Compute(x_next[s]));
+            }
+        }
+    }
+
+    /**
+     * substitute_batch with a matrix per system (the coefficients interleaved with the stride coef_stride) and
+     * the Sherman–Morrison correction of CyclicTridiagonalBatch. The corrected solutions are written to result
+     * (with the stride result_stride), which is x itself or, with mixed precision, the narrower output.
+     */
+    template<typename Compute, typename In, typename Out, typename Result>
+    void substitute_cyclic(const Compute* a, const Compute* g, const Compute* inv, const Compute* z, const Compute* v_last,
+                           const Compute* factor, std::ptrdiff_t coef_stride, int n,
+                           const In* d, std::ptrdiff_t d_stride, Out* x, std::ptrdiff_t x_stride,
+                           Result* result, std::ptrdiff_t result_stride, int count) {
+        // y = B^-1 d, as substitute_batch with the coefficients of every lane
+        #pragma omp simd
+        for (int l = 0; l < count; l++) {
+            x[l] = Out(Compute(d[l]) * inv[l]);
+        }
+        for (int k = 1; k < n; k++) {
+            const In* dk = d + k * d_stride;
+            const Out* x_prev = x + (k - 1) * x_stride;
+            Out* xk = x + k * x_stride;
+            const Compute* ak = a + k * coef_stride;
+            const Compute* inv_k = inv + k * coef_stride;
+            #pragma omp simd
+            for (int l = 0; l < count; l++) {
+                xk[l] = Out((Compute(dk[l]) - ak[l] * Compute(x_prev[l])) * inv_k[l]);
+            }
+        }
+        for (int k = n - 1; k-- > 0;) {
+            Out* xk = x + k * x_stride;
+            const Out* x_next = x + (k + 1) * x_stride;
+            const Compute* gk = g + k * coef_stride;
+            #pragma omp simd
+            for (int l = 0; l < count; l++) {
+                xk[l] = Out(Compute(xk[l]) - gk[l] * Compute(x_next[l]));
+            }
+        }
+
+        // x = y - (v.y / (1 + v.z)) z
+        std::vector<Compute> w(count);
+        {
+            const Out* x_first = x;
+            const Out* x_last = x + (n - 1) * x_stride;
+            #pragma omp simd
+            for (int l = 0; l < count; l++) {
+                w[l] = (Compute(x_first[l]) + v_last[l] * Compute(x_last[l])) * factor[l];
+            }
+        }
+        for (int k = 0; k < n; k++) {
+            const Out* xk = x + k * x_stride;
+            Result* rk = result + k * result_stride;
+            const Compute* zk = z + k * coef_stride;
+            const Compute* wl = w.data();
+            #pragma omp simd
+            for (int l = 0; l < count; l++) {
+                rk[l] = Result(Compute(xk[l]) - wl[l] * zk[l]);
+            }
+        }
+    }
+
+    /**
+     * substitute_batch through the Compute buffer y (with the stride y_stride) to the narrower x: the back substitution
+     * narrows every row as soon as it is solved, so x is written in the same pass.
+     */
+    template<typename Compute, typename Scalar>
+    void substitute_batch_mixed(const Compute* a, const Compute* g, const Compute* inv, int n,
+                                const Scalar* d, std::ptrdiff_t d_stride, Scalar* x, std::ptrdiff_t x_stride, int count,
+                                Compute* y, std::ptrdiff_t y_stride) {
+        const Compute inv0 = inv[0];
+        #pragma omp simd
+        for (int s = 0; s < count; s++) {
+            y[s] = Compute(d[s]) * inv0;
+        }
+
+        for (int i = 1; i < n; i++) {
+            const Scalar* di = d + i * d_stride;
+            const Compute* y_prev = y + (i - 1) * y_stride;
+            Compute* yi = y + i * y_stride;
+            const Compute ai = a[i];
+            const Compute inv_i = inv[i];
+            #pragma omp simd
+            for (int s = 0; s < count; s++) {
+                yi[s] = (Compute(di[s]) - ai * y_prev[s]) * inv_i;
+            }
+        }
+
+        {
+            const Compute* y_last = y + (n - 1) * y_stride;
+            Scalar* x_last = x + (n - 1) * x_stride;
+            #pragma omp simd
+            for (int s = 0; s < count; s++) {
+                x_last[s] = Scalar(y_last[s]);
+            }
+        }
+        for (int i = n - 1; i-- > 0;) {
+            Compute* yi = y + i * y_stride;
+            const Compute* y_next = y + (i + 1) * y_stride;
+            Scalar* xi = x + i * x_stride;
+            const Compute gi = g[i];
+            #pragma omp simd
+            for (int s = 0; s < count; s++) {
+                yi[s] -= gi * y_next[s];
+                xi[s] = Scalar(yi[s]);
+            }
+        }
+    }
+}
+
+template<typename Scalar, typename Compute>
+MathModule::TridiagonalFactorization<Scalar, Compute>::TridiagonalFactorization()
+{
+
+}
+
+template<typename Scalar, typename Compute>
+void MathModule::TridiagonalFactorization<Scalar, Compute>::factorize(const Compute* a, const Compute* b, const Compute* c, int n) {
+    if (n <= 0) {
+        clear();
+        return;
+    }
+
+    m_a.assign(a, a + n);
+    m_g.resize(n);
+    m_inv.resize(n);
+
+    m_inv[0] = Compute(1) / b[0];
+    m_g[0] = c[0] * m_inv[0];
+    for (int i = 1; i < n; i++) {
+        m_inv[i] = Compute(1) / (b[i] - a[i] * m_g[i - 1]);
+        m_g[i] = c[i] * m_inv[i];
+    }
+}
+
+template<typename Scalar, typename Compute>
+void MathModule::TridiagonalFactorization<Scalar, Compute>::clear() {
+    m_a.clear();
+    m_g.clear();
+    m_inv.clear();
+}
+
+template<typename Scalar, typename Compute>
+void MathModule::TridiagonalFactorization<Scalar, Compute>::solve(Scalar* d) const {
+    const int n = size();
+    if (n == 0) return;
+
+    if (std::is_same<Scalar, Compute>::value) {
+        substitute_batch(m_a.data(), m_g.data(), m_inv.data(), n, d, 1, d, 1, 1);
+        return;
+    }
+
+    std::vector<Compute> y(n);
+    substitute_batch_mixed(m_a.data(), m_g.data(), m_inv.data(), n, d, 1, d, 1, 1, y.data(), 1);
+}
+
+template<typename Scalar, typename Compute>
+void MathModule::TridiagonalFactorization<Scalar, Compute>::solve_batch(const Scalar* d, Scalar* x, int count, int stride) const {
+    const int n = size();
+    if (n == 0 || count <= 0) return;
+
+    if (std::is_same<Scalar, Compute>::value) {
+        substitute_batch(m_a.data(), m_g.data(), m_inv.data(), n, d, stride, x, stride, count);
+        return;
+    }
+
+    // the systems are solved by blocks in a Compute buffer, which stays in cache
+    std::vector<Compute> y(std::size_t(n) * MixedBlock);
+    for (int s = 0; s < count; s += MixedBlock) {
+        const int block = std::min(MixedBlock, count - s);
+        substitute_batch_mixed(m_a.data(), m_g.data(), m_inv.data(), n, d + s, stride, x + s, stride, block, y.data(), MixedBlock);
+    }
+}
+
+template class MathModule::TridiagonalFactorization<float>;
+template class MathModule::TridiagonalFactorization<double>;
+template class MathModule::TridiagonalFactorization<float, double>;
+
+void MathModule::solve_tridiagonal_batch(const float* a, const float* b, const float* c, const float* d, float* x,
+                                         int n, int count, int stride) {
+    TridiagonalFactorization<float> lu;
+    lu.factorize(a, b, c, n);
+    lu.solve_batch(d, x, count, stride);
+}
+
+void MathModule::solve_tridiagonal_batch(const double* a, const double* b, const double* c, const double* d, double* x,
+                                         int n, int count, int stride) {
+    TridiagonalFactorization<double> lu;
+    lu.factorize(a, b, c, n);
+    lu.solve_batch(d, x, count, stride);
+}
+
+template<typename Scalar, typename Compute>
+MathModule::CyclicTridiagonalBatch<Scalar, Compute>::CyclicTridiagonalBatch()
+{
+
+}
+
+template<typename Scalar, typename Compute>
+void MathModule::CyclicTridiagonalBatch<Scalar, Compute>::factorize(const Compute* a, const Compute* b, const Compute* c, int n, int count) {
+    if (n < 3 || count <= 0) {
+        clear();
+        return;
+    }
+
+    m_n = n;
+    m_count = count;
+    m_a.assign(a, a + std::size_t(n) * count);
+    m_g.resize(std::size_t(n) * count);
+    m_inv.resize(std::size_t(n) * count);
+    m_z.resize(std::size_t(n) * count);
+    m_v_last.resize(count);
+    m_factor.resize(count);
+
+    const std::size_t last = std::size_t(n - 1) * count;
+    for (int s = 0; s < count; s++) {
+        const Compute gamma = -b[s];
+        m_v_last[s] = a[s] / gamma;
+
+        // B differs from the matrix in the first and the last diagonal elements
+        m_inv[s] = Compute(1) / (b[s] - gamma);
+        m_g[s] = c[s] * m_inv[s];
+        for (int k = 1; k < n; k++) {
+            const std::size_t i = std::size_t(k) * count + s;
+            const Compute bk = (k == n - 1) ? b[i] - a[s] * c[i] / gamma : b[i];
+            m_inv[i] = Compute(1) / (bk - a[i] * m_g[i - count]);
+            m_g[i] = c[i] * m_inv[i];
+        }
+
+        // z = B^-1 u
+        m_z[s] = gamma * m_inv[s];
+        for (int k = 1; k < n; k++) {
+            const std::size_t i = std::size_t(k) * count + s;
+            const Compute uk = (k == n - 1) ? c[i] : Compute(0);
+            m_z[i] = (uk - a[i] * m_z[i - count]) * m_inv[i];
+        }
+        for (int k = n - 1; k-- > 0;) {
+            const std::size_t i = std::size_t(k) * count + s;
+            m_z[i] -= m_g[i] * m_z[i + count];
+        }
+
+        m_factor[s] = Compute(1) / (Compute(1) + m_z[s] + m_v_last[s] * m_z[last + s]);
+    }
+}
+
+template<typename Scalar, typename Compute>
+void MathModule::CyclicTridiagonalBatch<Scalar, Compute>::clear() {
+    m_n = 0;
+    m_count = 0;
+    m_a.clear();
+    m_g.clear();
+    m_inv.clear();
+    m_z.clear();
+    m_v_last.clear();
+    m_factor.clear();
+}
+
+template<typename Scalar, typename Compute>
+void MathModule::CyclicTridiagonalBatch<Scalar, Compute>::solve(const Scalar* d, Scalar* x, int stride, int first, int count) const {
+    const int n = m_n;
+    if (n == 0 || count <= 0) return;
+
+    if (std::is_same<Scalar, Compute>::value) {
+        substitute_cyclic(m_a.data() + first, m_g.data() + first, m_inv.data() + first, m_z.data() + first,
+                          m_v_last.data() + first, m_factor.data() + first, m_count, n, d, stride, x, stride, x, stride, count);
+        return;
+    }
+
+    std::vector<Compute> y(std::size_t(n) * MixedBlock);
+    for (int l = 0; l < count; l += MixedBlock) {
+        const int block = std::min(MixedBlock, count - l);
+        const int s = first + l;
+        substitute_cyclic(m_a.data() + s, m_g.data() + s, m_inv.data() + s, m_z.data() + s,
+                          m_v_last.data() + s, m_factor.data() + s, m_count, n, d + l, stride, y.data(), MixedBlock,
+                          x + l, stride, block);
+    }
+}
+
+template class MathModule::CyclicTridiagonalBatch<float>;
+template class MathModule::CyclicTridiagonalBatch<double>;
+template class MathModule::CyclicTridiagonalBatch<float, double>;
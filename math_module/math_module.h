@@ -41,7 +41,120 @@ namespace MathModule
      * and             the d matrix reused instead of r and x matrices to report results
      * Written by Keivan Moradi, 2014
      */
-    void solve_tridiagonal_equation(std::vector<float>& a, std::vector<float>& b, std::vector<float>& c, std::vector<float>& d, int n);
+    template<typename Scalar>
+    void solve_tridiagonal_equation(std::vector<Scalar>& a, std::vector<Scalar>& b, std::vector<Scalar>& c, std::vector<Scalar>& d, int n);
+
+    /**
+     * A factorization of a tridiagonal matrix with constant coefficients for solving it with many right parts.
+     *
+     * factorize does the forward elimination once and keeps the multipliers, so solve and solve_batch
+     * do only the forward and back substitution. The object can be reused until the matrix changes.
+     *
+     * Scalar is the type of the right parts and the solutions, Compute the one of the coefficients and of the elimination.
+     * With TridiagonalFactorization<float, double> the data stays fp32 and is widened only while it is solved.
+     */
+    template<typename Scalar, typename Compute = Scalar>
+    class TridiagonalFactorization
+    {
+    public:
+        typedef Compute compute_type;
+
+        TridiagonalFactorization();
+
+        /**
+         * @brief Factorizes the matrix with the lower diagonal a, the main diagonal b and the upper diagonal c
+         * (a[0] and c[n - 1] are not used).
+         */
+        void factorize(const Compute* a, const Compute* b, const Compute* c, int n);
+        void clear();
+
+        int size() const { return int(m_inv.size()); }
+        bool empty() const { return m_inv.empty(); }
+
+        /**
+         * @brief Solves the system with the right part d, the result is written back to d.
+         */
+        void solve(Scalar* d) const;
+
+        /**
+         * @brief Solves count systems with the interleaved right parts: the k-th element of the s-th system
+         * is d[k * stride + s]. The solutions are written to x with the same layout, x may point to d.
+         */
+        void solve_batch(const Scalar* d, Scalar* x, int count, int stride) const;
+
+    private:
+        std::vector<Compute> m_a;    /**< the lower diagonal */
+        std::vector<Compute> m_g;    /**< the upper diagonal after the elimination */
+        std::vector<Compute> m_inv;  /**< the reciprocal pivots */
+    };
+
+    /**
+     * Batched version of solve_tridiagonal_equation: solves count systems of size n with the same a, b, c
+     * and different right parts at once.
+     *
+     * The right parts are interleaved: the k-th element of the s-th system is d[k * stride + s], so the inner loop
+     * runs over the systems on contiguous memory and every SIMD lane handles its own system. The solutions are
+     * written to x with the same layout. a, b, c and d are not modified; x may point to d to solve in place.
+     *
+     * a[0] and c[n - 1] are not used.
+     */
+    void solve_tridiagonal_batch(const float* a, const float* b, const float* c, const float* d, float* x,
+                                 int n, int count, int stride);
+    void solve_tridiagonal_batch(const double* a, const double* b, const double* c, const double* d, double* x,
+                                 int n, int count, int stride);
+
+    /**
+     * Factorizations of count cyclic tridiagonal matrices of size n (a periodic grid line each), solved together.
+     *
+     * |b0 c0 0  a0|
+     * |a1 b1 c1 0 |
+     * |0  a2 b2 c2|
+     * |c3 0  a3 b3|
+     *
+     * A cyclic matrix is a tridiagonal one B plus the rank one correction u v^T (the corners) with u = (𝛾, 0, ..., 0, c_(n-1))
+     * and v = (1, 0, ..., 0, a_0 / 𝛾), 𝛾 = -b_0. By the Sherman–Morrison formula x = y - (v.y / (1 + v.z)) z,
+     * where B y = d and B z = u, so factorize eliminates B and solves for z once and solve does one substitution
+     * and a correction per system.
+     *
+     * The matrices may differ, their coefficients are interleaved like the right parts of solve_tridiagonal_batch:
+     * the k-th element of the s-th matrix is at [k * count + s], so every SIMD lane solves its own system.
+     * Scalar and Compute are the ones of TridiagonalFactorization.
+     */
+    template<typename Scalar, typename Compute = Scalar>
+    class CyclicTridiagonalBatch
+    {
+    public:
+        typedef Compute compute_type;
+
+        CyclicTridiagonalBatch();
+
+        /**
+         * @brief Factorizes the matrices with the lower diagonals a, the main diagonals b and the upper diagonals c
+         * (a_0 is the corner element of the first row and c_(n-1) the one of the last row). n must be at least 3.
+         */
+        void factorize(const Compute* a, const Compute* b, const Compute* c, int n, int count);
+        void clear();
+
+        int size() const { return m_n; }
+        int count() const { return m_count; }
+        bool empty() const { return m_n == 0; }
+
+        /**
+         * @brief Solves the systems first ... first + count - 1 with the interleaved right parts: the k-th element
+         * of the system first + l is d[k * stride + l]. The solutions are written to x with the same layout, x may point to d.
+         */
+        void solve(const Scalar* d, Scalar* x, int stride, int first, int count) const;
+
+    private:
+        int m_n = 0;
+        int m_count = 0;
+        std::vector<Compute> m_a;       /**< the lower diagonals */
+        std::vector<Compute> m_g;       /**< the upper diagonals of B after the elimination */
+        std::vector<Compute> m_inv;     /**< the reciprocal pivots of B */
+        std::vector<Compute> m_z;       /**< B^-1 u */
+        std::vector<Compute> m_v_last;  /**< the last element of v */
+        std::vector<Compute> m_factor;  /**< 1 / (1 + v.z) */
+    };
 }
 
 #endif // MATH_MODULE_H
@@ -0,0 +1,490 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "sparse_matrix.h"
+#include "../pde_solver/pde_thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+    const int VectorBlock = 4096;   /**< The vector operations are split across the threads by blocks of this size */
+
+    /**
+     * @brief Calls task(begin, end) for [0, n) split at the multiples of VectorBlock, across the pool if there is more than a block.
+     */
+    void for_blocks(PdeSolver::ThreadPool* pool, int n, const std::function<void(int, int)>& task)
+    {
+        const int blocks = (n + VectorBlock - 1) / VectorBlock;
+        if (pool && (pool->size() > 1) && (blocks > 1))
+        {
+            pool->parallel_for(blocks, 1, [&](int begin, int end) { task(begin * VectorBlock, std::min(n, end * VectorBlock)); });
+        }
+        else task(0, n);
+    }
+
+    /**
+     * @brief The sums of the blocks are added in the order of the blocks, so the result does not depend on the number of threads.
+     */
+    double dot(PdeSolver::ThreadPool* pool, const double* a, const double* b, int n)
+    {
+        std::vector<double> partial((n + VectorBlock - 1) / VectorBlock, 0.0);
+        for_blocks(pool, n, [&](int begin, int end)
+        {
+            for (int first = begin; first < end; first += VectorBlock)
+            {
+                const int last = std::min(end, first + VectorBlock);
+                double sum = 0.0;
+#pragma omp simd reduction(+:sum)
+                for (int i = first; i < last; ++i) sum += a[i] * b[i];
+                partial[first / VectorBlock] = sum;
+            }
+        });
+
+        double sum = 0.0;
+        for (double value : partial) sum += value;
+        return sum;
+    }
+
+    /**
+     * @brief z = r if there is no preconditioner.
+     */
+    void precondition(const MathModule::Preconditioner* M, PdeSolver::ThreadPool* pool, const double* r, double* z, int n)
+    {
+        if (M) M->apply(r, z);
+        else for_blocks(pool, n, [&](int begin, int end) { std::copy(r + begin, r + end, z + begin); });
+    }
+
+    /**
+     * @brief r = b - A x.
+     */
+    void residual(const MathModule::SparseMatrix& A, PdeSolver::ThreadPool* pool, const double* b, const double* x, double* r)
+    {
+        A.multiply(x, r, pool);
+        for_blocks(pool, A.rows(), [&](int begin, int end)
+        {
+#pragma omp simd
+            for (int i = begin; i < end; ++i) r[i] = b[i] - r[i];
+        });
+    }
+}
+
+MathModule::SparseMatrix::SparseMatrix()
+{
+
+}
+
+void MathModule::SparseMatrix::assemble(int rows, int cols, std::vector<Entry_t> entries)
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry_t& a, const Entry_t& b)
+    {
+        return (a.row < b.row) || ((a.row == b.row) && (a.col < b.col));
+    });
+
+    clear();
+    m_rows = rows;
+    m_cols = cols;
+    m_row_start.assign(rows + 1, 0);
+    m_diagonal.assign(rows, -1);
+    m_columns.reserve(entries.size());
+    m_values.reserve(entries.size());
+    for (size_t k = 0; k < entries.size(); ++k)
+    {
+        const Entry_t& entry = entries[k];
+        if ((entry.row < 0) || (entry.row >= rows) || (entry.col < 0) || (entry.col >= cols)) throw("The entry is outside the matrix");
+
+        if ((k > 0) && (entries[k - 1].row == entry.row) && (entries[k - 1].col == entry.col))
+        {
+            m_values.back() += entry.value;
+            continue;
+        }
+        if (entry.row == entry.col) m_diagonal[entry.row] = int(m_values.size());
+        m_columns.push_back(entry.col);
+        m_values.push_back(entry.value);
+        ++m_row_start[entry.row + 1];
+    }
+    for (int i = 0; i < rows; ++i) m_row_start[i + 1] += m_row_start[i];
+
+    // the banded copy, if the diagonals are few and mostly filled
+    std::vector<int> offsets;
+    for (int i = 0; (i < rows) && (int(offsets.size()) <= MaxDiagonals); ++i)
+    {
+        for (int k = m_row_start[i]; k < m_row_start[i + 1]; ++k)
+        {
+            const int offset = m_columns[k] - i;
+            if (std::find(offsets.begin(), offsets.end(), offset) == offsets.end()) offsets.push_back(offset);
+        }
+    }
+    if ((int(offsets.size()) <= MaxDiagonals) && (2 * size_t(nonzeros()) >= offsets.size() * size_t(rows)))
+    {
+        std::sort(offsets.begin(), offsets.end());
+        m_band_offsets = offsets;
+        m_band_values.assign(offsets.size() * size_t(rows), 0.0);
+        for (int i = 0; i < rows; ++i)
+        {
+            for (int k = m_row_start[i]; k < m_row_start[i + 1]; ++k)
+            {
+                const size_t d = std::lower_bound(offsets.begin(), offsets.end(), m_columns[k] - i) - offsets.begin();
+                m_band_values[d * rows + i] = m_values[k];
+            }
+        }
+    }
+}
+
+void MathModule::SparseMatrix::clear()
+{
+    m_rows = 0;
+    m_cols = 0;
+    m_row_start.clear();
+    m_columns.clear();
+    m_values.clear();
+    m_diagonal.clear();
+    m_band_offsets.clear();
+    m_band_values.clear();
+}
+
+int MathModule::SparseMatrix::bandwidth() const
+{
+    int width = 0;
+    for (int i = 0; i < m_rows; ++i)
+    {
+        for (int k = m_row_start[i]; k < m_row_start[i + 1]; ++k) width = std::max(width, std::abs(m_columns[k] - i));
+    }
+    return width;
+}
+
+void MathModule::SparseMatrix::multiply(const double* x, double* y, PdeSolver::ThreadPool* pool) const
+{
+    const int* row_start = m_row_start.data();
+    const int* columns = m_columns.data();
+    const double* values = m_values.data();
+    const int band_count = int(m_band_offsets.size());
+
+    // the single thread calls the same function object as the pool: an inlined copy of the loops may be vectorized
+    // differently and sum in another order
+    const std::function<void(int, int)> rows_task = [&](int begin, int end)
+    {
+        if (band_count > 0)
+        {
+            // a diagonal at a time, so every element of y gets the terms in the order of the columns, as in CSR
+            std::fill(y + begin, y + end, 0.0);
+            for (int d = 0; d < band_count; ++d)
+            {
+                const int offset = m_band_offsets[d];
+                const double* band = m_band_values.data() + size_t(d) * m_rows;
+                const int first = std::max(begin, -offset);
+                const int last = std::min(end, m_cols - offset);
+#pragma omp simd
+                for (int i = first; i < last; ++i) y[i] += band[i] * x[i + offset];
+            }
+            return;
+        }
+
+        for (int i = begin; i < end; ++i)
+        {
+            double sum = 0.0;
+            for (int k = row_start[i]; k < row_start[i + 1]; ++k) sum += values[k] * x[columns[k]];
+            y[i] = sum;
+        }
+    };
+
+    // the chunks are whole cache lines of y, so the threads never write to the same line
+    if (pool && (pool->size() > 1) && (m_rows > VectorBlock)) pool->parallel_for(m_rows, 8, rows_task);
+    else rows_task(0, m_rows);
+}
+
+MathModule::JacobiPreconditioner::JacobiPreconditioner(const SparseMatrix& matrix, PdeSolver::ThreadPool* pool) :
+    m_inv_diagonal(matrix.rows()),
+    m_pool(pool)
+{
+    for (int i = 0; i < matrix.rows(); ++i)
+    {
+        const int k = matrix.diagonal_index(i);
+        if ((k < 0) || (matrix.values()[k] == 0)) throw("The Jacobi preconditioner needs a nonzero diagonal");
+        m_inv_diagonal[i] = 1 / matrix.values()[k];
+    }
+}
+
+void MathModule::JacobiPreconditioner::apply(const double* r, double* z) const
+{
+    const double* inv_diagonal = m_inv_diagonal.data();
+    for_blocks(m_pool, int(m_inv_diagonal.size()), [&](int begin, int end)
+    {
+#pragma omp simd
+        for (int i = begin; i < end; ++i) z[i] = inv_diagonal[i] * r[i];
+    });
+}
+
+MathModule::Ilu0Preconditioner::Ilu0Preconditioner(const SparseMatrix& matrix) : m_factors(matrix)
+{
+    const int n = m_factors.rows();
+    const int* row_start = m_factors.row_start();
+    const int* columns = m_factors.columns();
+    double* values = m_factors.values();
+
+    // the IKJ elimination restricted to the stored elements; position[j] is the index of the element (i, j) of the current row
+    std::vector<int> position(m_factors.cols(), -1);
+    for (int i = 0; i < n; ++i)
+    {
+        if (m_factors.diagonal_index(i) < 0) throw("The ILU(0) preconditioner needs the diagonal elements");
+        for (int k = row_start[i]; k < row_start[i + 1]; ++k) position[columns[k]] = k;
+
+        for (int k = row_start[i]; (k < row_start[i + 1]) && (columns[k] < i); ++k)
+        {
+            const int pivot_row = columns[k];
+            const double pivot = values[m_factors.diagonal_index(pivot_row)];
+            if (pivot == 0) throw("A zero pivot in the ILU(0) factorization");
+            values[k] /= pivot;
+            for (int l = m_factors.diagonal_index(pivot_row) + 1; l < row_start[pivot_row + 1]; ++l)
+            {
+                if (position[columns[l]] >= 0) values[position[columns[l]]] -= values[k] * values[l];
+            }
+        }
+
+        for (int k = row_start[i]; k < row_start[i + 1]; ++k) position[columns[k]] = -1;
+    }
+
+    m_inv_pivots.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        const double pivot = values[m_factors.diagonal_index(i)];
+        if (pivot == 0) throw("A zero pivot in the ILU(0) factorization");
+        m_inv_pivots[i] = 1 / pivot;
+    }
+}
+
+void MathModule::Ilu0Preconditioner::apply(const double* r, double* z) const
+{
+    const int n = m_factors.rows();
+    const int* row_start = m_factors.row_start();
+    const int* columns = m_factors.columns();
+    const double* values = m_factors.values();
+
+    // L y = r (L has the unit diagonal), then U z = y; y is kept in z
+    for (int i = 0; i < n; ++i)
+    {
+        double sum = r[i];
+        for (int k = row_start[i]; k < m_factors.diagonal_index(i); ++k) sum -= values[k] * z[columns[k]];
+        z[i] = sum;
+    }
+    for (int i = n - 1; i >= 0; --i)
+    {
+        const int diagonal = m_factors.diagonal_index(i);
+        double sum = z[i];
+        for (int k = diagonal + 1; k < row_start[i + 1]; ++k) sum -= values[k] * z[columns[k]];
+        z[i] = sum * m_inv_pivots[i];
+    }
+}
+
+MathModule::SsorPreconditioner::SsorPreconditioner(const SparseMatrix& matrix, double omega) :
+    m_matrix(matrix),
+    m_omega(omega),
+    m_inv_diagonal(matrix.rows())
+{
+    if (!(omega > 0) || !(omega < 2)) throw("The SSOR relaxation factor must be between 0 and 2");
+    for (int i = 0; i < matrix.rows(); ++i)
+    {
+        const int k = matrix.diagonal_index(i);
+        if ((k < 0) || (matrix.values()[k] == 0)) throw("The SSOR preconditioner needs a nonzero diagonal");
+        m_inv_diagonal[i] = omega / matrix.values()[k];
+    }
+}
+
+void MathModule::SsorPreconditioner::apply(const double* r, double* z) const
+{
+    const int n = m_matrix.rows();
+    const int* row_start = m_matrix.row_start();
+    const int* columns = m_matrix.columns();
+    const double* values = m_matrix.values();
+
+    // (D / 𝜔 + L) y = r, then (D / 𝜔 + U) z = (2 - 𝜔) / 𝜔 (D / 𝜔) y; y is kept in z
+    for (int i = 0; i < n; ++i)
+    {
+        double sum = r[i];
+        for (int k = row_start[i]; k < m_matrix.diagonal_index(i); ++k) sum -= values[k] * z[columns[k]];
+        z[i] = sum * m_inv_diagonal[i];
+    }
+    const double scale = (2 - m_omega) / m_omega;
+    for (int i = n - 1; i >= 0; --i)
+    {
+        double sum = scale * z[i] / m_inv_diagonal[i];
+        for (int k = m_matrix.diagonal_index(i) + 1; k < row_start[i + 1]; ++k) sum -= values[k] * z[columns[k]];
+        z[i] = sum * m_inv_diagonal[i];
+    }
+}
+
+std::unique_ptr<MathModule::Preconditioner> MathModule::make_preconditioner(const std::string& name, const SparseMatrix& matrix,
+                                                                           PdeSolver::ThreadPool* pool)
+{
+    if (name == "none") return std::unique_ptr<Preconditioner>();
+    if (name == "jacobi") return std::unique_ptr<Preconditioner>(new JacobiPreconditioner(matrix, pool));
+    if (name == "ilu0") return std::unique_ptr<Preconditioner>(new Ilu0Preconditioner(matrix));
+    if (name == "ssor") return std::unique_ptr<Preconditioner>(new SsorPreconditioner(matrix, 1.5));
+    throw("Wrong preconditioner. Must be \"none\", \"jacobi\", \"ilu0\" or \"ssor\"");
+}
+
+MathModule::KrylovResult_t MathModule::conjugate_gradient(const SparseMatrix& A, const Preconditioner* M, const double* b, double* x,
+                                                          double tolerance, int max_iterations, PdeSolver::ThreadPool* pool)
+{
+    const int n = A.rows();
+    KrylovResult_t result;
+
+    const double b_norm = std::sqrt(dot(pool, b, b, n));
+    if (b_norm == 0)
+    {
+        std::fill(x, x + n, 0.0);
+        result.converged = true;
+        return result;
+    }
+
+    std::vector<double> r(n), z(n), p(n), q(n);
+    residual(A, pool, b, x, r.data());
+    result.residual = std::sqrt(dot(pool, r.data(), r.data(), n)) / b_norm;
+    if (result.residual <= tolerance)
+    {
+        result.converged = true;
+        return result;
+    }
+
+    precondition(M, pool, r.data(), z.data(), n);
+    p = z;
+    double rz = dot(pool, r.data(), z.data(), n);
+    while (result.iterations < max_iterations)
+    {
+        ++result.iterations;
+        A.multiply(p.data(), q.data(), pool);
+        const double alpha = rz / dot(pool, p.data(), q.data(), n);
+        for_blocks(pool, n, [&](int begin, int end)
+        {
+#pragma omp simd
+            for (int i = begin; i < end; ++i)
+            {
+                x[i] += alpha * p[i];
+                r[i] -= alpha * q[i];
+            }
+        });
+
+        result.residual = std::sqrt(dot(pool, r.data(), r.data(), n)) / b_norm;
+        if (result.residual <= tolerance)
+        {
+            result.converged = true;
+            break;
+        }
+
+        precondition(M, pool, r.data(), z.data(), n);
+        const double rz_new = dot(pool, r.data(), z.data(), n);
+        const double beta = rz_new / rz;
+        rz = rz_new;
+        for_blocks(pool, n, [&](int begin, int end)
+        {
+#pragma omp simd
+            for (int i = begin; i < end; ++i) p[i] = z[i] + beta * p[i];
+        });
+    }
+    return result;
+}
+
+MathModule::KrylovResult_t MathModule::bicgstab(const SparseMatrix& A, const Preconditioner* M, const double* b, double* x,
+                                                double tolerance, int max_iterations, PdeSolver::ThreadPool* pool)
+{
+    const int n = A.rows();
+    KrylovResult_t result;
+
+    const double b_norm = std::sqrt(dot(pool, b, b, n));
+    if (b_norm == 0)
+    {
+        std::fill(x, x + n, 0.0);
+        result.converged = true;
+        return result;
+    }
+
+    std::vector<double> r(n), r0(n), p(n, 0.0), v(n, 0.0), p_hat(n), s_hat(n), t(n);
+    residual(A, pool, b, x, r.data());
+    result.residual = std::sqrt(dot(pool, r.data(), r.data(), n)) / b_norm;
+    if (result.residual <= tolerance)
+    {
+        result.converged = true;
+        return result;
+    }
+
+    r0 = r;
+    double rho = 1.0, alpha = 1.0, omega = 1.0;
+    while (result.iterations < max_iterations)
+    {
+        ++result.iterations;
+        const double rho_new = dot(pool, r0.data(), r.data(), n);
+        if (rho_new == 0) break;    // the breakdown: r is orthogonal to r0
+        const double beta = (rho_new / rho) * (alpha / omega);
+        rho = rho_new;
+        for_blocks(pool, n, [&](int begin, int end)
+        {
+#pragma omp simd
+            for (int i = begin; i < end; ++i) p[i] = r[i] + beta * (p[i] - omega * v[i]);
+        });
+
+        precondition(M, pool, p.data(), p_hat.data(), n);
+        A.multiply(p_hat.data(), v.data(), pool);
+        alpha = rho / dot(pool, r0.data(), v.data(), n);
+
+        // s = r - alpha v is kept in r
+        for_blocks(pool, n, [&](int begin, int end)
+        {
+#pragma omp simd
+            for (int i = begin; i < end; ++i)
+            {
+                r[i] -= alpha * v[i];
+                x[i] += alpha * p_hat[i];
+            }
+        });
+        result.residual = std::sqrt(dot(pool, r.data(), r.data(), n)) / b_norm;
+        if (result.residual <= tolerance)
+        {
+            result.converged = true;
+            break;
+        }
+
+        precondition(M, pool, r.data(), s_hat.data(), n);
+        A.multiply(s_hat.data(), t.data(), pool);
+        const double tt = dot(pool, t.data(), t.data(), n);
+        omega = (tt > 0) ? dot(pool, t.data(), r.data(), n) / tt : 0.0;
+        if (omega == 0) break;
+        for_blocks(pool, n, [&](int begin, int end)
+        {
+#pragma omp simd
+            for (int i = begin; i < end; ++i)
+            {
+                x[i] += omega * s_hat[i];
+                r[i] -= omega * t[i];
+            }
+        });
+        result.residual = std::sqrt(dot(pool, r.data(), r.data(), n)) / b_norm;
+        if (result.residual <= tolerance)
+        {
+            result.converged = true;
+            break;
+        }
+    }
+    return result;
+}
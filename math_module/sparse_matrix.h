@@ -0,0 +1,197 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace PdeSolver
+{
+    class ThreadPool;
+}
+
+namespace MathModule
+{
+    /**
+     * A sparse matrix in the compressed sparse row (CSR) format: the columns and the values of row i are
+     * at row_start()[i] ... row_start()[i + 1] - 1, sorted by the column.
+     *
+     * The matrices of grid operators with the natural (row by row) numbering of the nodes are banded: their elements lie
+     * on a few diagonals (5 for the 5-point stencil). Such a matrix is also kept by diagonals, and multiply walks them
+     * with contiguous (vectorized) loops and without the column indices, which halves the memory traffic.
+     * The sums of the rows are taken in the order of the columns either way. The rows are split across the threads of a pool.
+     */
+    class SparseMatrix
+    {
+    public:
+        struct Entry_t
+        {
+            int row;
+            int col;
+            double value;
+        };
+
+        SparseMatrix();
+
+        /**
+         * @brief Builds the rows x cols matrix from the entries in any order, the entries of the same element are summed.
+         */
+        void assemble(int rows, int cols, std::vector<Entry_t> entries);
+        void clear();
+
+        int rows() const { return m_rows; }
+        int cols() const { return m_cols; }
+        int nonzeros() const { return int(m_values.size()); }
+        bool empty() const { return m_rows == 0; }
+
+        /**
+         * @brief The largest |i - j| of the stored elements.
+         */
+        int bandwidth() const;
+
+        const int* row_start() const { return m_row_start.data(); }
+        const int* columns() const { return m_columns.data(); }
+        const double* values() const { return m_values.data(); }
+        double* values() { return m_values.data(); }   /**< The values may be changed in place, the sparsity may not */
+
+        /**
+         * @brief The index of the diagonal element of the row in columns() and values(), -1 if it is not stored.
+         */
+        int diagonal_index(int row) const { return m_diagonal[row]; }
+
+        /**
+         * @brief y = A x, split across the pool if it is given. y must not overlap x.
+         */
+        void multiply(const double* x, double* y, PdeSolver::ThreadPool* pool = NULL) const;
+
+    private:
+        int m_rows = 0;
+        int m_cols = 0;
+        std::vector<int> m_row_start;   /**< rows + 1 offsets */
+        std::vector<int> m_columns;
+        std::vector<double> m_values;
+        std::vector<int> m_diagonal;    /**< the positions of the diagonal elements */
+
+        static const int MaxDiagonals = 16;     /**< The matrices with more diagonals are multiplied in CSR */
+        std::vector<int> m_band_offsets;        /**< the column - row of the stored diagonals in the increasing order, empty if not banded */
+        std::vector<double> m_band_values;      /**< the diagonals (rows elements each, zero outside the matrix) one after another */
+    };
+
+    /**
+     * An approximate inverse of a matrix for the Krylov solvers: apply computes z = M^-1 r.
+     */
+    class Preconditioner
+    {
+    public:
+        virtual ~Preconditioner() {}
+
+        /**
+         * @brief z = M^-1 r, z must not overlap r.
+         */
+        virtual void apply(const double* r, double* z) const = 0;
+    };
+
+    /**
+     * M = D, the diagonal of the matrix. The cheapest one, and the only one that is split across the threads.
+     */
+    class JacobiPreconditioner : public Preconditioner
+    {
+    public:
+        explicit JacobiPreconditioner(const SparseMatrix& matrix, PdeSolver::ThreadPool* pool = NULL);
+        virtual void apply(const double* r, double* z) const;
+
+    private:
+        std::vector<double> m_inv_diagonal;
+        PdeSolver::ThreadPool* m_pool;
+    };
+
+    /**
+     * M = L U, the incomplete LU factorization with no fill-in: L and U have the sparsity of the matrix.
+     * For a symmetric M-matrix (e.g. an implicit step of the heat equation) it is the incomplete Cholesky factorization,
+     * so it may be used with the conjugate gradients. The triangular solves are sequential.
+     */
+    class Ilu0Preconditioner : public Preconditioner
+    {
+    public:
+        explicit Ilu0Preconditioner(const SparseMatrix& matrix);
+        virtual void apply(const double* r, double* z) const;
+
+    private:
+        SparseMatrix m_factors;     /**< L (unit diagonal, not stored) below the diagonal and U on and above it */
+        std::vector<double> m_inv_pivots;   /**< the reciprocal diagonal of U (the substitutions are latency bound, a division would double it) */
+    };
+
+    /**
+     * Symmetric successive over-relaxation: M = (D / 𝜔 + L) (D / 𝜔)^-1 (D / 𝜔 + U) 𝜔 / (2 - 𝜔), where L and U are
+     * the strictly lower and upper parts of the matrix. Symmetric for a symmetric matrix, no setup beyond the diagonal.
+     * The triangular solves are sequential.
+     */
+    class SsorPreconditioner : public Preconditioner
+    {
+    public:
+        SsorPreconditioner(const SparseMatrix& matrix, double omega);
+        virtual void apply(const double* r, double* z) const;
+
+    private:
+        const SparseMatrix& m_matrix;
+        double m_omega;
+        std::vector<double> m_inv_diagonal; /**< 𝜔 / D */
+    };
+
+    /**
+     * @brief Creates the preconditioner by its name: "none" (returns NULL), "jacobi", "ilu0" or "ssor" (𝜔 = 1.5).
+     * The preconditioner keeps a reference to the matrix (ssor) or to the pool (jacobi), they must outlive it.
+     */
+    std::unique_ptr<Preconditioner> make_preconditioner(const std::string& name, const SparseMatrix& matrix, PdeSolver::ThreadPool* pool = NULL);
+
+    /**
+     * The result of a Krylov solve.
+     */
+    struct KrylovResult_t
+    {
+        int iterations = 0;
+        double residual = 0.0;      /**< |b - A x| / |b| */
+        bool converged = false;
+    };
+
+    /**
+     * @brief Solves A x = b by the preconditioned conjugate gradients (A and M symmetric positive definite),
+     * starting from the given x, until |b - A x| <= tolerance |b| or max_iterations.
+     *
+     * The vector operations and multiply are split across the pool if it is given. The dot products are summed
+     * by fixed blocks in a fixed order, so the result does not depend on the number of threads. M may be NULL.
+     */
+    KrylovResult_t conjugate_gradient(const SparseMatrix& A, const Preconditioner* M, const double* b, double* x,
+                                      double tolerance, int max_iterations, PdeSolver::ThreadPool* pool = NULL);
+
+    /**
+     * @brief Solves A x = b by the right preconditioned BiCGStab (any nonsingular A), otherwise the same as conjugate_gradient.
+     */
+    KrylovResult_t bicgstab(const SparseMatrix& A, const Preconditioner* M, const double* b, double* x,
+                            double tolerance, int max_iterations, PdeSolver::ThreadPool* pool = NULL);
+}
+
+#endif // SPARSE_MATRIX_H
@@ -0,0 +1,371 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "vector_math.h"
+
+#include <cstddef>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+
+namespace
+{
+    inline float as_float(int32_t i)
+    {
+        float f;
+        std::memcpy(&f, &i, sizeof(f));
+        return f;
+    }
+
+    inline int32_t as_int(float f)
+    {
+        int32_t i;
+        std::memcpy(&i, &f, sizeof(i));
+        return i;
+    }
+
+    /**
+     * floor(x) for |x| < 2^31 (std::floor is not vectorized without SSE4.1).
+     */
+    inline float floor_small(float x)
+    {
+        float t = float(int32_t(x));
+        return (t > x) ? t - 1.0f : t;
+    }
+
+    /**
+     * The reduction of sin_cos is accurate up to this |x| (and the octant fits in int32_t); the other arguments,
+     * also infinities and NaN, go to std::sin, std::cos and std::tan.
+     */
+    const float SinCosMaxArg = 8192.0f;
+
+    /**
+     * true if sin_cos can take all of x[0..n).
+     */
+    inline bool in_reduction_range(const float* x, int n)
+    {
+        int out_of_range = 0;
+#pragma omp simd reduction(|:out_of_range)
+        for (int i = 0; i < n; ++i) out_of_range |= !(std::fabs(x[i]) <= SinCosMaxArg);
+        return out_of_range == 0;
+    }
+
+    /**
+     * sin(x) (if cosine is false) or cos(x) (otherwise) for |x| <= SinCosMaxArg.
+     *
+     * |x| is reduced to r = |x| - j * pi/4 with an even octant j, then
+     * sin(j * pi/4 + r) is one of sin(r), cos(r), -sin(r), -cos(r). cos(x) is sin(|x| + pi/2), i.e. the octant j + 2.
+     */
+    inline float sin_cos(float x, bool cosine)
+    {
+        const float four_over_pi = 1.27323954473516f;
+        const float DP1 = 0.78515625f;
+        const float DP2 = 2.4187564849853515625e-4f;
+        const float DP3 = 3.77489497744594108e-8f;
+
+        float ax = std::fabs(x);
+        int32_t j = int32_t(ax * four_over_pi);
+        j = (j + 1) & ~1;
+        float y = float(j);
+        float r = ((ax - y * DP1) - y * DP2) - y * DP3;
+        float z = r * r;
+
+        float poly_cos = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+        float poly_sin = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+
+        if (cosine) j += 2;
+        float res = (j & 2) ? poly_cos : poly_sin;
+
+        // the sign: the octants 4..7 are negative, sin is odd
+        int32_t sign = (j & 4) << 29;
+        if (!cosine) sign ^= as_int(x) & int32_t(0x80000000);
+        return as_float(as_int(res) ^ sign);
+    }
+
+    inline float exp_kernel(float x)
+    {
+        const float log2e = 1.44269504088896341f;
+        const float C1 = 0.693359375f;
+        const float C2 = -2.12194440e-4f;
+        const float lo = -87.3365447505f;
+        const float hi = 88.7228391116729996f;
+
+        float xc = (x < lo) ? lo : x;
+        xc = (xc > hi) ? hi : xc;
+        float fx = floor_small(xc * log2e + 0.5f);
+        float r = xc - fx * C1 - fx * C2;
+        float z = r * r;
+
+        float y = ((((1.9875691500e-4f * r + 1.3981999507e-3f) * r + 8.3334519073e-3f) * r
+                    + 4.1665795894e-2f) * r + 1.6666665459e-1f) * r + 5.0000001201e-1f;
+        y = y * z + r + 1.0f;
+
+        // y * 2^fx; 2^fx is split in two factors so that fx = 128 does not overflow the exponent field
+        int32_t e = int32_t(fx);
+        int32_t e1 = e >> 1;
+        y = (y * as_float((e1 + 127) << 23)) * as_float((e - e1 + 127) << 23);
+
+        // the results below FLT_MIN are flushed to zero
+        y = (x > hi) ? std::numeric_limits<float>::infinity() : y;
+        y = (x < lo) ? 0.0f : y;
+        return (x != x) ? x : y;
+    }
+
+    inline float log_kernel(float x)
+    {
+        const float SQRTHF = 0.707106781186547524f;
+
+        // denormals are scaled up to get a normalized mantissa
+        bool denormal = (x > 0) && (x < std::numeric_limits<float>::min());
+        float xs = denormal ? x * 33554432.0f : x;  // 2^25
+
+        int32_t bits = as_int(xs);
+        float e = float(((bits >> 23) & 0xff) - 126) - (denormal ? 25.0f : 0.0f);
+        float m = as_float((bits & 0x007fffff) | 0x3f000000);  // the mantissa in [0.5, 1)
+
+        bool small = m < SQRTHF;
+        e = small ? e - 1.0f : e;
+        m = small ? m + m - 1.0f : m - 1.0f;
+
+        float z = m * m;
+        float y = 7.0376836292e-2f;
+        y = y * m - 1.1514610310e-1f;
+        y = y * m + 1.1676998740e-1f;
+        y = y * m - 1.2420140846e-1f;
+        y = y * m + 1.4249322787e-1f;
+        y = y * m - 1.6668057665e-1f;
+        y = y * m + 2.0000714765e-1f;
+        y = y * m - 2.4999993993e-1f;
+        y = y * m + 3.3333331174e-1f;
+        y = y * m * z;
+
+        y += e * -2.12194440e-4f;
+        y += -0.5f * z;
+        float res = m + y + e * 0.693359375f;
+
+        res = (x == std::numeric_limits<float>::infinity()) ? x : res;
+        res = (x == 0) ? -std::numeric_limits<float>::infinity() : res;
+        res = (x < 0) ? std::numeric_limits<float>::quiet_NaN() : res;
+        return (x != x) ? x : res;
+    }
+
+    /**
+     * A row of the 5-point stencil (n >= 2). v1 and v2 are the rows along the other axis, v2 is NULL
+     * for a boundary row and both are NULL for a single row.
+     */
+    inline void stencil5_row(const float* u, const float* v1, const float* v2, float* dst, int n, float center, float along, float across)
+    {
+        auto other = [&](int j) { return (v1 ? v1[j] : 0.0f) + (v2 ? v2[j] : 0.0f); };
+
+        dst[0] = center * u[0] + along * u[1] + across * other(0);
+        if (v1 && v2)
+        {
+#pragma omp simd
+            for (int j = 1; j < n - 1; ++j) dst[j] = center * u[j] + along * (u[j - 1] + u[j + 1]) + across * (v1[j] + v2[j]);
+        }
+        else if (v1)
+        {
+#pragma omp simd
+            for (int j = 1; j < n - 1; ++j) dst[j] = center * u[j] + along * (u[j - 1] + u[j + 1]) + across * v1[j];
+        }
+        else
+        {
+#pragma omp simd
+            for (int j = 1; j < n - 1; ++j) dst[j] = center * u[j] + along * (u[j - 1] + u[j + 1]);
+        }
+        dst[n - 1] = center * u[n - 1] + along * u[n - 2] + across * other(n - 1);
+    }
+}
+
+void MathModule::vector_sqrt(float* x, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] = std::sqrt(x[i]);
+}
+
+void MathModule::vector_sin(float* x, int n)
+{
+    if (!in_reduction_range(x, n))
+    {
+        for (int i = 0; i < n; ++i) x[i] = (std::fabs(x[i]) <= SinCosMaxArg) ? sin_cos(x[i], false) : std::sin(x[i]);
+        return;
+    }
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] = sin_cos(x[i], false);
+}
+
+void MathModule::vector_cos(float* x, int n)
+{
+    if (!in_reduction_range(x, n))
+    {
+        for (int i = 0; i < n; ++i) x[i] = (std::fabs(x[i]) <= SinCosMaxArg) ? sin_cos(x[i], true) : std::cos(x[i]);
+        return;
+    }
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] = sin_cos(x[i], true);
+}
+
+void MathModule::vector_tan(float* x, int n)
+{
+    if (!in_reduction_range(x, n))
+    {
+        for (int i = 0; i < n; ++i) x[i] = (std::fabs(x[i]) <= SinCosMaxArg) ? sin_cos(x[i], false) / sin_cos(x[i], true) : std::tan(x[i]);
+        return;
+    }
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] = sin_cos(x[i], false) / sin_cos(x[i], true);
+}
+
+void MathModule::vector_exp(float* x, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] = exp_kernel(x[i]);
+}
+
+void MathModule::vector_log(float* x, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] = log_kernel(x[i]);
+}
+
+void MathModule::vector_abs(float* x, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] = std::fabs(x[i]);
+}
+
+void MathModule::vector_neg(float* x, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] = -x[i];
+}
+
+void MathModule::vector_add(float* x, const float* y, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] += y[i];
+}
+
+void MathModule::vector_sub(float* x, const float* y, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] -= y[i];
+}
+
+void MathModule::vector_mul(float* x, const float* y, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] *= y[i];
+}
+
+void MathModule::vector_div(float* x, const float* y, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] /= y[i];
+}
+
+void MathModule::vector_mod(float* x, const float* y, int n)
+{
+    for (int i = 0; i < n; ++i) x[i] = std::fmod(x[i], y[i]);
+}
+
+void MathModule::vector_pow(float* x, const float* y, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i)
+    {
+        float base = x[i], exponent = y[i];
+        float res = exp_kernel(exponent * log_kernel(std::fabs(base)));
+
+        // a negative base: the sign depends on the parity of an integer exponent, otherwise the result is NaN
+        // (exponents above 2^23 are always integer and are treated as even)
+        float clamped = (std::fabs(exponent) < 8388608.0f) ? exponent : 0.0f;
+        int32_t whole = int32_t(clamped);
+        bool is_integer = (float(whole) == clamped);
+        bool is_odd = is_integer && ((whole & 1) != 0);
+
+        float negative_res = is_odd ? -res : res;
+        negative_res = is_integer ? negative_res : std::numeric_limits<float>::quiet_NaN();
+        res = (base < 0) ? negative_res : res;
+        x[i] = (exponent == 0) ? 1.0f : res;
+    }
+}
+
+void MathModule::vector_min(float* x, const float* y, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i)
+    {
+        float res = (y[i] < x[i]) ? y[i] : x[i];
+        x[i] = (y[i] != y[i]) ? y[i] : res;
+    }
+}
+
+void MathModule::vector_max(float* x, const float* y, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i)
+    {
+        float res = (y[i] > x[i]) ? y[i] : x[i];
+        x[i] = (y[i] != y[i]) ? y[i] : res;
+    }
+}
+
+void MathModule::vector_fill(float* x, float value, int n)
+{
+#pragma omp simd
+    for (int i = 0; i < n; ++i) x[i] = value;
+}
+
+void MathModule::vector_stencil5(const float* u, const float* u_up, const float* u_down, float* dst, int n, float center, float along, float across)
+{
+    if (n <= 0) return;
+    if (n == 1)
+    {
+        dst[0] = center * u[0] + across * ((u_up ? u_up[0] : 0.0f) + (u_down ? u_down[0] : 0.0f));
+        return;
+    }
+
+    // a boundary row has a single neighbour along the other axis
+    stencil5_row(u, u_up ? u_up : u_down, (u_up && u_down) ? u_down : NULL, dst, n, center, along, across);
+}
+
+void MathModule::vector_transpose(const float* src, int src_stride, float* dst, int dst_stride, int rows, int cols)
+{
+    const int tile = 16;
+    for (int i0 = 0; i0 < rows; i0 += tile)
+    {
+        const int i1 = (i0 + tile < rows) ? i0 + tile : rows;
+        for (int j0 = 0; j0 < cols; j0 += tile)
+        {
+            const int j1 = (j0 + tile < cols) ? j0 + tile : cols;
+            for (int j = j0; j < j1; ++j)
+            {
+                float* d = dst + std::ptrdiff_t(j) * dst_stride;
+#pragma omp simd
+                for (int i = i0; i < i1; ++i) d[i] = src[std::ptrdiff_t(i) * src_stride + j];
+            }
+        }
+    }
+}
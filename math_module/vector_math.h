@@ -0,0 +1,71 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef VECTOR_MATH_H
+#define VECTOR_MATH_H
+
+namespace MathModule
+{
+    /**
+     * Element-wise kernels over float arrays. The results are written back to the x array.
+     *
+     * The loops are written to be vectorized by the compiler (the project is built with -fopenmp-simd),
+     * so sin, cos, tan, exp, log and pow use Cephes-style polynomial approximations instead of libm calls.
+     * The approximations are accurate to a few ulp in float for |x| < 8192 (sin, cos, tan) and on the whole
+     * float range (exp, log). An array with a larger |x|, an infinity or NaN is computed element by element
+     * with std::sin, std::cos and std::tan for those elements.
+     */
+    void vector_sqrt(float* x, int n);
+    void vector_sin(float* x, int n);
+    void vector_cos(float* x, int n);
+    void vector_tan(float* x, int n);
+    void vector_exp(float* x, int n);
+    void vector_log(float* x, int n);
+    void vector_abs(float* x, int n);
+    void vector_neg(float* x, int n);
+
+    void vector_add(float* x, const float* y, int n);
+    void vector_sub(float* x, const float* y, int n);
+    void vector_mul(float* x, const float* y, int n);
+    void vector_div(float* x, const float* y, int n);
+    void vector_mod(float* x, const float* y, int n);
+    void vector_pow(float* x, const float* y, int n);  /**< x = pow(x, y) (a negative x is allowed only with an integer y, as in std::pow) */
+    void vector_min(float* x, const float* y, int n);
+    void vector_max(float* x, const float* y, int n);
+
+    void vector_fill(float* x, float value, int n);
+
+    /**
+     * The 5-point stencil on a row of a grid: dst[j] = center * u[j] + along * (u[j - 1] + u[j + 1]) + across * (u_up[j] + u_down[j]).
+     * The nodes outside the row are zero, u_up or u_down may be NULL (a zero row). dst must not overlap the input rows.
+     */
+    void vector_stencil5(const float* u, const float* u_up, const float* u_down, float* dst, int n, float center, float along, float across);
+
+    /**
+     * Transposes a rows x cols block: dst[j * dst_stride + i] = src[i * src_stride + j].
+     * The block is walked in small square tiles, so both the reads and the writes stay in cache.
+     */
+    void vector_transpose(const float* src, int src_stride, float* dst, int dst_stride, int rows, int cols);
+}
+
+#endif // VECTOR_MATH_H
@@ -0,0 +1,152 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "pde_checkpoint.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include <cstring>
+
+using namespace PdeSolver;
+
+namespace
+{
+    const char CheckpointMagic[8] = "PDECKPT";
+    const quint32 CheckpointVersion = 1;
+
+    struct CheckpointFileHeader_t
+    {
+        char magic[8];              /**< "PDECKPT" and the terminating zero */
+        quint32 version;
+        qint32 t_count;
+        qint32 level_count;
+        qint32 rows;
+        qint32 cols;
+        qint32 slice_count;         /**< The size of t_list */
+        quint64 settings_size;
+    };
+
+    /**
+     * @brief The settings a checkpoint is valid for: the ones that do not change the computed levels are left out,
+     * the method and the solver are added.
+     */
+    QByteArray problem_settings(const PdeSettings& set, const SolutionMethod_t& method, const QString& solver)
+    {
+        QVariantMap map = set.toQVariantMap();
+        for (const char* key : { "threads", "timeBlock", "outputFile", "compression", "compressionTolerance", "profile", "traceFile",
+                                 "checkpointFile", "checkpointEvery", "resume", "keepPartial", "maxCycles", "maxIterations" })
+        {
+            map.remove(key);
+        }
+        map.insert("method", method.name);
+        map.insert("coords", method.coord_system);
+        map.insert("dim", method.dim);
+        map.insert("solver", solver);
+        return QJsonDocument(QJsonObject::fromVariantMap(map)).toJson(QJsonDocument::Compact);
+    }
+}
+
+void PdeSolver::save_checkpoint(const QString& filename, const PdeSettings& set, const SolutionMethod_t& method, const QString& solver,
+                                int t_count, const QList<double>& t_list, const std::vector<const Field_t*>& levels)
+{
+    if (levels.empty()) throw("A checkpoint needs at least one time level");
+
+    const int rows = levels.front()->rows();
+    const int cols = levels.front()->cols();
+    QByteArray settings = problem_settings(set, method, solver);
+
+    CheckpointFileHeader_t header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CheckpointMagic, sizeof(header.magic));
+    header.version = CheckpointVersion;
+    header.t_count = t_count;
+    header.level_count = int(levels.size());
+    header.rows = rows;
+    header.cols = cols;
+    header.slice_count = t_list.size();
+    header.settings_size = settings.size();
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) throw("Cannot create the checkpoint file");
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(settings.constData(), settings.size());
+    for (double t : t_list) file.write(reinterpret_cast<const char*>(&t), sizeof(t));
+    for (const Field_t* level : levels)
+    {
+        if ((level->rows() != rows) || (level->cols() != cols)) throw("The checkpoint levels must have the same grid");
+        for (int i = 0; i < rows; ++i) file.write(reinterpret_cast<const char*>(level->row(i)), cols * sizeof(float));
+    }
+
+    if (!file.commit()) throw("Cannot write the checkpoint file");
+}
+
+bool PdeSolver::load_checkpoint(const QString& filename, const PdeSettings& set, const SolutionMethod_t& method, const QString& solver,
+                                Checkpoint_t& checkpoint)
+{
+    QFile file(filename);
+    if (!file.exists() || !file.open(QIODevice::ReadOnly)) return false;
+
+    CheckpointFileHeader_t header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != qint64(sizeof(header))) throw("The checkpoint file is truncated");
+    if (std::memcmp(header.magic, CheckpointMagic, sizeof(header.magic)) != 0) throw("Not a checkpoint file");
+    if (header.version != CheckpointVersion) throw("Unsupported checkpoint file version");
+    if ((header.t_count < 0) || (header.level_count <= 0) || (header.rows <= 0) || (header.cols <= 0) || (header.slice_count < 0))
+        throw("The checkpoint file is corrupted");
+
+    // the sizes are checked before anything is allocated for them
+    const qint64 data_bytes = qint64(header.slice_count) * qint64(sizeof(double)) +
+                              qint64(header.level_count) * header.rows * header.cols * qint64(sizeof(float));
+    const quint64 remaining = quint64(file.size() - file.pos());
+    if ((header.settings_size > remaining) || (remaining - header.settings_size < quint64(data_bytes)))
+        throw("The checkpoint file is truncated");
+
+    QByteArray settings = file.read(qint64(header.settings_size));
+    if (settings.size() != int(header.settings_size)) throw("The checkpoint file is truncated");
+    if (settings != problem_settings(set, method, solver)) return false;
+
+    Checkpoint_t loaded;
+    loaded.t_count = header.t_count;
+    for (int k = 0; k < header.slice_count; ++k)
+    {
+        double t = 0;
+        if (file.read(reinterpret_cast<char*>(&t), sizeof(t)) != qint64(sizeof(t))) throw("The checkpoint file is truncated");
+        loaded.t_list.push_back(t);
+    }
+    loaded.levels.resize(header.level_count);
+    for (Field_t& level : loaded.levels)
+    {
+        level.resize(header.rows, header.cols);
+        for (int i = 0; i < header.rows; ++i)
+        {
+            const qint64 bytes = qint64(header.cols) * sizeof(float);
+            if (file.read(reinterpret_cast<char*>(level.row(i)), bytes) != bytes) throw("The checkpoint file is truncated");
+        }
+    }
+
+    checkpoint = std::move(loaded);
+    return true;
+}
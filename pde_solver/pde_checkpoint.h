@@ -0,0 +1,68 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_CHECKPOINT_H
+#define PDE_CHECKPOINT_H
+
+#include <QList>
+#include <QString>
+
+#include <vector>
+
+#include "pde_settings.h"
+#include "pde_field.h"
+#include "pde_solver_structs.h"
+
+namespace PdeSolver
+{
+    /**
+     * @brief The state a time-stepping solver needs to continue a solve.
+     */
+    struct Checkpoint_t
+    {
+        int t_count = 0;                /**< The index of the newest computed time level */
+        QList<double> t_list;           /**< The times of the output slices written up to t_count */
+        std::vector<Field_t> levels;    /**< The working time levels, the newest first */
+    };
+
+    /**
+     * @brief Writes a checkpoint file (atomically: a crash while writing keeps the previous checkpoint).
+     *
+     * The file layout (native byte order): CheckpointFileHeader_t | settings (UTF-8 JSON) | t_list | levels (row-major floats).
+     * The settings also name the method and the solver (the class name), so another scheme does not resume the levels.
+     */
+    void save_checkpoint(const QString& filename, const PdeSettings& set, const SolutionMethod_t& method, const QString& solver,
+                         int t_count, const QList<double>& t_list, const std::vector<const Field_t*>& levels);
+
+    /**
+     * @brief Reads a checkpoint file.
+     *
+     * Returns false if there is no file or it was written for another problem (the method, the solver, the grid, the coefficients,
+     * the expressions or the output retention differ; the output, profiling and threading settings may change).
+     * Throws if the file is corrupted.
+     */
+    bool load_checkpoint(const QString& filename, const PdeSettings& set, const SolutionMethod_t& method, const QString& solver,
+                         Checkpoint_t& checkpoint);
+}
+
+#endif // PDE_CHECKPOINT_H
@@ -0,0 +1,500 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "pde_expression.h"
+#include "../math_module/vector_math.h"
+
+#include <QtCore/qmath.h>
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <algorithm>
+
+namespace
+{
+    struct Function_t
+    {
+        const char* name;
+        PdeExpression::OpCode op;
+        int min_args;
+        int max_args;   /**< -1 means any number of arguments (folded pairwise, as in Math.min/Math.max) */
+    };
+
+    const Function_t functions[] =
+    {
+        { "sqrt", PdeExpression::Sqrt, 1, 1 },
+        { "sin",  PdeExpression::Sin,  1, 1 },
+        { "cos",  PdeExpression::Cos,  1, 1 },
+        { "tan",  PdeExpression::Tan,  1, 1 },
+        { "exp",  PdeExpression::Exp,  1, 1 },
+        { "log",  PdeExpression::Log,  1, 1 },
+        { "abs",  PdeExpression::Abs,  1, 1 },
+        { "pow",  PdeExpression::Pow,  2, 2 },
+        { "min",  PdeExpression::Min,  2, -1 },
+        { "max",  PdeExpression::Max,  2, -1 }
+    };
+
+    struct Variable_t
+    {
+        const char* name;
+        PdeExpression::Variable var;
+    };
+
+    const Variable_t variables[] =
+    {
+        { "x", PdeExpression::X },
+        { "y", PdeExpression::Y },
+        { "z", PdeExpression::Z },
+        { "R", PdeExpression::R },
+        { "F", PdeExpression::F },
+        { "T", PdeExpression::T }
+    };
+}
+
+/**
+ * @brief A recursive descent parser which emits the program while parsing.
+ *
+ * expr    := term (('+' | '-') term)*\n
+ * term    := unary (('*' | '/' | '%') unary)*\n
+ * unary   := ('+' | '-') unary | primary\n
+ * primary := number | constant | variable | function '(' expr (',' expr)* ')' | '(' expr ')'
+ */
+struct PdeExpression::Parser_t
+{
+    PdeExpression& expr;
+    std::string src;
+    int allowed_variables;
+    size_t pos = 0;
+    int depth = 0;
+    int max_depth = 0;
+
+    Parser_t(PdeExpression& expr_, const QString& source, int allowed_variables_)
+        : expr(expr_), src(source.toStdString()), allowed_variables(allowed_variables_) {}
+
+    [[noreturn]] void fail(const std::string& msg) const
+    {
+        throw std::invalid_argument("Error in expression \"" + src + "\" at position " + std::to_string(pos) + ": " + msg);
+    }
+
+    void skip_spaces()
+    {
+        while ((pos < src.size()) && std::isspace(static_cast<unsigned char>(src[pos]))) ++pos;
+    }
+
+    bool accept(char ch)
+    {
+        skip_spaces();
+        if ((pos < src.size()) && (src[pos] == ch))
+        {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char ch)
+    {
+        if (!accept(ch)) fail(std::string("'") + ch + "' expected");
+    }
+
+    void push(int count = 1)
+    {
+        depth += count;
+        if (depth > max_depth) max_depth = depth;
+        if (max_depth > MaxStackDepth) fail("the expression is too deep");
+    }
+
+    void op(OpCode code)
+    {
+        depth -= arity(code) - 1;
+        expr.emit_op(code);
+    }
+
+    void parse()
+    {
+        skip_spaces();
+        if (pos == src.size())
+        {
+            expr.emit_const(0);
+            return;
+        }
+        parse_expr();
+        skip_spaces();
+        if (pos != src.size()) fail("unexpected '" + src.substr(pos, 1) + "'");
+    }
+
+    void parse_expr()
+    {
+        parse_term();
+        for (;;)
+        {
+            if (accept('+')) { parse_term(); op(Add); }
+            else if (accept('-')) { parse_term(); op(Sub); }
+            else break;
+        }
+    }
+
+    void parse_term()
+    {
+        parse_unary();
+        for (;;)
+        {
+            if (accept('*')) { parse_unary(); op(Mul); }
+            else if (accept('/')) { parse_unary(); op(Div); }
+            else if (accept('%')) { parse_unary(); op(Mod); }
+            else break;
+        }
+    }
+
+    void parse_unary()
+    {
+        if (accept('-')) { parse_unary(); op(Neg); }
+        else if (accept('+')) parse_unary();
+        else parse_primary();
+    }
+
+    void parse_primary()
+    {
+        skip_spaces();
+        if (pos == src.size()) fail("unexpected end of the expression");
+
+        char ch = src[pos];
+        if (accept('('))
+        {
+            parse_expr();
+            expect(')');
+        }
+        else if (std::isdigit(static_cast<unsigned char>(ch)) || (ch == '.')) parse_number();
+        else if (std::isalpha(static_cast<unsigned char>(ch)) || (ch == '_')) parse_identifier();
+        else fail("unexpected '" + src.substr(pos, 1) + "'");
+    }
+
+    void parse_number()
+    {
+        // the digits [. digits] [e [+-] digits] are scanned here and converted in the C locale:
+        // strtod follows LC_NUMERIC, which reads "0.5" as 0 in a comma-decimal locale
+        size_t end = pos;
+        while ((end < src.size()) && std::isdigit(static_cast<unsigned char>(src[end]))) ++end;
+        if ((end < src.size()) && (src[end] == '.')) ++end;
+        while ((end < src.size()) && std::isdigit(static_cast<unsigned char>(src[end]))) ++end;
+        if ((end == pos) || ((end == pos + 1) && (src[pos] == '.'))) fail("a number expected");
+        if ((end < src.size()) && ((src[end] == 'e') || (src[end] == 'E')))
+        {
+            size_t exponent = end + 1;
+            if ((exponent < src.size()) && ((src[exponent] == '+') || (src[exponent] == '-'))) ++exponent;
+            if ((exponent < src.size()) && std::isdigit(static_cast<unsigned char>(src[exponent])))
+            {
+                end = exponent;
+                while ((end < src.size()) && std::isdigit(static_cast<unsigned char>(src[end]))) ++end;
+            }
+        }
+
+        std::istringstream stream(src.substr(pos, end - pos));
+        stream.imbue(std::locale::classic());
+        double value = 0;
+        stream >> value;
+        if (stream.fail()) fail("a number expected");
+        pos = end;
+
+        push();
+        expr.emit_const(value);
+    }
+
+    void parse_identifier()
+    {
+        size_t start = pos;
+        while ((pos < src.size()) && (std::isalnum(static_cast<unsigned char>(src[pos])) || (src[pos] == '_'))) ++pos;
+        std::string name = src.substr(start, pos - start);
+
+        // "Math.sin" etc. are accepted for compatibility with the former JavaScript evaluator
+        if ((name == "Math") && accept('.'))
+        {
+            skip_spaces();
+            parse_identifier();
+            return;
+        }
+
+        if (name == "PI") { push(); expr.emit_const(M_PI); return; }
+        if (name == "E") { push(); expr.emit_const(M_E); return; }
+
+        for (auto& var : variables)
+        {
+            if (name != var.name) continue;
+            if (!(allowed_variables & (1 << var.var)))
+            {
+                pos = start;
+                fail("the variable \"" + name + "\" cannot be used here");
+            }
+            push();
+            expr.emit_var(var.var);
+            return;
+        }
+
+        for (auto& func : functions)
+        {
+            if (name != func.name) continue;
+
+            expect('(');
+            int args = 0;
+            do
+            {
+                parse_expr();
+                ++args;
+                if (args > 1 && func.max_args == -1) op(func.op);
+            } while (accept(','));
+            expect(')');
+
+            if ((args < func.min_args) || ((func.max_args != -1) && (args > func.max_args)))
+            {
+                fail("wrong number of arguments of \"" + name + "\"");
+            }
+            if (func.max_args != -1) op(func.op);
+            return;
+        }
+
+        pos = start;
+        fail("unknown identifier \"" + name + "\"");
+    }
+};
+
+PdeExpression::PdeExpression()
+{
+    emit_const(0);
+}
+
+void PdeExpression::compile(const QString& source, int allowed_variables)
+{
+    PdeExpression compiled;
+    compiled.m_Program.clear();
+    compiled.m_Source = source;
+    compiled.m_AllowedVariables = allowed_variables;
+
+    Parser_t parser(compiled, source, allowed_variables);
+    parser.parse();
+
+    *this = compiled;
+}
+
+int PdeExpression::arity(OpCode op)
+{
+    switch (op)
+    {
+    case PushConst:
+    case PushVar:
+        return 0;
+    case Neg:
+    case Sqrt:
+    case Sin:
+    case Cos:
+    case Tan:
+    case Exp:
+    case Log:
+    case Abs:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+double PdeExpression::apply(OpCode op, double a, double b)
+{
+    switch (op)
+    {
+    case Neg:  return -a;
+    case Add:  return a + b;
+    case Sub:  return a - b;
+    case Mul:  return a * b;
+    case Div:  return a / b;
+    case Mod:  return std::fmod(a, b);
+    case Sqrt: return std::sqrt(a);
+    case Sin:  return std::sin(a);
+    case Cos:  return std::cos(a);
+    case Tan:  return std::tan(a);
+    case Exp:  return std::exp(a);
+    case Log:  return std::log(a);
+    case Abs:  return std::fabs(a);
+    case Pow:  return std::pow(a, b);
+    case Min:  return (std::isnan(a) || std::isnan(b)) ? NAN : ((a < b) ? a : b);
+    case Max:  return (std::isnan(a) || std::isnan(b)) ? NAN : ((a > b) ? a : b);
+    default:   return NAN;
+    }
+}
+
+void PdeExpression::emit_const(double value)
+{
+    Instruction_t instr;
+    instr.op = PushConst;
+    instr.var = -1;
+    instr.value = value;
+    m_Program.push_back(instr);
+}
+
+void PdeExpression::emit_var(int var)
+{
+    Instruction_t instr;
+    instr.op = PushVar;
+    instr.var = var;
+    instr.value = 0;
+    m_Program.push_back(instr);
+    m_UsedVariables |= 1 << var;
+}
+
+void PdeExpression::emit_op(OpCode op)
+{
+    // constant folding: an operation on constants is replaced with its result
+    int n = arity(op);
+    size_t size = m_Program.size();
+    bool operands_are_constant = size >= size_t(n);
+    for (int i = 1; operands_are_constant && (i <= n); ++i)
+    {
+        operands_are_constant = m_Program[size - i].op == PushConst;
+    }
+
+    if (operands_are_constant)
+    {
+        double a = m_Program[size - n].value;
+        double b = (n == 2) ? m_Program[size - 1].value : 0;
+        m_Program.resize(size - n);
+        emit_const(apply(op, a, b));
+        return;
+    }
+
+    Instruction_t instr;
+    instr.op = op;
+    instr.var = -1;
+    instr.value = 0;
+    m_Program.push_back(instr);
+}
+
+double PdeExpression::evaluate(const double* vars) const
+{
+    double stack[MaxStackDepth];
+    int top = -1;
+
+    for (const auto& instr : m_Program)
+    {
+        switch (instr.op)
+        {
+        case PushConst: stack[++top] = instr.value; break;
+        case PushVar:   stack[++top] = vars[instr.var]; break;
+        case Neg:       stack[top] = -stack[top]; break;
+        case Add:       --top; stack[top] += stack[top + 1]; break;
+        case Sub:       --top; stack[top] -= stack[top + 1]; break;
+        case Mul:       --top; stack[top] *= stack[top + 1]; break;
+        case Div:       --top; stack[top] /= stack[top + 1]; break;
+        default:
+            if (arity(instr.op) == 1) stack[top] = apply(instr.op, stack[top]);
+            else
+            {
+                --top;
+                stack[top] = apply(instr.op, stack[top], stack[top + 1]);
+            }
+        }
+    }
+
+    return stack[0];
+}
+
+void PdeExpression::evaluate(const float* const* vars, float* out, int n) const
+{
+    alignas(64) float stack[MaxStackDepth][BlockSize];
+    bool is_const[MaxStackDepth];      // the slot holds the same constant in every lane
+    double const_value[MaxStackDepth];
+    int top = -1;
+
+    for (const auto& instr : m_Program)
+    {
+        if (instr.op == PushConst)
+        {
+            ++top;
+            MathModule::vector_fill(stack[top], float(instr.value), n);
+            is_const[top] = true;
+            const_value[top] = instr.value;
+            continue;
+        }
+        if (instr.op == PushVar)
+        {
+            ++top;
+            std::copy(vars[instr.var], vars[instr.var] + n, stack[top]);
+            is_const[top] = false;
+            continue;
+        }
+
+        if (arity(instr.op) == 1)
+        {
+            float* a = stack[top];
+            switch (instr.op)
+            {
+            case Neg:  MathModule::vector_neg(a, n); break;
+            case Sqrt: MathModule::vector_sqrt(a, n); break;
+            case Sin:  MathModule::vector_sin(a, n); break;
+            case Cos:  MathModule::vector_cos(a, n); break;
+            case Tan:  MathModule::vector_tan(a, n); break;
+            case Exp:  MathModule::vector_exp(a, n); break;
+            case Log:  MathModule::vector_log(a, n); break;
+            case Abs:  MathModule::vector_abs(a, n); break;
+            default:   throw("Wrong opcode");
+            }
+            is_const[top] = false;
+            continue;
+        }
+
+        --top;
+        float* a = stack[top];
+        float* b = stack[top + 1];
+        switch (instr.op)
+        {
+        case Add: MathModule::vector_add(a, b, n); break;
+        case Sub: MathModule::vector_sub(a, b, n); break;
+        case Mul: MathModule::vector_mul(a, b, n); break;
+        case Div: MathModule::vector_div(a, b, n); break;
+        case Mod: MathModule::vector_mod(a, b, n); break;
+        case Min: MathModule::vector_min(a, b, n); break;
+        case Max: MathModule::vector_max(a, b, n); break;
+        case Pow:
+            // pow(E, b) and pow(const, b) are by far the most frequent forms (e.g. "pow(E, -R*R)")
+            if (is_const[top] && (const_value[top] > 0))
+            {
+                if (const_value[top] != M_E)
+                {
+                    MathModule::vector_fill(a, float(std::log(const_value[top])), n);
+                    MathModule::vector_mul(b, a, n);
+                }
+                MathModule::vector_exp(b, n);
+                std::copy(b, b + n, a);
+            }
+            else if (is_const[top + 1] && (const_value[top + 1] == 2)) MathModule::vector_mul(a, a, n);
+            else if (is_const[top + 1] && (const_value[top + 1] == 0.5)) MathModule::vector_sqrt(a, n);
+            else MathModule::vector_pow(a, b, n);
+            break;
+        default:
+            throw("Wrong opcode");
+        }
+        is_const[top] = false;
+    }
+
+    std::copy(stack[0], stack[0] + n, out);
+}
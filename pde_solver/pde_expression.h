@@ -0,0 +1,164 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_EXPRESSION_H
+#define PDE_EXPRESSION_H
+
+#include <QString>
+
+#include <vector>
+#include <stdexcept>
+
+/**
+ * @brief A compiled arithmetic expression (such as V1, V2 and f of PdeSettings).
+ *
+ * The expression is parsed once into a small stack-based program, so evaluating it for a grid node costs only a few
+ * arithmetic operations: no string processing and no heap allocation are done after compile(const QString&, int).
+ * The program can also be run over blocks of points at once, with every instruction applied to a whole block by
+ * the vectorized kernels of MathModule (see math_module/vector_math.h).\n
+ * The syntax is a subset of JavaScript arithmetic which was accepted by the former QScriptEngine-based evaluator:\n
+ * numbers, + - * / %, parentheses, the constants PI and E, the variables x, y, z, R, F, T and the functions
+ * sqrt, sin, cos, tan, exp, log, abs, pow, min and max.
+ */
+class PdeExpression
+{
+public:
+    enum Variable
+    {
+        X = 0,          /**< The first Cartesian coordinate ("x") */
+        Y,              /**< The second Cartesian coordinate ("y") */
+        Z,              /**< The third Cartesian coordinate ("z", 3d grids only) */
+        R,              /**< The radius ("R") */
+        F,              /**< The polar angle ("F") */
+        T,              /**< The time ("T") */
+        VariablesCount
+    };
+
+    /**
+     * @brief Bit flags of variables an expression is allowed to use.
+     * @see compile(const QString& source, int allowed_variables)
+     */
+    enum VariableMask
+    {
+        MaskX = 1 << X,
+        MaskY = 1 << Y,
+        MaskZ = 1 << Z,
+        MaskR = 1 << R,
+        MaskF = 1 << F,
+        MaskT = 1 << T
+    };
+
+    /**
+     * @brief The maximum depth of the evaluation stack. Deeper expressions are rejected by compile(const QString&, int).
+     */
+    static const int MaxStackDepth = 32;
+
+    /**
+     * @brief The maximum number of points evaluated by evaluate(const float* const*, float*, int) at once.
+     */
+    static const int BlockSize = 64;
+
+    PdeExpression();
+
+    /**
+     * @brief Parses the source and builds the program.
+     *
+     * Throws std::invalid_argument if the source cannot be parsed or uses an identifier
+     * which is unknown or not allowed by the allowed_variables mask.
+     * An empty source is the same as "0".
+     */
+    void compile(const QString& source, int allowed_variables);
+
+    /**
+     * @brief Evaluates the expression.
+     * @param vars values of the variables indexed by PdeExpression::Variable
+     */
+    double evaluate(const double* vars) const;
+
+    /**
+     * @brief Evaluates the expression at n points at once (in float precision).
+     * @param vars arrays of n values of every variable used, indexed by PdeExpression::Variable (unused ones may be NULL)
+     * @param out n results
+     * @param n the number of points, n <= BlockSize
+     */
+    void evaluate(const float* const* vars, float* out, int n) const;
+
+    bool is_constant() const { return (m_Program.size() == 1) && (m_Program[0].op == PushConst); }
+    bool is_zero() const { return is_constant() && (m_Program[0].value == 0); }
+
+    const QString& source() const { return m_Source; }
+    int used_variables() const { return m_UsedVariables; }
+    int allowed_variables() const { return m_AllowedVariables; }    /**< The mask the expression was compiled with */
+
+    enum OpCode
+    {
+        PushConst = 0,
+        PushVar,
+        Neg,
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Mod,
+        Sqrt,
+        Sin,
+        Cos,
+        Tan,
+        Exp,
+        Log,
+        Abs,
+        Pow,
+        Min,
+        Max
+    };
+
+    struct Instruction_t
+    {
+        OpCode op;
+        int var;        /**< The variable index (for PushVar only) */
+        double value;   /**< The constant (for PushConst only) */
+    };
+
+    const std::vector<Instruction_t>& program() const { return m_Program; }
+
+    /**
+     * @brief The number of operands consumed by an instruction (a PushConst/PushVar instruction consumes none).
+     */
+    static int arity(OpCode op);
+
+    static double apply(OpCode op, double a, double b = 0);
+
+private:
+    struct Parser_t;
+
+    void emit_const(double value);
+    void emit_var(int var);
+    void emit_op(OpCode op);
+
+    QString m_Source;
+    std::vector<Instruction_t> m_Program;
+    int m_UsedVariables = 0;
+    int m_AllowedVariables = 0;
+};
+
+#endif // PDE_EXPRESSION_H
@@ -0,0 +1,131 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_FIELD_H
+#define PDE_FIELD_H
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+
+namespace PdeSolver
+{
+    /**
+     * @brief The alignment of field buffers and rows (a cache line, also enough for any SIMD register).
+     */
+    const size_t FieldAlignment = 64;
+
+    /**
+     * @brief A std::allocator replacement which returns FieldAlignment-aligned memory.
+     */
+    template <typename T>
+    struct AlignedAllocator
+    {
+        typedef T value_type;
+
+        AlignedAllocator() {}
+        template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+        T* allocate(size_t n)
+        {
+            size_t bytes = (n * sizeof(T) + FieldAlignment - 1) / FieldAlignment * FieldAlignment;
+            void* ptr = NULL;
+#ifdef _WIN32
+            ptr = _aligned_malloc(bytes, FieldAlignment);
+#else
+            if (posix_memalign(&ptr, FieldAlignment, bytes) != 0) ptr = NULL;
+#endif
+            if (!ptr) throw std::bad_alloc();
+            return static_cast<T*>(ptr);
+        }
+
+        void deallocate(T* ptr, size_t)
+        {
+#ifdef _WIN32
+            _aligned_free(ptr);
+#else
+            free(ptr);
+#endif
+        }
+
+        template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+        template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+    };
+
+    /**
+     * @brief A 2d grid function (a time slice of u or 𝛿u/𝛿t) stored in one contiguous aligned buffer.
+     *
+     * The values are stored row by row: the element (i, j) is at data()[i * stride() + j].
+     * Each row is padded to a multiple of FieldAlignment bytes, so every row starts at an aligned address.
+     * A single column field (a radial profile of a symmetric solution) is not padded, it is a dense column.\n
+     * The coordinates of the nodes are not stored, they are implied by the grid (see PdeSettings::CoordGridSet_t::node(int)):
+     * rows go along X1 (Cartesian coords) or R (polar coords), columns go along X2 or F1 respectively.
+     */
+    template <typename Scalar>
+    class GridField
+    {
+    public:
+        GridField() {}
+        GridField(int rows, int cols) { resize(rows, cols); }
+
+        void resize(int rows, int cols)
+        {
+            const int lane = int(FieldAlignment / sizeof(Scalar));
+            m_Rows = rows;
+            m_Cols = cols;
+            m_Stride = (cols == 1) ? 1 : (cols + lane - 1) / lane * lane;
+            m_Data.assign(size_t(m_Rows) * m_Stride, Scalar(0));
+        }
+
+        int rows() const { return m_Rows; }
+        int cols() const { return m_Cols; }
+        int stride() const { return m_Stride; }     /**< The distance between two rows (in elements) */
+        bool empty() const { return m_Data.empty(); }
+        size_t bytes() const { return m_Data.size() * sizeof(Scalar); }
+
+        Scalar* data() { return m_Data.data(); }
+        const Scalar* data() const { return m_Data.data(); }
+
+        Scalar* row(int i) { return m_Data.data() + size_t(i) * m_Stride; }
+        const Scalar* row(int i) const { return m_Data.data() + size_t(i) * m_Stride; }
+
+        Scalar& operator()(int i, int j) { return m_Data[size_t(i) * m_Stride + j]; }
+        const Scalar& operator()(int i, int j) const { return m_Data[size_t(i) * m_Stride + j]; }
+
+        void fill(Scalar value) { std::fill(m_Data.begin(), m_Data.end(), value); }
+
+    private:
+        int m_Rows = 0;
+        int m_Cols = 0;
+        int m_Stride = 0;
+        std::vector<Scalar, AlignedAllocator<Scalar> > m_Data;
+    };
+
+    typedef GridField<float> Field_t;
+    typedef std::shared_ptr<Field_t> FieldPtr_t;
+}
+
+#endif // PDE_FIELD_H
@@ -0,0 +1,201 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "pde_profiler.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+using namespace PdeSolver;
+
+namespace
+{
+    std::atomic<unsigned> g_NextSession(1);
+
+    /**
+     * @brief The buffer of the calling thread in the session it was registered in.
+     */
+    struct ThreadBufferCache_t
+    {
+        unsigned session = 0;
+        void* buffer = nullptr;
+    };
+
+    thread_local ThreadBufferCache_t t_BufferCache;
+}
+
+const char* Profiler::phase_name(Phase phase)
+{
+    static const char* names[PhaseCount] = { "solve", "initial conditions", "right part", "tridiagonal solve", "slice output", "signal delivery",
+                                                  "checkpoint", "smoothing", "grid transfer", "krylov solve" };
+    return names[phase];
+}
+
+const char* Profiler::counter_name(Counter counter)
+{
+    static const char* names[CounterCount] = { "time steps", "rejected steps", "output slices", "progress signals", "multigrid cycles", "krylov iterations" };
+    return names[counter];
+}
+
+Profiler::Profiler()
+{
+    m_Origin = Clock::now();
+}
+
+Profiler::~Profiler()
+{
+
+}
+
+void Profiler::start(bool enabled)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Buffers.clear();
+        m_Session = g_NextSession++;
+        m_Origin = Clock::now();
+        m_Enabled = enabled;
+    }
+
+    // the calling thread is the first one in the trace
+    if (enabled) thread_buffer();
+}
+
+void Profiler::stop()
+{
+    m_Enabled = false;
+}
+
+Profiler::ThreadBuffer_t& Profiler::thread_buffer()
+{
+    if (t_BufferCache.session != m_Session)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Buffers.emplace_back(new ThreadBuffer_t);
+        m_Buffers.back()->thread_index = int(m_Buffers.size()) - 1;
+        m_Buffers.back()->events.reserve(1024);
+        t_BufferCache.session = m_Session;
+        t_BufferCache.buffer = m_Buffers.back().get();
+    }
+    return *static_cast<ThreadBuffer_t*>(t_BufferCache.buffer);
+}
+
+void Profiler::record(Phase phase, qint64 begin_ns, qint64 end_ns)
+{
+    if (!m_Enabled) return;
+    Event_t event;
+    event.begin_ns = begin_ns;
+    event.end_ns = end_ns;
+    event.phase = phase;
+    thread_buffer().events.push_back(event);
+}
+
+void Profiler::count(Counter counter, qint64 value)
+{
+    if (!m_Enabled) return;
+    thread_buffer().counters[counter] += value;
+}
+
+void Profiler::write_trace(const QString& filename) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) throw("Cannot open the trace file");
+
+    // the events are written by hand, as a solve may have millions of them
+    std::string text = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char line[256];
+    bool first = true;
+    auto append = [&](int length)
+    {
+        if (!first) text += ",\n";
+        text.append(line, length);
+        first = false;
+    };
+
+    qint64 end_ns = 0;
+    qint64 counters[CounterCount] = {};
+    for (const auto& buffer : m_Buffers)
+    {
+        append(std::snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                             buffer->thread_index, (buffer->thread_index == 0) ? "solver" : "worker", buffer->thread_index));
+        for (const auto& event : buffer->events)
+        {
+            append(std::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"cat\":\"pde\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                                 phase_name(Phase(event.phase)), buffer->thread_index, event.begin_ns / 1e3, (event.end_ns - event.begin_ns) / 1e3));
+            end_ns = std::max(end_ns, event.end_ns);
+        }
+        for (int counter = 0; counter < CounterCount; ++counter) counters[counter] += buffer->counters[counter];
+    }
+
+    // the counters are totals, so they are shown at the end of the solve
+    for (int counter = 0; counter < CounterCount; ++counter)
+    {
+        append(std::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                             counter_name(Counter(counter)), end_ns / 1e3, (long long)counters[counter]));
+    }
+    text += "\n]}\n";
+
+    if (file.write(text.data(), qint64(text.size())) != qint64(text.size())) throw("Cannot write the trace file");
+    file.close();
+}
+
+QString Profiler::summary() const
+{
+    qint64 calls[PhaseCount] = {};
+    qint64 total_ns[PhaseCount] = {};
+    qint64 max_ns[PhaseCount] = {};
+    qint64 counters[CounterCount] = {};
+    for (const auto& buffer : m_Buffers)
+    {
+        for (const auto& event : buffer->events)
+        {
+            const qint64 duration = event.end_ns - event.begin_ns;
+            calls[event.phase]++;
+            total_ns[event.phase] += duration;
+            max_ns[event.phase] = std::max(max_ns[event.phase], duration);
+        }
+        for (int counter = 0; counter < CounterCount; ++counter) counters[counter] += buffer->counters[counter];
+    }
+
+    // the phases run by the workers are summed over the threads, so they can take more than 100% of the solve
+    const double solve_ns = std::max<qint64>(total_ns[Solve], 1);
+    std::string text;
+    char line[256];
+    text.append(line, std::snprintf(line, sizeof(line), "%-20s%10s%12s%12s%12s%12s\n", "phase", "calls", "total ms", "mean us", "max us", "% of solve"));
+    for (int phase = 0; phase < PhaseCount; ++phase)
+    {
+        if (calls[phase] == 0) continue;
+        text.append(line, std::snprintf(line, sizeof(line), "%-20s%10lld%12.3f%12.3f%12.3f%12.1f\n", phase_name(Phase(phase)), (long long)calls[phase],
+                                        total_ns[phase] / 1e6, total_ns[phase] / 1e3 / calls[phase], max_ns[phase] / 1e3, 100 * total_ns[phase] / solve_ns));
+    }
+    for (int counter = 0; counter < CounterCount; ++counter)
+    {
+        text.append(line, std::snprintf(line, sizeof(line), "%-20s%10lld\n", counter_name(Counter(counter)), (long long)counters[counter]));
+    }
+    text.append(line, std::snprintf(line, sizeof(line), "threads: %d\n", int(m_Buffers.size())));
+    return QString::fromStdString(text);
+}
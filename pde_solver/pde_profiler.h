@@ -0,0 +1,158 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_PROFILER_H
+#define PDE_PROFILER_H
+
+#include <QString>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace PdeSolver
+{
+    /**
+     * @brief Collects the timings of the phases of a solve and a few counters.
+     *
+     * Every thread records into its own buffer (registered once per session under a mutex, then appended without locks),
+     * so the workers of a parallel_for do not contend. The buffers are read only between the sessions,
+     * when the workers are idle. When disabled, a ScopedTimer costs a single branch.
+     */
+    class Profiler
+    {
+    public:
+        enum Phase
+        {
+            Solve,              /**< The whole get_solution */
+            InitialConditions,  /**< u(x, 0) and 𝛿u/𝛿t(x, 0) */
+            RightPart,          /**< The explicit part and f of a step */
+            TridiagonalSolve,   /**< The implicit part of a step */
+            SliceOutput,        /**< Copying, compressing or writing an output slice */
+            SignalDelivery,     /**< Emitting the progress signals */
+            Checkpoint,         /**< Writing a checkpoint */
+            Smoothing,          /**< The Gauss–Seidel sweeps of a multigrid cycle */
+            GridTransfer,       /**< The residual, its restriction and the interpolation of the correction */
+            KrylovSolve,        /**< The iterative solve of a sparse system */
+            PhaseCount
+        };
+
+        enum Counter
+        {
+            TimeSteps,
+            RejectedSteps,      /**< The adaptive steps retried with a smaller step */
+            OutputSlices,
+            ProgressSignals,
+            MultigridCycles,
+            KrylovIterations,
+            CounterCount
+        };
+
+        static const char* phase_name(Phase phase);
+        static const char* counter_name(Counter counter);
+
+        Profiler();
+        ~Profiler();
+
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        /**
+         * @brief Drops the data of the previous session and starts a new one if enabled.
+         */
+        void start(bool enabled);
+
+        /**
+         * @brief Ends the session (the data is kept for write_trace and summary).
+         */
+        void stop();
+
+        bool enabled() const { return m_Enabled; }
+
+        qint64 now_ns() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_Origin).count(); }
+
+        /**
+         * @brief Adds a phase interval of the calling thread (the times are from now_ns()).
+         */
+        void record(Phase phase, qint64 begin_ns, qint64 end_ns);
+
+        void count(Counter counter, qint64 value = 1);
+
+        /**
+         * @brief Writes the intervals in the Chrome trace event format (opens in chrome://tracing or ui.perfetto.dev).
+         */
+        void write_trace(const QString& filename) const;
+
+        /**
+         * @brief A table of the calls, total and mean times of the phases and the counters.
+         */
+        QString summary() const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Event_t
+        {
+            qint64 begin_ns;
+            qint64 end_ns;
+            int phase;
+        };
+
+        struct ThreadBuffer_t
+        {
+            int thread_index = 0;
+            std::vector<Event_t> events;
+            qint64 counters[CounterCount] = {};
+        };
+
+        ThreadBuffer_t& thread_buffer();
+
+        bool m_Enabled = false;
+        unsigned m_Session = 0;     /**< Unique among all the profilers, so a thread can tell if its cached buffer is still valid */
+        Clock::time_point m_Origin;
+        std::mutex m_Mutex;
+        std::vector<std::unique_ptr<ThreadBuffer_t>> m_Buffers;
+    };
+
+    /**
+     * @brief Records the interval from the construction to the destruction as a phase (if the profiler is enabled).
+     */
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(Profiler& profiler, Profiler::Phase phase)
+            : m_Profiler(profiler.enabled() ? &profiler : nullptr), m_Phase(phase), m_Begin(m_Profiler ? profiler.now_ns() : 0) {}
+        ~ScopedTimer() { if (m_Profiler) m_Profiler->record(m_Phase, m_Begin, m_Profiler->now_ns()); }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Profiler* m_Profiler;
+        Profiler::Phase m_Phase;
+        qint64 m_Begin;
+    };
+}
+
+#endif // PDE_PROFILER_H
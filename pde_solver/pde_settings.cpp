@@ -23,8 +23,10 @@
 
 #include "pde_settings.h"
 #include <QVector2D>
+#include <QStringList>
 #include <algorithm>
 #include <cassert>
+#include <stdexcept>
 
 PdeSettings::PdeSettings()
 {
@@ -38,10 +40,34 @@ PdeSettings::PdeSettings(const PdeSettings& other)
     m_Dim = other.m_Dim;
     c = other.c;
     m = other.m;
+    output_every = other.output_every;
+    output_max_slices = other.output_max_slices;
+    threads = other.threads;
+    output_file = other.output_file;
+    compression = other.compression;
+    compression_tolerance = other.compression_tolerance;
+    adaptive_step = other.adaptive_step;
+    step_tolerance = other.step_tolerance;
+    time_block = other.time_block;
+    precision = other.precision;
+    residual_tolerance = other.residual_tolerance;
+    max_cycles = other.max_cycles;
+    max_iterations = other.max_iterations;
+    linear_solver = other.linear_solver;
+    preconditioner = other.preconditioner;
+    profile = other.profile;
+    trace_file = other.trace_file;
+    checkpoint_file = other.checkpoint_file;
+    checkpoint_every = other.checkpoint_every;
+    resume = other.resume;
+    keep_partial = other.keep_partial;
     m_Coords = other.m_Coords;
     V1_str = other.V1_str;
 	V2_str = other.V2_str;
 	f_str = other.f_str;
+    m_V1 = other.m_V1;
+    m_V2 = other.m_V2;
+    m_f = other.m_f;
 }
 
 PdeSettings::PdeSettings(CoordsType coords_type, int dim)
@@ -88,56 +114,218 @@ const PdeSettings::CoordGridSet_t* PdeSettings::get_coord_by_label(QString label
     return NULL;
 }
 
-float PdeSettings::evaluate_expression(QString expression, QVector2D x, double t) const
+float PdeSettings::evaluate_expression(const PdeExpression& expression, QVector2D x, double t) const
 {
-	if ((expression == "") || (expression == "0")) return 0;
+    if (expression.is_constant()) return float(expression.program()[0].value);
 
-    //TODO: why problems with declaring QScriptEngine instance in class?
-    QScriptEngine m_ScriptEngine1;
+    double vars[PdeExpression::VariablesCount] = { 0 };
+    vars[PdeExpression::T] = t;
 
-	if (!std::isnan(t)) expression.replace("T", QString::number(t));
+    if (m_CoordsType == CoordsType::Polar)
+    {
+        vars[PdeExpression::R] = x[0] / (m * m);
+        vars[PdeExpression::F] = x[1];
+    }
+    else if (m_CoordsType == CoordsType::Cartesian)
+    {
+        vars[PdeExpression::X] = x[0] / m;
+        vars[PdeExpression::Y] = x[1] / m;
+        vars[PdeExpression::R] = qSqrt(x[0] * x[0] + x[1] * x[1]) / (m * m);
+    }
+    else throw("Wrong coords type");
+
+    return float(expression.evaluate(vars));
+}
+
+void PdeSettings::evaluate_expression_block(const PdeExpression& expression, const float* x1, const float* x2, const float* x3, double t,
+                                            float* out, int n) const
+{
+    alignas(64) float x_block[PdeExpression::BlockSize];
+    alignas(64) float y_block[PdeExpression::BlockSize];
+    alignas(64) float z_block[PdeExpression::BlockSize];
+    alignas(64) float R_block[PdeExpression::BlockSize];
+    alignas(64) float T_block[PdeExpression::BlockSize];
+    const float* vars[PdeExpression::VariablesCount] = { NULL };
+
+    int used = expression.used_variables();
+    float inv_m = 1.0f / m, inv_m2 = 1.0f / (m * m);
 
     if (m_CoordsType == CoordsType::Polar)
     {
-        expression.replace("R", QString::number(x[0] / (m * m)));
+        for (int i = 0; i < n; ++i) R_block[i] = x1[i] * inv_m2;
+        vars[PdeExpression::R] = R_block;
+        vars[PdeExpression::F] = x2;
+    }
+    else if (m_CoordsType == CoordsType::Cartesian)
+    {
+        if (used & PdeExpression::MaskX)
+        {
+            for (int i = 0; i < n; ++i) x_block[i] = x1[i] * inv_m;
+            vars[PdeExpression::X] = x_block;
+        }
+        if (used & PdeExpression::MaskY)
+        {
+            for (int i = 0; i < n; ++i) y_block[i] = x2[i] * inv_m;
+            vars[PdeExpression::Y] = y_block;
+        }
+        if ((used & PdeExpression::MaskZ) && x3)
+        {
+            for (int i = 0; i < n; ++i) z_block[i] = x3[i] * inv_m;
+            vars[PdeExpression::Z] = z_block;
+        }
+        if (used & PdeExpression::MaskR)
+        {
+            if (x3) for (int i = 0; i < n; ++i) R_block[i] = std::sqrt(x1[i] * x1[i] + x2[i] * x2[i] + x3[i] * x3[i]) * inv_m2;
+            else for (int i = 0; i < n; ++i) R_block[i] = std::sqrt(x1[i] * x1[i] + x2[i] * x2[i]) * inv_m2;
+            vars[PdeExpression::R] = R_block;
+        }
+    }
+    else throw("Wrong coords type");
+
+    if (used & PdeExpression::MaskT)
+    {
+        std::fill(T_block, T_block + n, float(t));
+        vars[PdeExpression::T] = T_block;
     }
+
+    expression.evaluate(vars, out, n);
+}
+
+void PdeSettings::evaluate_expression(const PdeExpression& expression, const float* x1, const float* x2, double t, float* out, int n) const
+{
+    if (expression.is_constant())
+    {
+        std::fill(out, out + n, float(expression.program()[0].value));
+        return;
+    }
+
+    for (int i = 0; i < n; i += PdeExpression::BlockSize)
+    {
+        evaluate_expression_block(expression, x1 + i, x2 + i, NULL, t, out + i, std::min(PdeExpression::BlockSize, n - i));
+    }
+}
+
+void PdeSettings::evaluate_expression_grid(const PdeExpression& expression, const float* x1, int n1, const float* x2, int n2, double t, float* out, int stride) const
+{
+    alignas(64) float x1_block[PdeExpression::BlockSize];
+
+    for (int i = 0; i < n1; ++i)
+    {
+        std::fill(x1_block, x1_block + std::min(PdeExpression::BlockSize, n2), x1[i]);
+        for (int j = 0; j < n2; j += PdeExpression::BlockSize)
+        {
+            int n = std::min(PdeExpression::BlockSize, n2 - j);
+            if (expression.is_constant()) std::fill(out + i * stride + j, out + i * stride + j + n, float(expression.program()[0].value));
+            else evaluate_expression_block(expression, x1_block, x2 + j, NULL, t, out + i * stride + j, n);
+        }
+    }
+}
+
+void PdeSettings::evaluate_expression_grid(const PdeExpression& expression, const float* x1, int n1, const float* x2, int n2, const float* x3, int n3,
+                                           double t, float* out, int stride) const
+{
+    alignas(64) float x1_block[PdeExpression::BlockSize];
+    alignas(64) float x2_block[PdeExpression::BlockSize];
+    const int block_size = PdeExpression::BlockSize;
+
+    for (int i = 0; i < n1; ++i)
+    {
+        std::fill(x1_block, x1_block + std::min(block_size, n3), x1[i]);
+        for (int j = 0; j < n2; ++j)
+        {
+            std::fill(x2_block, x2_block + std::min(block_size, n3), x2[j]);
+            float* row = out + (size_t(i) * n2 + j) * stride;
+            for (int k = 0; k < n3; k += block_size)
+            {
+                int n = std::min(block_size, n3 - k);
+                if (expression.is_constant()) std::fill(row + k, row + k + n, float(expression.program()[0].value));
+                else evaluate_expression_block(expression, x1_block, x2_block, x3 + k, t, row + k, n);
+            }
+        }
+    }
+}
+
+void PdeSettings::compile_expressions()
+{
+    int space_vars;
+    if (m_CoordsType == CoordsType::Polar) space_vars = PdeExpression::MaskR | PdeExpression::MaskF;
     else if (m_CoordsType == CoordsType::Cartesian)
     {
-        float R = qSqrt(x[0] * x[0] + x[1] * x[1]);
-        expression.replace("x", QString::number(x[0] / m));
-        expression.replace("y", QString::number(x[1] / m));
-        expression.replace("R", QString::number(R / (m * m)));
+        space_vars = PdeExpression::MaskX | PdeExpression::MaskY | PdeExpression::MaskR;
+        if (m_Dim >= 3) space_vars |= PdeExpression::MaskZ;
     }
     else throw("Wrong coords type");
 
-    expression.replace("sqrt", "Math.sqrt");
-    expression.replace("sin", "Math.sin");
-    expression.replace("cos", "Math.cos");
-    expression.replace("tan", "Math.tan");	
-    expression.replace("abs", "Math.abs");
-    expression.replace("pow", "Math.pow");
-    expression.replace("max", "Math.max");
-    expression.replace("min", "Math.min");
-    expression.replace("PI", "Math.PI");
-    expression.replace("E", "Math.E");
-    expression.replace("--", "-");
+    // a reset with the same expressions (e.g. the runs of a sweep, which are copies of one settings) keeps the programs
+    compile_expression(m_V1, V1_str, space_vars);
+    compile_expression(m_V2, V2_str, space_vars);
+    compile_expression(m_f, f_str, space_vars | PdeExpression::MaskT);
+}
 
-    return float(m_ScriptEngine1.evaluate(expression).toNumber());
+void PdeSettings::compile_expression(PdeExpression& expression, const QString& source, int allowed_variables)
+{
+    if ((expression.allowed_variables() == allowed_variables) && (expression.source() == source)) return;
+    expression.compile(source, allowed_variables);
 }
 
 float PdeSettings::V1(QVector2D x) const
 {
-    return evaluate_expression(V1_str, x);
+    return evaluate_expression(m_V1, x);
 }
 
 float PdeSettings::V2(QVector2D x) const
 {
-    return evaluate_expression(V2_str, x);
+    return evaluate_expression(m_V2, x);
 }
 
 float PdeSettings::f(QVector2D x, double t) const
 {
-	return evaluate_expression(f_str, x, t);
+	return evaluate_expression(m_f, x, t);
+}
+
+void PdeSettings::V1(const float* x1, const float* x2, float* out, int n) const
+{
+    evaluate_expression(m_V1, x1, x2, NAN, out, n);
+}
+
+void PdeSettings::V2(const float* x1, const float* x2, float* out, int n) const
+{
+    evaluate_expression(m_V2, x1, x2, NAN, out, n);
+}
+
+void PdeSettings::f(const float* x1, const float* x2, double t, float* out, int n) const
+{
+    evaluate_expression(m_f, x1, x2, t, out, n);
+}
+
+void PdeSettings::V1_grid(const float* x1, int n1, const float* x2, int n2, float* out, int stride) const
+{
+    evaluate_expression_grid(m_V1, x1, n1, x2, n2, NAN, out, stride);
+}
+
+void PdeSettings::V2_grid(const float* x1, int n1, const float* x2, int n2, float* out, int stride) const
+{
+    evaluate_expression_grid(m_V2, x1, n1, x2, n2, NAN, out, stride);
+}
+
+void PdeSettings::f_grid(const float* x1, int n1, const float* x2, int n2, double t, float* out, int stride) const
+{
+    evaluate_expression_grid(m_f, x1, n1, x2, n2, t, out, stride);
+}
+
+void PdeSettings::V1_grid(const float* x1, int n1, const float* x2, int n2, const float* x3, int n3, float* out, int stride) const
+{
+    evaluate_expression_grid(m_V1, x1, n1, x2, n2, x3, n3, NAN, out, stride);
+}
+
+void PdeSettings::V2_grid(const float* x1, int n1, const float* x2, int n2, const float* x3, int n3, float* out, int stride) const
+{
+    evaluate_expression_grid(m_V2, x1, n1, x2, n2, x3, n3, NAN, out, stride);
+}
+
+void PdeSettings::f_grid(const float* x1, int n1, const float* x2, int n2, const float* x3, int n3, double t, float* out, int stride) const
+{
+    evaluate_expression_grid(m_f, x1, n1, x2, n2, x3, n3, t, out, stride);
 }
 
 void PdeSettings::reset(QVariantMap& map)
@@ -151,18 +339,84 @@ void PdeSettings::reset(QVariantMap& map)
     if (map.contains("c")) c = map["c"].value<float>();
     if (map.contains("m")) m = map["m"].value<float>();
 
+    if (map.contains("outputEvery")) output_every = qMax(1, map["outputEvery"].value<int>());
+    if (map.contains("outputMaxSlices")) output_max_slices = qMax(0, map["outputMaxSlices"].value<int>());
+    if (map.contains("threads")) threads = qMax(0, map["threads"].value<int>());
+    if (map.contains("outputFile")) output_file = map["outputFile"].value<QString>();
+    if (map.contains("compression"))
+    {
+        QString value = map["compression"].value<QString>();
+        if ((value != "none") && (value != "lossless") && (value != "fp16") && (value != "tolerance"))
+            throw std::invalid_argument("Wrong compression \"" + value.toStdString() + "\": must be none, lossless, fp16 or tolerance");
+        compression = value;
+    }
+    if (map.contains("compressionTolerance"))
+    {
+        float value = map["compressionTolerance"].value<float>();
+        if (!(value > 0)) throw std::invalid_argument("The compression tolerance must be positive");
+        compression_tolerance = value;
+    }
+    if (map.contains("adaptiveStep")) adaptive_step = map["adaptiveStep"].value<bool>();
+    if (map.contains("stepTolerance"))
+    {
+        float value = map["stepTolerance"].value<float>();
+        if (!(value > 0)) throw std::invalid_argument("The step tolerance must be positive");
+        step_tolerance = value;
+    }
+    if (map.contains("timeBlock")) time_block = qMax(1, map["timeBlock"].value<int>());
+    if (map.contains("precision"))
+    {
+        QString value = map["precision"].value<QString>();
+        if ((value != "single") && (value != "mixed"))
+            throw std::invalid_argument("Wrong precision \"" + value.toStdString() + "\": must be single or mixed");
+        precision = value;
+    }
+    if (map.contains("residualTolerance"))
+    {
+        float value = map["residualTolerance"].value<float>();
+        if (!(value > 0)) throw std::invalid_argument("The residual tolerance must be positive");
+        residual_tolerance = value;
+    }
+    if (map.contains("maxCycles")) max_cycles = qMax(1, map["maxCycles"].value<int>());
+    if (map.contains("maxIterations")) max_iterations = qMax(1, map["maxIterations"].value<int>());
+    if (map.contains("linearSolver"))
+    {
+        QString value = map["linearSolver"].value<QString>();
+        if ((value != "cg") && (value != "bicgstab"))
+            throw std::invalid_argument("Wrong linear solver \"" + value.toStdString() + "\": must be cg or bicgstab");
+        linear_solver = value;
+    }
+    if (map.contains("preconditioner"))
+    {
+        QString value = map["preconditioner"].value<QString>();
+        if ((value != "none") && (value != "jacobi") && (value != "ilu0") && (value != "ssor"))
+            throw std::invalid_argument("Wrong preconditioner \"" + value.toStdString() + "\": must be none, jacobi, ilu0 or ssor");
+        preconditioner = value;
+    }
+    if (map.contains("profile")) profile = map["profile"].value<bool>();
+    if (map.contains("traceFile")) trace_file = map["traceFile"].value<QString>();
+    if (map.contains("checkpointFile")) checkpoint_file = map["checkpointFile"].value<QString>();
+    if (map.contains("checkpointEvery")) checkpoint_every = qMax(0, map["checkpointEvery"].value<int>());
+    if (map.contains("resume")) resume = map["resume"].value<bool>();
+    if (map.contains("keepPartial")) keep_partial = map["keepPartial"].value<bool>();
+
 	if (map.contains("CoordsType"))
 	{
 		if (map["CoordsType"].value<QString>() == "Cartesian") m_CoordsType = CoordsType::Cartesian;
 		else if (map["CoordsType"].value<QString>() == "Polar") m_CoordsType = CoordsType::Polar;
 	}
 
+    // the entries which are not grid settings
+    const QStringList non_coord_keys = { "V1", "V2", "f", "c", "m", "CoordsType", "outputEvery", "outputMaxSlices", "threads", "outputFile", "compression", "compressionTolerance", "adaptiveStep", "stepTolerance", "timeBlock", "precision", "residualTolerance", "maxCycles", "maxIterations",
+                                          "linearSolver", "preconditioner", "profile", "traceFile", "checkpointFile", "checkpointEvery", "resume", "keepPartial" };
+
     QString key, label;
     bool coord_with_current_label_exists = false;
     for(QVariantMap::const_iterator iter = map.begin(); iter != map.end(); ++iter)
     {
         key = iter.key();
         label = "";
+        if (non_coord_keys.contains(key)) continue;
 
         //search for a label (if exsists):
         if (key.contains("count")) label = QString(key).replace("count", "");
@@ -197,8 +451,18 @@ void PdeSettings::reset(QVariantMap& map)
         }
     }
 
+    // the dimension is the number of the space axes: X1, X2, ... or R, F1, ...
+    int space_axes = 0;
+    for (auto& coord : m_Coords)
+    {
+        if (coord.label != "T") ++space_axes;
+    }
+    if (space_axes > 0) m_Dim = space_axes;
+
     //ensure the grid fits the area
     set_boundaries();
+
+    compile_expressions();
 }
 
 void PdeSettings::set_defaults()
@@ -209,15 +473,17 @@ void PdeSettings::set_defaults()
 		V2_str = "pow(E, -R*R)";
 		f_str = "0";
 		m_Coords.push_back(CoordGridSet_t(200, 0.05, 0, 10, "R"));
+		// the angle covers the circle, as the methods which solve on the whole polar grid need
 		for (int i = 1; i < m_Dim; ++i)
 		{
-			m_Coords.push_back(CoordGridSet_t(40, 0.1, 0, 1, "F" + QString::number(i)));
+			m_Coords.push_back(CoordGridSet_t(40, 2 * M_PI / 40, 0, 2 * M_PI, "F" + QString::number(i)));
 		}
 		m_Coords.push_back(CoordGridSet_t(400, 0.02, 0, 8, "T"));
 	}
 	else if (m_CoordsType == CoordsType::Cartesian)
 	{
-		V1_str = "10 * pow(E, -(abs(x)+abs(y))/5)*sin((abs(x)+abs(y)))";
+		if (m_Dim >= 3) V1_str = "10 * pow(E, -(abs(x)+abs(y)+abs(z))/5)*sin((abs(x)+abs(y)+abs(z)))";
+		else V1_str = "10 * pow(E, -(abs(x)+abs(y))/5)*sin((abs(x)+abs(y)))";
 		V2_str = "0";
 		f_str = "0";
 		for (int i = 1; i < m_Dim + 1; ++i)
@@ -227,6 +493,8 @@ void PdeSettings::set_defaults()
 		m_Coords.push_back(CoordGridSet_t(100, 0.001, 0, 1, "T"));
 	}
 	else throw("Wrong coords type");
+
+	compile_expressions();
 }
 
 QVariantMap PdeSettings::toQVariantMap() const
@@ -240,6 +508,28 @@ QVariantMap PdeSettings::toQVariantMap() const
 	map.insert("m", m);
 	map.insert("c", c);
 
+	map.insert("outputEvery", output_every);
+	map.insert("outputMaxSlices", output_max_slices);
+	map.insert("threads", threads);
+	map.insert("outputFile", output_file);
+	map.insert("compression", compression);
+	map.insert("compressionTolerance", compression_tolerance);
+	map.insert("adaptiveStep", adaptive_step);
+	map.insert("stepTolerance", step_tolerance);
+	map.insert("timeBlock", time_block);
+	map.insert("precision", precision);
+	map.insert("residualTolerance", residual_tolerance);
+	map.insert("maxCycles", max_cycles);
+	map.insert("maxIterations", max_iterations);
+	map.insert("linearSolver", linear_solver);
+	map.insert("preconditioner", preconditioner);
+	map.insert("profile", profile);
+	map.insert("traceFile", trace_file);
+	map.insert("checkpointFile", checkpoint_file);
+	map.insert("checkpointEvery", checkpoint_every);
+	map.insert("resume", resume);
+	map.insert("keepPartial", keep_partial);
+
     for (auto& coord : m_Coords)
     {
         map.insert("count" + coord.label, coord.count);
@@ -263,6 +553,28 @@ QVariantMap PdeSettings::getQVariantMapToolTips() const
     map.insert("c", "A constant (e.g. for the heat equation: 𝛿u/𝛿t = c^2 * Δu)");
     map.insert("m", "The scale coefficient for V1 and V2 functions (i.e. V1(x) -> V1(x / m) and the same for V2)");
 
+    map.insert("outputEvery", "Only every n-th time level is kept for display");
+    map.insert("outputMaxSlices", "The maximum number of time slices kept for display (0 means no limit)");
+    map.insert("threads", "The number of solver threads (0 means one per hardware thread)");
+    map.insert("outputFile", "The solution file the time slices are written to (empty means the slices are kept in memory)");
+    map.insert("compression", "How the time slices are kept in memory: none, lossless, fp16 or tolerance (error below compressionTolerance)");
+    map.insert("compressionTolerance", "The maximum absolute error of the tolerance compression");
+    map.insert("adaptiveStep", "If true, the heat equation solver grows the time step (by powers of two of stepT) while the error stays below stepTolerance");
+    map.insert("stepTolerance", "The local error per time step of the adaptive step (relative to max(1, max|u|))");
+    map.insert("timeBlock", "The number of time steps the explicit heat method takes on a band of rows while it stays in cache (1 means one step over the whole grid at a time, the results are the same)");
+    map.insert("precision", "single or mixed: mixed keeps the time levels in fp32, but solves the implicit systems in fp64 (for small time steps and fine grids)");
+    map.insert("residualTolerance", "The iterative solvers (Poisson's equation, the Crank-Nicolson heat step) stop when the residual norm drops below this part of the norm of the right part");
+    map.insert("maxCycles", "The maximum number of multigrid cycles of the Poisson equation solver");
+    map.insert("maxIterations", "The maximum number of Krylov iterations of a Crank-Nicolson heat step");
+    map.insert("linearSolver", "The Krylov method of the Crank-Nicolson heat step: cg or bicgstab");
+    map.insert("preconditioner", "The preconditioner of the Krylov method: none, jacobi, ilu0 or ssor");
+    map.insert("profile", "If true, the solver times its phases and prints a summary when done");
+    map.insert("traceFile", "The Chrome trace file the phase timings are written to (empty means no trace)");
+    map.insert("checkpointFile", "The file the working time levels are saved to, so a cancelled or crashed solve can be resumed (empty means no checkpoints)");
+    map.insert("checkpointEvery", "The number of time steps between checkpoints (0 means only when the solve is cancelled)");
+    map.insert("resume", "If true, the solve continues from checkpointFile if it was written for the same problem");
+    map.insert("keepPartial", "If true, a cancelled solve shows the time slices computed so far, otherwise they are freed");
+
     for (auto& coord : m_Coords)
     {
         map.insert("count" + coord.label, "The number of nodes along the " + coord.label + " axis");
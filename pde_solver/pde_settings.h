@@ -25,16 +25,19 @@
 #define PDE_SETTINGS_H
 
 #include <QtCore/qmath.h>
-#include <QScriptEngine>
 #include <QVector>
+#include <QVector2D>
 #include <QString>
-#include <QToolTip>
+#include <QVariant>
 
 #include <memory>
 #include <functional>
 #include <limits>
+#include <vector>
 #include <sys/types.h>
 
+#include "pde_expression.h"
+
 /**
  * @brief A class for storing settings for solving a pde equation (such as the initial function, the time step, the coefficients etc.).
  */
@@ -68,10 +71,68 @@ public:
 	float V2(QVector2D x) const;  /**< The initial function 𝛿u/𝛿t(x, 0) (if used) */
 	float f(QVector2D x, double t) const;  /**< The right part of the equation. */
 
+    /**
+     * @brief Batch versions of V1, V2 and f: out[i] = V1(QVector2D(x1[i], x2[i])) for i < n.
+     *
+     * The expressions are evaluated by blocks of points with vectorized kernels (in float precision).
+     */
+    void V1(const float* x1, const float* x2, float* out, int n) const;
+    void V2(const float* x1, const float* x2, float* out, int n) const;
+    void f(const float* x1, const float* x2, double t, float* out, int n) const;
+
+    /**
+     * @brief Grid versions of V1, V2 and f: out[i * stride + j] = V1(QVector2D(x1[i], x2[j])) for i < n1, j < n2.
+     */
+    void V1_grid(const float* x1, int n1, const float* x2, int n2, float* out, int stride) const;
+    void V2_grid(const float* x1, int n1, const float* x2, int n2, float* out, int stride) const;
+    void f_grid(const float* x1, int n1, const float* x2, int n2, double t, float* out, int stride) const;
+
+    /**
+     * @brief 3d grid versions of V1, V2 and f: out[(i * n2 + j) * stride + k] = V1 at (x1[i], x2[j], x3[k]) for i < n1, j < n2, k < n3.
+     *
+     * This is the layout of a 3d field: a row per (X1, X2) node, the X3 nodes along the row.
+     */
+    void V1_grid(const float* x1, int n1, const float* x2, int n2, const float* x3, int n3, float* out, int stride) const;
+    void V2_grid(const float* x1, int n1, const float* x2, int n2, const float* x3, int n3, float* out, int stride) const;
+    void f_grid(const float* x1, int n1, const float* x2, int n2, const float* x3, int n3, double t, float* out, int stride) const;
+
+    bool f_is_zero() const { return m_f.is_zero(); }  /**< If true, the equation is homogeneous and f need not be evaluated */
+
     float c = 2.0f;     /**< A constant (e.g. for the heat equation: 𝛿u/𝛿t = c^2 * Δu) */
     float m = 1.0f;     /**< The scale coefficient for V1 and V2 functions (i.e. V1(x) -> V1(x / m) and the same for V2) */
 
-    int m_Dim = 2;      /**< The dimension */
+    int m_Dim = 2;      /**< The dimension (the number of the space axes, reset(QVariantMap& map) takes it from the grid entries) */
+
+    int output_every = 1;       /**< Only every n-th time level goes to the output (the working levels are kept anyway) */
+    int output_max_slices = 0;  /**< The maximum number of output time slices, 0 means no limit (output_every is increased to fit) */
+
+    QString output_file;        /**< If set, the solvers write the output time slices to this solution file instead of keeping them in memory */
+
+    QString compression = "none";       /**< How the output slices are kept in memory: "none", "lossless", "fp16" or "tolerance" (see PdeSolver::SnapshotStore) */
+    float compression_tolerance = 1e-4f; /**< The absolute error of the "tolerance" compression */
+
+    int threads = 0;            /**< The number of threads the solvers split the grid lines across, 0 means one per hardware thread */
+
+    bool adaptive_step = false;     /**< If true, the heat equation solver chooses the time step (a multiple of the T step) by the error control */
+    float step_tolerance = 1e-3f;   /**< The local error per step the adaptive step keeps (relative to max(1, max|u|)) */
+
+    int time_block = 1;         /**< The number of time steps the explicit heat method advances a cache-sized band of rows by at once, 1 means a step over the whole grid at a time */
+
+    QString precision = "single";   /**< The arithmetic of the implicit schemes: "single" (fp32) or "mixed" (fp32 levels, fp64 elimination and accumulation) */
+
+    float residual_tolerance = 1e-6f;   /**< The iterative solvers (the multigrid cycles, the Krylov iterations of a step) stop when the L2 norm of the residual drops below this part of the norm of the right part */
+    int max_cycles = 50;                /**< The maximum number of multigrid cycles of the Poisson equation solver */
+    int max_iterations = 500;           /**< The maximum number of Krylov iterations of a Crank–Nicolson step of the heat equation */
+    QString linear_solver = "cg";       /**< The Krylov method of the Crank–Nicolson heat step: "cg" (conjugate gradients) or "bicgstab" */
+    QString preconditioner = "ilu0";    /**< The preconditioner of the Krylov method: "none", "jacobi", "ilu0" or "ssor" */
+
+    bool profile = false;       /**< If true, the solvers time their phases and put a summary into the solution (see PdeSolver::Profiler) */
+    QString trace_file;         /**< If set, the phase timings are also written to this Chrome trace file (implies profile) */
+
+    QString checkpoint_file;    /**< If set, the working time levels are saved here every checkpoint_every steps and when a solve is cancelled */
+    int checkpoint_every = 0;   /**< The number of time steps between checkpoints, 0 means only when cancelled */
+    bool resume = false;        /**< If true and checkpoint_file holds a checkpoint of the same problem, the solve continues from it */
+    bool keep_partial = true;   /**< If true, a cancelled solve emits the slices computed so far, otherwise they are freed */
 
     struct CoordGridSet_t
     {
@@ -85,6 +146,14 @@ public:
         CoordGridSet_t() {}
         CoordGridSet_t(int count_, float step_, float min_, float max_, QString label_ = "<label>", QString descr_ = "<descr>")
         { count = count_; step = step_; min = min_; max = max_; label = label_; descr = descr_; }
+
+        float node(int i) const { return min + i * step; }  /**< The coordinate of the i-th node */
+        std::vector<float> nodes() const                       /**< The coordinates of all nodes along the axis */
+        {
+            std::vector<float> res(count);
+            for (int i = 0; i < count; ++i) res[i] = node(i);
+            return res;
+        }
     };
     QVector<CoordGridSet_t> m_Coords;
 
@@ -93,7 +162,8 @@ public:
     /**
      * @brief A method for changing the object data from a QVariantMap.
      *
-     * If an entry is missing, no change for the entry will be applied.
+     * If an entry is missing, no change for the entry will be applied.\n
+     * The V1, V2 and f expressions are compiled here, so an invalid expression throws std::invalid_argument.
      */
     void reset(QVariantMap& map);
 
@@ -132,8 +202,19 @@ private:
     QString V2_str = "R";
 	QString f_str = "sin(R) / (R + 1)";
 
+    PdeExpression m_V1;
+    PdeExpression m_V2;
+    PdeExpression m_f;
+
     void set_boundaries();
-	float evaluate_expression(QString expression, QVector2D x, double t = NAN) const;
+    void compile_expressions();
+    static void compile_expression(PdeExpression& expression, const QString& source, int allowed_variables);
+    float evaluate_expression(const PdeExpression& expression, QVector2D x, double t = NAN) const;
+    void evaluate_expression_block(const PdeExpression& expression, const float* x1, const float* x2, const float* x3, double t, float* out, int n) const;
+    void evaluate_expression(const PdeExpression& expression, const float* x1, const float* x2, double t, float* out, int n) const;
+    void evaluate_expression_grid(const PdeExpression& expression, const float* x1, int n1, const float* x2, int n2, double t, float* out, int stride) const;
+    void evaluate_expression_grid(const PdeExpression& expression, const float* x1, int n1, const float* x2, int n2, const float* x3, int n3,
+                                  double t, float* out, int stride) const;
 };
 
 #endif //PDE_SETTINGS_H	
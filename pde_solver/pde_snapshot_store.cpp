@@ -0,0 +1,492 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "pde_snapshot_store.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace PdeSolver;
+
+namespace
+{
+    const char SnapshotStoreMagic[8] = "PDESNAP";
+    const quint32 SnapshotStoreVersion = 1;
+
+    quint32 float_bits(float value)
+    {
+        quint32 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    float bits_float(quint32 bits)
+    {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    /**
+     * IEEE 754 binary32 -> binary16 with rounding to the nearest even.
+     */
+    quint32 float_to_half(float value)
+    {
+        const quint32 x = float_bits(value);
+        const quint32 sign = (x >> 16) & 0x8000;
+        const int exp = int((x >> 23) & 0xff) - 127 + 15;
+        quint32 mant = x & 0x7fffff;
+
+        if ((x & 0x7fffffff) > 0x7f800000) return sign | 0x7e00;   // NaN
+        if (exp >= 31) return sign | 0x7c00;                         // overflow and infinity
+
+        if (exp <= 0)
+        {
+            // a subnormal half (or zero)
+            if (exp < -10) return sign;
+            mant |= 0x800000;
+            const int shift = 14 - exp;
+            quint32 half = mant >> shift;
+            const quint32 rest = mant & ((1u << shift) - 1);
+            const quint32 halfway = 1u << (shift - 1);
+            if ((rest > halfway) || ((rest == halfway) && (half & 1))) ++half;
+            return sign | half;
+        }
+
+        quint32 half = (quint32(exp) << 10) | (mant >> 13);
+        const quint32 rest = mant & 0x1fff;
+        if ((rest > 0x1000) || ((rest == 0x1000) && (half & 1))) ++half;  // a carry rounds up to the next exponent or infinity
+        return sign | half;
+    }
+
+    float half_to_float(quint32 half)
+    {
+        const quint32 sign = (half & 0x8000) << 16;
+        const quint32 exp = (half >> 10) & 0x1f;
+        const quint32 mant = half & 0x3ff;
+
+        if (exp == 0)
+        {
+            float value = mant * (1.0f / 16777216.0f);  // mant * 2^-24
+            return sign ? -value : value;
+        }
+        if (exp == 31) return bits_float(sign | 0x7f800000 | (mant << 13));
+        return bits_float(sign | ((exp - 15 + 127) << 23) | (mant << 13));
+    }
+
+    const int PackBlock = 32;
+
+    /**
+     * The residuals are written in blocks of PackBlock: a byte with the bit width of the widest residual in the block,
+     * then all the residuals of the block with that width. A block of zeros takes a single byte.
+     */
+    void pack_residuals(const std::vector<quint32>& residuals, std::vector<uchar>& out)
+    {
+        const int n = int(residuals.size());
+        for (int first = 0; first < n; first += PackBlock)
+        {
+            const int last = std::min(n, first + PackBlock);
+
+            quint32 all_bits = 0;
+            for (int k = first; k < last; ++k) all_bits |= residuals[k];
+            int width = 0;
+            while ((width < 32) && (all_bits >> width)) ++width;
+            out.push_back(uchar(width));
+            if (width == 0) continue;
+
+            quint64 buffer = 0;
+            int buffered = 0;
+            for (int k = first; k < last; ++k)
+            {
+                buffer |= quint64(residuals[k]) << buffered;
+                buffered += width;
+                while (buffered >= 8)
+                {
+                    out.push_back(uchar(buffer));
+                    buffer >>= 8;
+                    buffered -= 8;
+                }
+            }
+            if (buffered > 0) out.push_back(uchar(buffer));
+        }
+    }
+
+    /**
+     * @brief Returns the number of bytes pack_residuals writes for n residuals in the packed data of the size,
+     * or -1 if the data is not a valid packing (a width over 32 or a block past the end).
+     */
+    qint64 packed_size(const uchar* in, quint64 size, int n)
+    {
+        quint64 pos = 0;
+        for (int first = 0; first < n; first += PackBlock)
+        {
+            const int count = std::min(n - first, PackBlock);
+            if (pos >= size) return -1;
+            const int width = in[pos++];
+            if (width > 32) return -1;
+            pos += (quint64(count) * width + 7) / 8;
+            if (pos > size) return -1;
+        }
+        return qint64(pos);
+    }
+
+    void unpack_residuals(const uchar* in, std::vector<quint32>& residuals)
+    {
+        const int n = int(residuals.size());
+        for (int first = 0; first < n; first += PackBlock)
+        {
+            const int last = std::min(n, first + PackBlock);
+            const int width = *in++;
+            if (width == 0)
+            {
+                std::fill(residuals.begin() + first, residuals.begin() + last, 0u);
+                continue;
+            }
+
+            const quint64 mask = (quint64(1) << width) - 1;
+            quint64 buffer = 0;
+            int buffered = 0;
+            for (int k = first; k < last; ++k)
+            {
+                while (buffered < width)
+                {
+                    buffer |= quint64(*in++) << buffered;
+                    buffered += 8;
+                }
+                residuals[k] = quint32(buffer & mask);
+                buffer >>= width;
+                buffered -= width;
+            }
+        }
+    }
+
+    void write_bytes(QFileDevice& file, const char* data, qint64 bytes)
+    {
+        if (file.write(data, bytes) != bytes) throw("Cannot write the snapshot store file");
+    }
+
+    template <typename T>
+    void write_value(QFileDevice& file, const T& value)
+    {
+        write_bytes(file, reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    T read_value(const QByteArray& data, qint64& pos)
+    {
+        if (pos + qint64(sizeof(T)) > data.size()) throw("The snapshot store file is truncated");
+        T value;
+        std::memcpy(&value, data.constData() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+}
+
+SnapshotStore::Mode SnapshotStore::mode_from_string(const QString& mode)
+{
+    if (mode == "lossless") return Lossless;
+    else if (mode == "fp16") return Fp16;
+    else if (mode == "tolerance") return Tolerance;
+    else throw("Wrong compression. Must be \"none\", \"lossless\", \"fp16\" or \"tolerance\"");
+}
+
+SnapshotStore::SnapshotStore(int rows, int cols, bool has_u_t, Mode mode, float tolerance) :
+    m_Rows(rows), m_Cols(cols), m_HasUt(has_u_t), m_Mode(mode), m_Tolerance(tolerance)
+{
+    if ((mode == Tolerance) && !(tolerance > 0)) throw("The compression tolerance must be positive");
+}
+
+void SnapshotStore::append(double t, const Field_t& u, const Field_t* u_t)
+{
+    if ((u.rows() != m_Rows) || (u.cols() != m_Cols)) throw("The slice does not match the snapshot store grid");
+
+    encode(m_U, u);
+    if (m_HasUt)
+    {
+        if (!u_t) throw("The snapshot store expects 𝛿u/𝛿t slices");
+        encode(m_Ut, *u_t);
+    }
+    m_Times.push_back(t);
+}
+
+double SnapshotStore::time(int slice) const
+{
+    if ((slice < 0) || (slice >= slice_count())) throw("Wrong time slice");
+    return m_Times[slice];
+}
+
+void SnapshotStore::read_u(int slice, Field_t& field) const
+{
+    decode(m_U, slice, field);
+}
+
+void SnapshotStore::read_u_t(int slice, Field_t& field) const
+{
+    if (!m_HasUt) throw("The snapshot store has no 𝛿u/𝛿t slices");
+    decode(m_Ut, slice, field);
+}
+
+size_t SnapshotStore::compressed_bytes() const
+{
+    size_t bytes = 0;
+    for (const auto& slice : m_U.slices) bytes += slice.size();
+    for (const auto& slice : m_Ut.slices) bytes += slice.size();
+    return bytes;
+}
+
+size_t SnapshotStore::raw_bytes() const
+{
+    return size_t(m_Rows) * m_Cols * sizeof(float) * m_Times.size() * (m_HasUt ? 2 : 1);
+}
+
+quint32 SnapshotStore::to_word(float value) const
+{
+    switch (m_Mode)
+    {
+    case Lossless:
+        return float_bits(value);
+    case Fp16:
+        return float_to_half(value);
+    case Tolerance:
+    default:
+    {
+        // the nodes are rounded to the nearest multiple of 2 * tolerance
+        double q = std::nearbyint(double(value) / (2.0 * m_Tolerance));
+        if (!(q == q)) q = 0;
+        q = std::max<double>(std::numeric_limits<qint32>::min(), std::min<double>(std::numeric_limits<qint32>::max(), q));
+        return quint32(qint32(q));
+    }
+    }
+}
+
+float SnapshotStore::from_word(quint32 word) const
+{
+    switch (m_Mode)
+    {
+    case Lossless:
+        return bits_float(word);
+    case Fp16:
+        return half_to_float(word);
+    case Tolerance:
+    default:
+        return float(qint32(word) * (2.0 * m_Tolerance));
+    }
+}
+
+quint32 SnapshotStore::predict(quint32 prev, quint32 prev2, int order) const
+{
+    // the levels are smooth in time, so the next one is extrapolated linearly from the two before it
+    if (order == 0) return 0;
+    if (order == 1) return prev;
+
+    switch (m_Mode)
+    {
+    case Lossless:
+        return float_bits(2 * bits_float(prev) - bits_float(prev2));
+    case Fp16:
+        return float_to_half(2 * half_to_float(prev) - half_to_float(prev2));
+    case Tolerance:
+    default:
+        return 2 * prev - prev2;
+    }
+}
+
+void SnapshotStore::encode(Channel_t& channel, const Field_t& field)
+{
+    const int n = m_Rows * m_Cols;
+    const int order = std::min<int>(channel.slices.size() % KeyframeInterval, 2);
+    if (channel.encoder_state.empty())
+    {
+        channel.encoder_state.assign(n, 0);
+        channel.encoder_state2.assign(n, 0);
+    }
+
+    std::vector<quint32> residuals(n);
+    int k = 0;
+    for (int i = 0; i < m_Rows; ++i)
+    {
+        const float* row = field.row(i);
+        for (int j = 0; j < m_Cols; ++j, ++k)
+        {
+            const quint32 word = to_word(row[j]);
+            const quint32 predicted = predict(channel.encoder_state[k], channel.encoder_state2[k], order);
+            if (m_Mode == Tolerance)
+            {
+                // zigzag, so that small negative differences are small numbers too
+                const qint32 diff = qint32(word - predicted);
+                residuals[k] = (quint32(diff) << 1) ^ quint32(diff >> 31);
+            }
+            else residuals[k] = word ^ predicted;
+            channel.encoder_state2[k] = channel.encoder_state[k];
+            channel.encoder_state[k] = word;
+        }
+    }
+
+    std::vector<uchar> out;
+    out.reserve(n / 2);
+    pack_residuals(residuals, out);
+    out.shrink_to_fit();
+    channel.slices.push_back(std::move(out));
+}
+
+void SnapshotStore::decode(const Channel_t& channel, int slice, Field_t& field) const
+{
+    if ((slice < 0) || (slice >= int(channel.slices.size()))) throw("Wrong time slice");
+
+    const int n = m_Rows * m_Cols;
+    const int keyframe = slice - slice % KeyframeInterval;
+
+    // continue from the cached slice if it is on the way, otherwise start from the keyframe
+    int first = keyframe;
+    if ((channel.decoded_slice >= keyframe) && (channel.decoded_slice <= slice)) first = channel.decoded_slice + 1;
+    else
+    {
+        channel.decoder_state.assign(n, 0);
+        channel.decoder_state2.assign(n, 0);
+    }
+
+    std::vector<quint32>& state = channel.decoder_state;
+    std::vector<quint32>& state2 = channel.decoder_state2;
+    std::vector<quint32> residuals(n);
+    for (int s = first; s <= slice; ++s)
+    {
+        const int order = std::min(s - keyframe, 2);
+        unpack_residuals(channel.slices[s].data(), residuals);
+        for (int k = 0; k < n; ++k)
+        {
+            const quint32 predicted = predict(state[k], state2[k], order);
+            state2[k] = state[k];
+            if (m_Mode == Tolerance) state[k] = predicted + ((residuals[k] >> 1) ^ (0u - (residuals[k] & 1)));
+            else state[k] = predicted ^ residuals[k];
+        }
+    }
+    channel.decoded_slice = slice;
+
+    if ((field.rows() != m_Rows) || (field.cols() != m_Cols)) field.resize(m_Rows, m_Cols);
+    int k = 0;
+    for (int i = 0; i < m_Rows; ++i)
+    {
+        float* row = field.row(i);
+        for (int j = 0; j < m_Cols; ++j, ++k) row[j] = from_word(state[k]);
+    }
+}
+
+void SnapshotStore::save(const QString& filename, const PdeSettings& set) const
+{
+    // written aside and renamed by commit(), so a failed or concurrent save never leaves a partly written file
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) throw("Cannot create the snapshot store file");
+
+    QByteArray settings = QJsonDocument(QJsonObject::fromVariantMap(set.toQVariantMap())).toJson(QJsonDocument::Compact);
+
+    write_bytes(file, SnapshotStoreMagic, sizeof(SnapshotStoreMagic));
+    write_value(file, SnapshotStoreVersion);
+    write_value(file, quint32(m_Mode));
+    write_value(file, m_Tolerance);
+    write_value(file, qint32(m_Rows));
+    write_value(file, qint32(m_Cols));
+    write_value(file, quint32(m_HasUt ? 1 : 0));
+    write_value(file, quint32(KeyframeInterval));
+    write_value(file, quint64(m_Times.size()));
+    write_value(file, quint64(settings.size()));
+    write_bytes(file, settings.constData(), settings.size());
+    write_bytes(file, reinterpret_cast<const char*>(m_Times.data()), m_Times.size() * sizeof(double));
+
+    for (const Channel_t* channel : { &m_U, &m_Ut })
+    {
+        for (const auto& slice : channel->slices)
+        {
+            write_value(file, quint64(slice.size()));
+            write_bytes(file, reinterpret_cast<const char*>(slice.data()), slice.size());
+        }
+    }
+    if (!file.commit()) throw("Cannot write the snapshot store file");
+}
+
+SnapshotStore SnapshotStore::load(const QString& filename, PdeSettings* set)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) throw("Cannot open the snapshot store file");
+    QByteArray data = file.readAll();
+    file.close();
+
+    qint64 pos = sizeof(SnapshotStoreMagic);
+    if ((data.size() < pos) || (std::memcmp(data.constData(), SnapshotStoreMagic, sizeof(SnapshotStoreMagic)) != 0))
+        throw("Not a snapshot store file");
+    if (read_value<quint32>(data, pos) != SnapshotStoreVersion) throw("Unsupported snapshot store version");
+
+    Mode mode = Mode(read_value<quint32>(data, pos));
+    float tolerance = read_value<float>(data, pos);
+    int rows = read_value<qint32>(data, pos);
+    int cols = read_value<qint32>(data, pos);
+    bool has_u_t = read_value<quint32>(data, pos) != 0;
+    if (read_value<quint32>(data, pos) != quint32(KeyframeInterval)) throw("Unsupported snapshot store keyframe interval");
+    quint64 slice_count = read_value<quint64>(data, pos);
+    quint64 settings_size = read_value<quint64>(data, pos);
+    if ((mode != Lossless) && (mode != Fp16) && (mode != Tolerance)) throw("The snapshot store file is corrupted");
+    if ((rows <= 0) || (cols <= 0) || (qint64(rows) * cols > std::numeric_limits<int>::max())) throw("The snapshot store file is corrupted");
+
+    if (settings_size > quint64(data.size() - pos)) throw("The snapshot store file is truncated");
+    if (set)
+    {
+        QVariantMap map = QJsonDocument::fromJson(QByteArray(data.constData() + pos, int(settings_size))).object().toVariantMap();
+        *set = PdeSettings(map);
+    }
+    pos += settings_size;
+
+    SnapshotStore store(rows, cols, has_u_t, mode, tolerance);
+    for (quint64 s = 0; s < slice_count; ++s) store.m_Times.push_back(read_value<double>(data, pos));
+
+    for (Channel_t* channel : { &store.m_U, &store.m_Ut })
+    {
+        if ((channel == &store.m_Ut) && !has_u_t) break;
+        for (quint64 s = 0; s < slice_count; ++s)
+        {
+            quint64 size = read_value<quint64>(data, pos);
+            if (size > quint64(data.size() - pos)) throw("The snapshot store file is truncated");
+            const uchar* begin = reinterpret_cast<const uchar*>(data.constData() + pos);
+            // the decoder trusts the block widths, so they are checked here against the grid
+            if (packed_size(begin, size, rows * cols) != qint64(size)) throw("The snapshot store file is corrupted");
+            channel->slices.push_back(std::vector<uchar>(begin, begin + size));
+            pos += size;
+        }
+
+        // the encoder continues from the last slice, so more slices can be appended
+        if (slice_count > 0)
+        {
+            Field_t last;
+            store.decode(*channel, int(slice_count) - 1, last);
+            channel->encoder_state = channel->decoder_state;
+            channel->encoder_state2 = channel->decoder_state2;
+        }
+    }
+
+    return store;
+}
@@ -0,0 +1,135 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_SNAPSHOT_STORE_H
+#define PDE_SNAPSHOT_STORE_H
+
+#include <QString>
+
+#include <vector>
+
+#include "pde_settings.h"
+#include "pde_field.h"
+
+namespace PdeSolver
+{
+    /**
+     * @brief A compressed store of time slices (u and, optionally, 𝛿u/𝛿t).
+     *
+     * Every slice is predicted from the two previous ones (linear extrapolation), as neighbouring time levels change smoothly,
+     * and only the residual is stored:\n
+     * Lossless - the XOR of the float bits (exact);\n
+     * Fp16 - the XOR of the half precision bits (the relative error is below 2^-11);\n
+     * Tolerance - the difference of the values quantized with the step 2 * tolerance (the absolute error is below tolerance
+     * plus the float rounding).\n
+     * The residuals are bit-packed in blocks of 32 with the width of the widest one, so smooth regions take a few bits per node.
+     *
+     * Every KeyframeInterval-th slice is coded on its own, so a random slice costs at most KeyframeInterval decodes.
+     * The last decoded slice is cached, so playing the slices in order costs one decode per slice.
+     * The decoding is not thread-safe (the cache is shared).
+     */
+    class SnapshotStore
+    {
+    public:
+        enum Mode { Lossless, Fp16, Tolerance };
+
+        static const int KeyframeInterval = 32;
+
+        /**
+         * @brief Parses "lossless", "fp16" or "tolerance" (throws on other values).
+         */
+        static Mode mode_from_string(const QString& mode);
+
+        SnapshotStore(int rows, int cols, bool has_u_t, Mode mode = Lossless, float tolerance = 1e-4f);
+
+        /**
+         * @brief Appends a time slice. u_t is ignored if the store was created without 𝛿u/𝛿t.
+         */
+        void append(double t, const Field_t& u, const Field_t* u_t);
+
+        int rows() const { return m_Rows; }
+        int cols() const { return m_Cols; }
+        bool has_u_t() const { return m_HasUt; }
+        Mode mode() const { return m_Mode; }
+        float tolerance() const { return m_Tolerance; }
+        int slice_count() const { return int(m_Times.size()); }
+        double time(int slice) const;
+
+        /**
+         * @brief Decodes a slice to a field (the field is resized if needed).
+         */
+        void read_u(int slice, Field_t& field) const;
+        void read_u_t(int slice, Field_t& field) const;
+
+        size_t compressed_bytes() const;    /**< The size of the coded slices */
+        size_t raw_bytes() const;           /**< The size the slices would take as float arrays */
+
+        /**
+         * @brief Writes the store and the settings the solution was generated with to a file.
+         *
+         * The file is replaced only when it is completely written (throws otherwise), so concurrent saves of the same file
+         * leave one of them.
+         */
+        void save(const QString& filename, const PdeSettings& set) const;
+
+        /**
+         * @brief Reads a store written by save(), throws if the file is not a snapshot store.
+         * @param set if not NULL, receives the settings stored with the slices
+         */
+        static SnapshotStore load(const QString& filename, PdeSettings* set = NULL);
+
+    private:
+        /**
+         * @brief The coded slices of one function (u or 𝛿u/𝛿t).
+         */
+        struct Channel_t
+        {
+            std::vector<std::vector<uchar> > slices;
+            std::vector<quint32> encoder_state;          /**< The words of the last appended slice */
+            std::vector<quint32> encoder_state2;         /**< The words of the slice before it */
+
+            mutable std::vector<quint32> decoder_state;  /**< The words of the last decoded slice */
+            mutable std::vector<quint32> decoder_state2; /**< The words of the slice before it */
+            mutable int decoded_slice = -1;
+        };
+
+        quint32 predict(quint32 prev, quint32 prev2, int order) const;
+        void encode(Channel_t& channel, const Field_t& field);
+        void decode(const Channel_t& channel, int slice, Field_t& field) const;
+
+        quint32 to_word(float value) const;
+        float from_word(quint32 word) const;
+
+        int m_Rows;
+        int m_Cols;
+        bool m_HasUt;
+        Mode m_Mode;
+        float m_Tolerance;
+
+        std::vector<double> m_Times;
+        Channel_t m_U;
+        Channel_t m_Ut;
+    };
+}
+
+#endif // PDE_SNAPSHOT_STORE_H
@@ -0,0 +1,284 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "pde_solution_cache.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cstring>
+
+#include "pde_solution_file.h"
+
+using namespace PdeSolver;
+
+namespace
+{
+    const char CacheIndexMagic[8] = "PDECACH";
+    const quint32 CacheIndexVersion = 1;
+    const char* const CacheIndexFilename = "index.bin";
+
+    /**
+     * @brief The index file layout (native byte order): CacheIndexHeader_t | entry_count x CacheIndexEntry_t.
+     */
+    struct CacheIndexHeader_t
+    {
+        char magic[8];              /**< "PDECACH" and the terminating zero */
+        quint32 version;
+        quint32 entry_count;
+        quint64 clock;
+    };
+
+    struct CacheIndexEntry_t
+    {
+        char key[64];               /**< The hex digits of the key (not terminated if it takes all 64) */
+        qint64 bytes;
+        quint64 last_used;
+    };
+}
+
+SolutionCache::SolutionCache(const QString& directory, qint64 max_bytes) :
+    m_Directory(directory),
+    m_MaxBytes(max_bytes)
+{
+    if (!QDir().mkpath(m_Directory)) throw("Cannot create the solution cache directory");
+
+    try
+    {
+        read_index();
+    }
+    catch (const char* msg)
+    {
+        qDebug() << "SolutionCache:" << msg << ", starting an empty cache";
+        m_Entries.clear();
+        m_Clock = 0;
+    }
+}
+
+bool SolutionCache::is_cacheable(const PdeSettings& set)
+{
+    return !set.profile && set.trace_file.isEmpty() && set.checkpoint_file.isEmpty();
+}
+
+QString SolutionCache::key(const PdeSettings& set, const SolutionMethod_t& method, const QString& solver)
+{
+    // the results do not depend on the number of threads and the time blocking
+    QVariantMap map = set.toQVariantMap();
+    for (const char* key : { "threads", "timeBlock", "outputFile", "profile", "traceFile", "checkpointFile", "checkpointEvery", "resume", "keepPartial" })
+    {
+        map.remove(key);
+    }
+
+    // the map is sorted by the keys, so the text is the same for the same settings
+    QByteArray text;
+    for (QVariantMap::const_iterator iter = map.begin(); iter != map.end(); ++iter)
+    {
+        text.append((iter.key() + "=" + iter.value().toString() + "\n").toUtf8());
+    }
+    text.append(("method=" + method.name + "\ncoords=" + method.coord_system + "\ndim=" + QString::number(method.dim) +
+                 "\nsolver=" + solver + "\nversion=" + QString::number(SolverVersion) + "\n").toUtf8());
+
+    return QString::fromLatin1(QCryptographicHash::hash(text, QCryptographicHash::Sha256).toHex());
+}
+
+std::shared_ptr<SnapshotStore> SolutionCache::load(const QString& key)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if (!m_Entries.contains(key)) return std::shared_ptr<SnapshotStore>();
+
+    std::shared_ptr<SnapshotStore> store;
+    try
+    {
+        store = std::make_shared<SnapshotStore>(SnapshotStore::load(file_path(key)));
+        m_Entries[key].last_used = ++m_Clock;
+    }
+    catch (const char* msg)
+    {
+        qDebug() << "SolutionCache: dropping the entry" << key << ":" << msg;
+        remove_entry(key);
+    }
+    write_index();
+
+    return store;
+}
+
+void SolutionCache::store(const QString& key, const GraphSolution_t& solution)
+{
+    std::shared_ptr<const SnapshotStore> store = solution.graph_data.store;
+    if (!store)
+    {
+        // the slices kept in memory or written to a solution file are coded losslessly
+        SolutionFileReader reader;
+        if (!solution.solution_file.isEmpty()) reader.open(solution.solution_file);
+        const int slice_count = reader.is_open() ? reader.slice_count() : solution.graph_data.u_list.size();
+        if (slice_count == 0) return;
+
+        const int rows = reader.is_open() ? reader.rows() : solution.graph_data.u_list.first()->rows();
+        const int cols = reader.is_open() ? reader.cols() : solution.graph_data.u_list.first()->cols();
+        const bool has_u_t = reader.is_open() ? reader.has_u_t() : (solution.graph_data.u_t_list.size() == slice_count) &&
+                                                                    bool(solution.graph_data.u_t_list.first());
+
+        std::shared_ptr<SnapshotStore> coded = std::make_shared<SnapshotStore>(rows, cols, has_u_t, SnapshotStore::Lossless);
+        Field_t u, u_t;
+        for (int i = 0; i < slice_count; ++i)
+        {
+            if (reader.is_open())
+            {
+                reader.read_u(i, u);
+                if (has_u_t) reader.read_u_t(i, u_t);
+                coded->append(reader.time(i), u, has_u_t ? &u_t : NULL);
+            }
+            else
+            {
+                coded->append(solution.graph_data.t_list[i], *solution.graph_data.u_list[i],
+                              has_u_t ? solution.graph_data.u_t_list[i].get() : NULL);
+            }
+        }
+        store = coded;
+    }
+    if (store->slice_count() == 0) return;
+
+    // save() writes a unique temporary file and renames it when it is complete, so a crash, a full disk or a run
+    // storing the same key at the same time leave no broken entry; the index is updated only after that
+    const QString filename = file_path(key);
+    store->save(filename, solution.set);
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const qint64 bytes = QFile(filename).size();
+
+    Entry_t entry;
+    entry.bytes = bytes;
+    entry.last_used = ++m_Clock;
+    m_Entries.insert(key, entry);
+    evict();
+    write_index();
+}
+
+qint64 SolutionCache::size_bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    qint64 bytes = 0;
+    for (const Entry_t& entry : m_Entries) bytes += entry.bytes;
+    return bytes;
+}
+
+int SolutionCache::entry_count() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Entries.size();
+}
+
+QString SolutionCache::file_path(const QString& key) const
+{
+    return QDir(m_Directory).filePath(key + ".pdesnap");
+}
+
+void SolutionCache::read_index()
+{
+    QFile file(QDir(m_Directory).filePath(CacheIndexFilename));
+    if (!file.exists()) return;
+    if (!file.open(QIODevice::ReadOnly)) throw("Cannot open the solution cache index");
+    QByteArray data = file.readAll();
+    file.close();
+
+    CacheIndexHeader_t header;
+    if (data.size() < int(sizeof(header))) throw("The solution cache index is truncated");
+    std::memcpy(&header, data.constData(), sizeof(header));
+    if (std::memcmp(header.magic, CacheIndexMagic, sizeof(header.magic)) != 0) throw("Not a solution cache index");
+    if (header.version != CacheIndexVersion) throw("Unsupported solution cache index version");
+    if (data.size() != int(sizeof(header) + header.entry_count * sizeof(CacheIndexEntry_t))) throw("The solution cache index is truncated");
+
+    m_Clock = header.clock;
+    for (quint32 i = 0; i < header.entry_count; ++i)
+    {
+        CacheIndexEntry_t item;
+        std::memcpy(&item, data.constData() + sizeof(header) + i * sizeof(item), sizeof(item));
+
+        QString key = QString::fromLatin1(item.key, int(strnlen(item.key, sizeof(item.key))));
+        // an entry whose file was deleted is forgotten
+        if (!QFile::exists(file_path(key))) continue;
+
+        Entry_t entry;
+        entry.bytes = item.bytes;
+        entry.last_used = item.last_used;
+        m_Entries.insert(key, entry);
+    }
+}
+
+void SolutionCache::write_index() const
+{
+    CacheIndexHeader_t header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CacheIndexMagic, sizeof(header.magic));
+    header.version = CacheIndexVersion;
+    header.entry_count = quint32(m_Entries.size());
+    header.clock = m_Clock;
+
+    QByteArray data(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (QMap<QString, Entry_t>::const_iterator iter = m_Entries.begin(); iter != m_Entries.end(); ++iter)
+    {
+        CacheIndexEntry_t item;
+        std::memset(&item, 0, sizeof(item));
+        QByteArray key = iter.key().toLatin1();
+        std::memcpy(item.key, key.constData(), std::min(size_t(key.size()), sizeof(item.key)));
+        item.bytes = iter.value().bytes;
+        item.last_used = iter.value().last_used;
+        data.append(reinterpret_cast<const char*>(&item), sizeof(item));
+    }
+
+    QSaveFile file(QDir(m_Directory).filePath(CacheIndexFilename));
+    if (!file.open(QIODevice::WriteOnly)) throw("Cannot write the solution cache index");
+    file.write(data);
+    if (!file.commit()) throw("Cannot write the solution cache index");
+}
+
+void SolutionCache::remove_entry(const QString& key)
+{
+    QFile::remove(file_path(key));
+    m_Entries.remove(key);
+}
+
+void SolutionCache::evict()
+{
+    qint64 bytes = 0;
+    for (const Entry_t& entry : m_Entries) bytes += entry.bytes;
+
+    // a single solution over the limit is not kept either
+    while ((bytes > m_MaxBytes) && !m_Entries.isEmpty())
+    {
+        QMap<QString, Entry_t>::const_iterator oldest = m_Entries.begin();
+        for (QMap<QString, Entry_t>::const_iterator iter = m_Entries.begin(); iter != m_Entries.end(); ++iter)
+        {
+            if (iter.value().last_used < oldest.value().last_used) oldest = iter;
+        }
+        const QString key = oldest.key();
+        bytes -= oldest.value().bytes;
+        remove_entry(key);
+    }
+}
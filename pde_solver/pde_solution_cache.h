@@ -0,0 +1,114 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_SOLUTION_CACHE_H
+#define PDE_SOLUTION_CACHE_H
+
+#include <QMap>
+#include <QString>
+
+#include <memory>
+#include <mutex>
+
+#include "pde_settings.h"
+#include "pde_solver_structs.h"
+#include "pde_snapshot_store.h"
+
+namespace PdeSolver
+{
+    /**
+     * @brief A directory of solutions addressed by the hash of the problem they solve.
+     *
+     * A solve of the same settings with the same method and solver is loaded from the cache instead of computed again,
+     * also after a restart. The solutions are kept as snapshot stores, <key>.pdesnap (lossless, unless the settings ask
+     * for a lossy compression). The index file keeps the sizes and the last use of the entries, and when the total size
+     * goes over the limit the least recently used entries are removed.\n
+     * The methods are thread-safe. The index is not shared between processes: the last one to write it wins.
+     */
+    class SolutionCache
+    {
+    public:
+        /**
+         * @brief A part of every key: increment it when a change of a solver changes its results, so the old entries are not used.
+         */
+        static const quint32 SolverVersion = 1;
+
+        static const qint64 DefaultMaxBytes = qint64(1) << 30;
+
+        /**
+         * @brief Opens the cache in the directory (it is created if needed). An index which cannot be read is started anew.
+         */
+        explicit SolutionCache(const QString& directory, qint64 max_bytes = DefaultMaxBytes);
+
+        /**
+         * @brief If a solve with the settings may be loaded from the cache: the profiled, traced and checkpointed solves are run,
+         * as they are asked for their side effects.
+         */
+        static bool is_cacheable(const PdeSettings& set);
+
+        /**
+         * @brief The SHA-256 (in hex) of the settings, the method, the solver (its class name) and SolverVersion.
+         *
+         * The entries which do not change the slices (keepPartial, checkpointEvery, outputFile etc.) are left out.
+         */
+        static QString key(const PdeSettings& set, const SolutionMethod_t& method, const QString& solver);
+
+        /**
+         * @brief Reads the slices stored with the key and marks them as used.
+         * @return NULL if there are none (or the file is lost or broken, then the entry is dropped)
+         */
+        std::shared_ptr<SnapshotStore> load(const QString& key);
+
+        /**
+         * @brief Stores the slices of a complete solution (kept in memory, in a snapshot store or in a solution file)
+         * and removes the least recently used entries if the cache grows over the limit.
+         */
+        void store(const QString& key, const GraphSolution_t& solution);
+
+        const QString& directory() const { return m_Directory; }
+        qint64 max_bytes() const { return m_MaxBytes; }
+        qint64 size_bytes() const;      /**< The total size of the stored solutions */
+        int entry_count() const;
+
+    private:
+        struct Entry_t
+        {
+            qint64 bytes = 0;
+            quint64 last_used = 0;      /**< The value of m_Clock when the entry was stored or loaded last */
+        };
+
+        QString file_path(const QString& key) const;
+        void read_index();
+        void write_index() const;
+        void remove_entry(const QString& key);
+        void evict();
+
+        QString m_Directory;
+        qint64 m_MaxBytes;
+        QMap<QString, Entry_t> m_Entries;
+        quint64 m_Clock = 0;            /**< Counts the uses of the entries (the LRU order survives restarts, unlike a timer) */
+        mutable std::mutex m_Mutex;
+    };
+}
+
+#endif // PDE_SOLUTION_CACHE_H
@@ -0,0 +1,315 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "pde_solution_file.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <limits>
+
+using namespace PdeSolver;
+
+namespace
+{
+    const char SolutionFileMagic[8] = "PDESOLV";
+
+    quint64 align_up(quint64 bytes)
+    {
+        return (bytes + FieldAlignment - 1) / FieldAlignment * FieldAlignment;
+    }
+
+    quint64 field_bytes(int rows, int cols)
+    {
+        return align_up(quint64(rows) * cols * sizeof(float));
+    }
+
+    /**
+     * @brief true if the layout of the header is the one SolutionFileWriter writes (the slices are read right from the mapping).
+     */
+    bool header_is_valid(const SolutionFileHeader_t& header)
+    {
+        if ((header.rows <= 0) || (header.cols <= 0) || (qint64(header.rows) * header.cols > std::numeric_limits<int>::max())) return false;
+
+        const bool has_u_t = header.flags & SolutionFileHeader_t::HasUt;
+        return (header.slice_stride == FieldAlignment + field_bytes(header.rows, header.cols) * (has_u_t ? 2 : 1)) &&
+               (header.settings_offset >= sizeof(SolutionFileHeader_t)) && (header.data_offset % FieldAlignment == 0) &&
+               (header.data_offset >= header.settings_offset) && (header.data_offset - header.settings_offset >= header.settings_size);
+    }
+}
+
+SolutionFileWriter::SolutionFileWriter()
+{
+    std::memset(&m_Header, 0, sizeof(m_Header));
+}
+
+SolutionFileWriter::~SolutionFileWriter()
+{
+    close();
+}
+
+void SolutionFileWriter::open(const QString& filename, const PdeSettings& set, int rows, int cols, bool has_u_t)
+{
+    close();
+
+    m_File.setFileName(filename);
+    if (!m_File.open(QIODevice::ReadWrite | QIODevice::Truncate)) throw("Cannot create the solution file");
+
+    QByteArray settings = QJsonDocument(QJsonObject::fromVariantMap(set.toQVariantMap())).toJson(QJsonDocument::Compact);
+
+    std::memset(&m_Header, 0, sizeof(m_Header));
+    std::memcpy(m_Header.magic, SolutionFileMagic, sizeof(m_Header.magic));
+    m_Header.version = Version;
+    m_Header.flags = has_u_t ? SolutionFileHeader_t::HasUt : 0;
+    m_Header.rows = rows;
+    m_Header.cols = cols;
+    m_Header.slice_count = 0;
+    m_Header.settings_offset = sizeof(SolutionFileHeader_t);
+    m_Header.settings_size = settings.size();
+    m_Header.data_offset = align_up(m_Header.settings_offset + m_Header.settings_size);
+    m_Header.slice_stride = FieldAlignment + field_bytes(rows, cols) * (has_u_t ? 2 : 1);
+
+    write_bytes(reinterpret_cast<const char*>(&m_Header), sizeof(m_Header));
+    write_bytes(settings.constData(), settings.size());
+    write_padding(m_Header.data_offset - m_Header.settings_offset - m_Header.settings_size);
+    if (!m_File.flush()) throw("Cannot write the solution file");
+}
+
+void SolutionFileWriter::reopen(const QString& filename, int rows, int cols, bool has_u_t, quint64 slice_count)
+{
+    close();
+
+    m_File.setFileName(filename);
+    if (!m_File.open(QIODevice::ReadWrite)) throw("Cannot open the solution file");
+
+    SolutionFileHeader_t header;
+    if ((m_File.read(reinterpret_cast<char*>(&header), sizeof(header)) != qint64(sizeof(header))) ||
+        (std::memcmp(header.magic, SolutionFileMagic, sizeof(header.magic)) != 0) || (header.version != Version))
+    {
+        close();
+        throw("Not a solution file");
+    }
+    if ((header.rows != rows) || (header.cols != cols) || (bool(header.flags & SolutionFileHeader_t::HasUt) != has_u_t))
+    {
+        close();
+        throw("The solution file does not match the grid");
+    }
+    if (!header_is_valid(header))
+    {
+        close();
+        throw("The solution file is corrupted");
+    }
+
+    const quint64 size = m_File.size();
+    if ((header.slice_count < slice_count) || (size < header.data_offset) || ((size - header.data_offset) / header.slice_stride < slice_count))
+    {
+        close();
+        throw("The solution file has fewer slices than the checkpoint");
+    }
+
+    const quint64 end = header.data_offset + slice_count * header.slice_stride;
+    m_Header = header;
+    m_Header.slice_count = slice_count;
+    if (!m_File.resize(qint64(end))) throw("Cannot write the solution file");
+    m_File.seek(offsetof(SolutionFileHeader_t, slice_count));
+    write_bytes(reinterpret_cast<const char*>(&m_Header.slice_count), sizeof(m_Header.slice_count));
+    m_File.seek(qint64(end));
+    if (!m_File.flush()) throw("Cannot write the solution file");
+}
+
+void SolutionFileWriter::append(double t, const Field_t& u, const Field_t* u_t)
+{
+    if (!is_open()) throw("The solution file is not open");
+    if ((u.rows() != m_Header.rows) || (u.cols() != m_Header.cols)) throw("The slice does not match the solution file grid");
+
+    write_bytes(reinterpret_cast<const char*>(&t), sizeof(t));
+    write_padding(FieldAlignment - sizeof(t));
+
+    write_field(u);
+    if (m_Header.flags & SolutionFileHeader_t::HasUt)
+    {
+        if (!u_t) throw("The solution file expects 𝛿u/𝛿t slices");
+        write_field(*u_t);
+    }
+
+    // the count goes last and only after the slice is written out, so a reader never sees a slice that is not
+    // written yet, nor one that was lost (e.g. on a full disk)
+    if (!m_File.flush()) throw("Cannot write the solution file");
+    const quint64 slice_count = m_Header.slice_count + 1;
+    qint64 end = m_File.pos();
+    m_File.seek(offsetof(SolutionFileHeader_t, slice_count));
+    write_bytes(reinterpret_cast<const char*>(&slice_count), sizeof(slice_count));
+    m_File.seek(end);
+    if (!m_File.flush()) throw("Cannot write the solution file");
+    m_Header.slice_count = slice_count;
+}
+
+void SolutionFileWriter::close()
+{
+    if (m_File.isOpen()) m_File.close();
+}
+
+void SolutionFileWriter::write_field(const Field_t& field)
+{
+    for (int i = 0; i < field.rows(); ++i)
+        write_bytes(reinterpret_cast<const char*>(field.row(i)), field.cols() * sizeof(float));
+    write_padding(field_bytes(field.rows(), field.cols()) - quint64(field.rows()) * field.cols() * sizeof(float));
+}
+
+void SolutionFileWriter::write_padding(qint64 bytes)
+{
+    static const char zeros[FieldAlignment] = {};
+    if (bytes > 0) write_bytes(zeros, bytes);
+}
+
+void SolutionFileWriter::write_bytes(const char* data, qint64 bytes)
+{
+    if (m_File.write(data, bytes) != bytes) throw("Cannot write the solution file");
+}
+
+SolutionFileReader::SolutionFileReader()
+{
+    std::memset(&m_Header, 0, sizeof(m_Header));
+}
+
+SolutionFileReader::~SolutionFileReader()
+{
+    close();
+}
+
+void SolutionFileReader::open(const QString& filename)
+{
+    close();
+
+    m_File.setFileName(filename);
+    if (!m_File.open(QIODevice::ReadOnly)) throw("Cannot open the solution file");
+
+    refresh();
+
+    const SolutionFileHeader_t& header = *reinterpret_cast<const SolutionFileHeader_t*>(m_Data);
+    if (std::memcmp(header.magic, SolutionFileMagic, sizeof(header.magic)) != 0)
+    {
+        close();
+        throw("Not a solution file");
+    }
+    if (header.version != SolutionFileWriter::Version)
+    {
+        close();
+        throw("Unsupported solution file version");
+    }
+    if (!header_is_valid(header))
+    {
+        close();
+        throw("The solution file is corrupted");
+    }
+    m_Header = header;
+
+    if ((m_Header.settings_offset > quint64(m_Size)) || (m_Header.settings_size > quint64(m_Size) - m_Header.settings_offset))
+    {
+        close();
+        throw("The solution file is truncated");
+    }
+    QByteArray settings(reinterpret_cast<const char*>(m_Data + m_Header.settings_offset), int(m_Header.settings_size));
+    QVariantMap map = QJsonDocument::fromJson(settings).object().toVariantMap();
+    m_Settings = PdeSettings(map);
+
+    refresh();
+}
+
+void SolutionFileReader::refresh()
+{
+    if (!m_File.isOpen()) throw("The solution file is not open");
+
+    if (m_Data) m_File.unmap(m_Data);
+    m_Size = m_File.size();
+    if (m_Size < qint64(sizeof(SolutionFileHeader_t)))
+    {
+        close();
+        throw("The solution file is truncated");
+    }
+    m_Data = m_File.map(0, m_Size);
+    if (!m_Data)
+    {
+        close();
+        throw("Cannot map the solution file");
+    }
+
+    // only the slices that are both counted and fully inside the mapping are visible
+    const SolutionFileHeader_t& header = *reinterpret_cast<const SolutionFileHeader_t*>(m_Data);
+    m_SliceCount = 0;
+    if ((m_Header.slice_stride > 0) && (quint64(m_Size) >= m_Header.data_offset))
+        m_SliceCount = std::min<quint64>(header.slice_count, (quint64(m_Size) - m_Header.data_offset) / m_Header.slice_stride);
+}
+
+void SolutionFileReader::close()
+{
+    if (m_Data) m_File.unmap(m_Data);
+    m_Data = NULL;
+    m_Size = 0;
+    m_SliceCount = 0;
+    if (m_File.isOpen()) m_File.close();
+}
+
+double SolutionFileReader::time(int slice) const
+{
+    double t;
+    std::memcpy(&t, slice_data(slice), sizeof(t));
+    return t;
+}
+
+const float* SolutionFileReader::u(int slice) const
+{
+    return reinterpret_cast<const float*>(slice_data(slice) + FieldAlignment);
+}
+
+const float* SolutionFileReader::u_t(int slice) const
+{
+    if (!has_u_t()) return NULL;
+    return reinterpret_cast<const float*>(slice_data(slice) + FieldAlignment + field_bytes(rows(), cols()));
+}
+
+void SolutionFileReader::read_u(int slice, Field_t& field) const
+{
+    copy_to_field(u(slice), rows(), cols(), field);
+}
+
+void SolutionFileReader::read_u_t(int slice, Field_t& field) const
+{
+    if (!has_u_t()) throw("The solution file has no 𝛿u/𝛿t slices");
+    copy_to_field(u_t(slice), rows(), cols(), field);
+}
+
+const uchar* SolutionFileReader::slice_data(int slice) const
+{
+    if ((slice < 0) || (quint64(slice) >= m_SliceCount)) throw("Wrong time slice");
+    return m_Data + m_Header.data_offset + quint64(slice) * m_Header.slice_stride;
+}
+
+void SolutionFileReader::copy_to_field(const float* src, int rows, int cols, Field_t& field)
+{
+    if ((field.rows() != rows) || (field.cols() != cols)) field.resize(rows, cols);
+    for (int i = 0; i < rows; ++i) std::memcpy(field.row(i), src + std::ptrdiff_t(i) * cols, cols * sizeof(float));
+}
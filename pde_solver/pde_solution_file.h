@@ -0,0 +1,160 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_SOLUTION_FILE_H
+#define PDE_SOLUTION_FILE_H
+
+#include <QFile>
+#include <QString>
+
+#include "pde_settings.h"
+#include "pde_field.h"
+
+namespace PdeSolver
+{
+    /**
+     * @brief The header of a solution file.
+     *
+     * The file layout (native byte order):\n
+     * SolutionFileHeader_t | settings (PdeSettings::toQVariantMap() as UTF-8 JSON) | padding | slice 0 | slice 1 | ...\n
+     * Every slice takes slice_stride bytes: the time (a double) padded to FieldAlignment, then u and, if HasUt is set,
+     * 𝛿u/𝛿t as row-major float arrays of rows x cols, each padded to FieldAlignment. The data and every slice start
+     * at a multiple of FieldAlignment, so the slice of any time level is found in O(1) and can be used right from a mapping.
+     */
+    struct SolutionFileHeader_t
+    {
+        enum Flags { HasUt = 1 };
+
+        char magic[8];              /**< "PDESOLV" and the terminating zero */
+        quint32 version;
+        quint32 flags;
+        qint32 rows;
+        qint32 cols;
+        quint64 slice_count;        /**< Updated after every appended slice, so a file being written can be read */
+        quint64 settings_offset;
+        quint64 settings_size;
+        quint64 data_offset;
+        quint64 slice_stride;
+    };
+
+    /**
+     * @brief Writes a solution file slice by slice while a solver runs.
+     */
+    class SolutionFileWriter
+    {
+    public:
+        static const quint32 Version = 1;
+
+        SolutionFileWriter();
+        ~SolutionFileWriter();
+
+        /**
+         * @brief Creates the file (an existing one is overwritten) and writes the header and the settings.
+         */
+        void open(const QString& filename, const PdeSettings& set, int rows, int cols, bool has_u_t);
+
+        /**
+         * @brief Opens an existing file for appending after its first slice_count slices (the later ones are dropped),
+         * e.g. to continue a solve from a checkpoint. Throws if the file does not match the grid or has fewer slices.
+         */
+        void reopen(const QString& filename, int rows, int cols, bool has_u_t, quint64 slice_count);
+
+        /**
+         * @brief Appends a time slice. u_t is ignored if the file was opened without 𝛿u/𝛿t.
+         * Throws if the slice cannot be written; the slice count in the header is updated only after the slice is written out.
+         */
+        void append(double t, const Field_t& u, const Field_t* u_t);
+
+        void close();
+
+        bool is_open() const { return m_File.isOpen(); }
+        QString filename() const { return m_File.fileName(); }
+        quint64 slice_count() const { return m_Header.slice_count; }
+
+    private:
+        void write_field(const Field_t& field);
+        void write_padding(qint64 bytes);
+        void write_bytes(const char* data, qint64 bytes);       /**< Throws if the data is not written (e.g. the disk is full) */
+
+        QFile m_File;
+        SolutionFileHeader_t m_Header;
+    };
+
+    /**
+     * @brief Maps a solution file into memory and gives random access to its time slices.
+     *
+     * Only the touched pages are read, so a run of any length can be replayed without loading it.
+     */
+    class SolutionFileReader
+    {
+    public:
+        SolutionFileReader();
+        ~SolutionFileReader();
+
+        /**
+         * @brief Maps the file, throws if it is not a valid solution file.
+         */
+        void open(const QString& filename);
+
+        /**
+         * @brief Maps the file again to see the slices appended since it was opened.
+         */
+        void refresh();
+
+        void close();
+
+        bool is_open() const { return m_Data != NULL; }
+        const PdeSettings& settings() const { return m_Settings; }
+        int rows() const { return m_Header.rows; }
+        int cols() const { return m_Header.cols; }
+        bool has_u_t() const { return m_Header.flags & SolutionFileHeader_t::HasUt; }
+        int slice_count() const { return int(m_SliceCount); }
+
+        double time(int slice) const;
+
+        /**
+         * @brief The mapped slices: row-major rows x cols arrays with the row stride of cols (NULL if there is no 𝛿u/𝛿t).
+         */
+        const float* u(int slice) const;
+        const float* u_t(int slice) const;
+
+        /**
+         * @brief Copies a slice to a field (the field is resized if needed).
+         */
+        void read_u(int slice, Field_t& field) const;
+        void read_u_t(int slice, Field_t& field) const;
+
+    private:
+        const uchar* slice_data(int slice) const;
+        static void copy_to_field(const float* src, int rows, int cols, Field_t& field);
+
+        QFile m_File;
+        uchar* m_Data = NULL;
+        qint64 m_Size = 0;
+        quint64 m_SliceCount = 0;
+        SolutionFileHeader_t m_Header;
+        PdeSettings m_Settings;
+    };
+}
+
+#endif // PDE_SOLUTION_FILE_H
@@ -0,0 +1,46 @@
+# The solver core (no widgets: QtGui is linked only for QVector2D). Included by gui_app and cli_app.
+
+# the numeric kernels (e.g. math_module/vector_math.cpp) are written to be vectorized by the compiler
+gcc|clang: QMAKE_CXXFLAGS += -fopenmp-simd -fno-math-errno -fno-trapping-math
+
+# QVector2D (the points of PdeSettings::V1, V2 and f) is in QtGui; nothing in the core opens a window
+QT += core gui
+CONFIG += c++11 thread
+
+HEADERS += \
+	$$PWD/pde_solver_heat_equation.h \
+	$$PWD/pde_solver_wave_equation.h \
+	$$PWD/pde_solver_poisson_equation.h \
+	$$PWD/pde_solver_base.h \
+	$$PWD/pde_settings.h \
+	$$PWD/pde_expression.h \
+	$$PWD/pde_field.h \
+	$$PWD/pde_time_levels.h \
+	$$PWD/pde_thread_pool.h \
+	$$PWD/pde_solution_file.h \
+	$$PWD/pde_snapshot_store.h \
+	$$PWD/pde_profiler.h \
+	$$PWD/pde_checkpoint.h \
+	$$PWD/pde_sweep.h \
+	$$PWD/pde_solution_cache.h \
+	$$PWD/pde_solver_structs.h \
+	$$PWD/../math_module/math_module.h \
+	$$PWD/../math_module/vector_math.h \
+	$$PWD/../math_module/sparse_matrix.h
+SOURCES += \
+	$$PWD/pde_settings.cpp \
+	$$PWD/pde_expression.cpp \
+	$$PWD/pde_solver_heat_equation.cpp \
+	$$PWD/pde_solver_wave_equation.cpp \
+	$$PWD/pde_solver_poisson_equation.cpp \
+	$$PWD/pde_solver_base.cpp \
+	$$PWD/pde_thread_pool.cpp \
+	$$PWD/pde_solution_file.cpp \
+	$$PWD/pde_snapshot_store.cpp \
+	$$PWD/pde_profiler.cpp \
+	$$PWD/pde_checkpoint.cpp \
+	$$PWD/pde_sweep.cpp \
+	$$PWD/pde_solution_cache.cpp \
+	$$PWD/../math_module/math_module.cpp \
+	$$PWD/../math_module/vector_math.cpp \
+	$$PWD/../math_module/sparse_matrix.cpp
@@ -23,7 +23,8 @@
 
 #include "pde_solver_base.h"
 
-using namespace QtDataVisualization;
+#include <exception>
+
 using namespace PdeSolver;
 
 Q_DECLARE_METATYPE(PdeSolver::GraphDataSlice_t);
@@ -33,7 +34,7 @@ Q_DECLARE_METATYPE(PdeSolver::SolutionMethod_t);
 Q_DECLARE_METATYPE(PdeSettings);
 
 
-PdeSolverBase::PdeSolverBase(QObject *parent) : QObject(parent)
+PdeSolverBase::PdeSolverBase(QObject *parent) : QObject(parent), m_CancelRequested(false)
 {
     qRegisterMetaType<GraphDataSlice_t>();
     qRegisterMetaType<GraphData_t>();
@@ -41,7 +42,8 @@ PdeSolverBase::PdeSolverBase(QObject *parent) : QObject(parent)
     qRegisterMetaType<SolutionMethod_t>();
     qRegisterMetaType<PdeSettings>();
 
-    connect(this, SIGNAL(solve_invoked(PdeSettings, PdeSolver::SolutionMethod_t)), this, SLOT(get_solution(PdeSettings, PdeSolver::SolutionMethod_t)));
+    connect(this, SIGNAL(solve_invoked(PdeSettings, PdeSolver::SolutionMethod_t)), this, SLOT(solve_or_load(PdeSettings, PdeSolver::SolutionMethod_t)));
+    connect(this, SIGNAL(solution_generated(PdeSolver::GraphSolution_t)), this, SLOT(hold_solution(PdeSolver::GraphSolution_t)));
 }
 
 
@@ -55,100 +57,351 @@ QVector<SolutionMethod_t> PdeSolverBase::get_implemented_methods()
     throw("Error: calling PdeSolverBase::get_implemented_methods method (it is a base class)");
 }
 
+QString PdeSolverBase::check_stability(const PdeSettings&, SolutionMethod_t)
+{
+    // the implicit schemes are stable with any steps
+    return QString();
+}
+
 void PdeSolverBase::solve(const PdeSettings& set, SolutionMethod_t method)
 {
+    // reset here rather than in get_solution, so a cancel() right after solve() is not lost while the call is queued
+    m_CancelRequested = false;
     emit solve_invoked(set, method);
 }
 
-void PdeSolverBase::clear_graph_data_slice(GraphDataSlice_t& data_slice)
+void PdeSolverBase::cancel()
 {
-    for (auto& row_ptr : *data_slice.u) delete row_ptr;
-    delete data_slice.u;
-
-    for (auto& row_ptr : *data_slice.u_t) delete row_ptr;
-    delete data_slice.u_t;
+    m_CancelRequested = true;
 }
 
 GraphDataSlice_t PdeSolverBase::get_initial_conditions_in_cartesian_coords(const PdeSettings& set)
 {
     const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
     const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+    const PdeSettings::CoordGridSet_t* coordX3 = set.get_coord_by_label("X3");
+
+    if (coordX3) return get_initial_conditions(set, coordX1, coordX2, *coordX3);
+    return get_initial_conditions(set, coordX1, coordX2);
+}
+
+GraphDataSlice_t PdeSolverBase::get_initial_conditions_in_polar_coords(const PdeSettings& set)
+{
+    qDebug() << "PdeSolverBase::get_initial_conditions invoked";
+
+    const PdeSettings::CoordGridSet_t& coordF = *set.get_coord_by_label("F1");
+    const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
+
+    return get_initial_conditions(set, coordR, coordF);
+}
+
+GraphDataSlice_t PdeSolverBase::get_initial_conditions(const PdeSettings& set, const PdeSettings::CoordGridSet_t& coord_row,
+                                                       const PdeSettings::CoordGridSet_t& coord_col)
+{
+    report_progress("Computing initial conditions...", 0);
+    ScopedTimer timer(m_Profiler, Profiler::InitialConditions);
+
+    std::vector<float> row_nodes = coord_row.nodes();
+    std::vector<float> col_nodes = coord_col.nodes();
 
     GraphDataSlice_t graph_data_slice;
-    graph_data_slice.u = new QSurfaceDataArray();
-    graph_data_slice.u_t = new QSurfaceDataArray();  // partial 𝛿u/𝛿t
+    graph_data_slice.u = std::make_shared<Field_t>(coord_row.count, coord_col.count);
+    graph_data_slice.u_t = std::make_shared<Field_t>(coord_row.count, coord_col.count);  // partial 𝛿u/𝛿t
 
-    graph_data_slice.u->reserve(coordX1.count);
-    graph_data_slice.u_t->reserve(coordX1.count);
+    // the whole grid is evaluated at once by the vectorized kernels
+    Field_t& u = *graph_data_slice.u;
+    Field_t& u_t = *graph_data_slice.u_t;
+    set.V1_grid(row_nodes.data(), coord_row.count, col_nodes.data(), coord_col.count, u.data(), u.stride());
+    set.V2_grid(row_nodes.data(), coord_row.count, col_nodes.data(), coord_col.count, u_t.data(), u_t.stride());
 
-    int x1_count = 0;
-    for (float x1_val = coordX1.min; x1_val < coordX1.max; x1_val += coordX1.step)
-    {
-        emit solution_progress_update("Computing initial conditions...", int(float(x1_count * 100) / coordX1.count));
+    qDebug() << "PdeSolverBase::get_initial_conditions returned";
 
-        auto row = new QSurfaceDataRow();
-        auto row_t = new QSurfaceDataRow();
+    return graph_data_slice;
+}
+
+GraphDataSlice_t PdeSolverBase::get_initial_conditions(const PdeSettings& set, const PdeSettings::CoordGridSet_t& coord_row,
+                                                       const PdeSettings::CoordGridSet_t& coord_col, const PdeSettings::CoordGridSet_t& coord_depth)
+{
+    report_progress("Computing initial conditions...", 0);
+    ScopedTimer timer(m_Profiler, Profiler::InitialConditions);
 
-        row->reserve(coordX2.count);
-        row_t->reserve(coordX2.count);
+    std::vector<float> row_nodes = coord_row.nodes();
+    std::vector<float> col_nodes = coord_col.nodes();
+    std::vector<float> depth_nodes = coord_depth.nodes();
 
-        for (float x2_val = coordX2.min; x2_val < coordX2.max; x2_val += coordX2.step)
+    GraphDataSlice_t graph_data_slice;
+    graph_data_slice.u = std::make_shared<Field_t>(coord_row.count * coord_col.count, coord_depth.count);
+    graph_data_slice.u_t = std::make_shared<Field_t>(coord_row.count * coord_col.count, coord_depth.count);  // partial 𝛿u/𝛿t
+
+    Field_t& u = *graph_data_slice.u;
+    Field_t& u_t = *graph_data_slice.u_t;
+    set.V1_grid(row_nodes.data(), coord_row.count, col_nodes.data(), coord_col.count, depth_nodes.data(), coord_depth.count, u.data(), u.stride());
+    set.V2_grid(row_nodes.data(), coord_row.count, col_nodes.data(), coord_col.count, depth_nodes.data(), coord_depth.count, u_t.data(), u_t.stride());
+
+    return graph_data_slice;
+}
+
+void PdeSolverBase::begin_output(const PdeSettings& set, GraphSolution_t& solution, int rows, int cols, bool has_u_t, int slice_count,
+                                 const Checkpoint_t* resume)
+{
+    solution.graph_data.t_list.reserve(slice_count);
+    solution.graph_data.store.reset();
+    solution.solution_file.clear();
+
+    if (!set.output_file.isEmpty())
+    {
+        if (resume)
         {
-            row->push_back(QVector3D(x2_val, set.V1(QVector2D(x1_val, x2_val)), x1_val));
-            row_t->push_back(QVector3D(x2_val, set.V2(QVector2D(x1_val, x2_val)), x1_val));
+            m_SolutionFile.reopen(set.output_file, rows, cols, has_u_t, resume->t_list.size());
+            solution.graph_data.t_list = resume->t_list;
         }
+        else m_SolutionFile.open(set.output_file, set, rows, cols, has_u_t);
+        solution.solution_file = set.output_file;
+    }
+    else if (set.compression != "none")
+    {
+        solution.graph_data.store = std::make_shared<SnapshotStore>(rows, cols, has_u_t, SnapshotStore::mode_from_string(set.compression),
+                                                                    set.compression_tolerance);
+    }
+    else
+    {
+        solution.graph_data.u_list.reserve(slice_count);
+        solution.graph_data.u_t_list.reserve(slice_count);
+    }
+}
+
+void PdeSolverBase::output_slice(GraphSolution_t& solution, double t, const Field_t& u, const Field_t* u_t)
+{
+    ScopedTimer timer(m_Profiler, Profiler::SliceOutput);
+    m_Profiler.count(Profiler::OutputSlices);
+
+    solution.graph_data.t_list.push_back(t);
 
-        graph_data_slice.u->push_back(row);
-        graph_data_slice.u_t->push_back(row_t);
-        ++x1_count;
+    if (m_SolutionFile.is_open())
+    {
+        m_SolutionFile.append(t, u, u_t);
     }
-    qDebug() << "PdeSolverBase::get_initial_conditions returned";
+    else if (solution.graph_data.store)
+    {
+        solution.graph_data.store->append(t, u, u_t);
+    }
+    else
+    {
+        solution.graph_data.u_list.push_back(std::make_shared<Field_t>(u));
+        solution.graph_data.u_t_list.push_back(u_t ? std::make_shared<Field_t>(*u_t) : FieldPtr_t());
+    }
+}
 
-    return graph_data_slice;
+void PdeSolverBase::end_output()
+{
+    m_SolutionFile.close();
 }
 
-GraphDataSlice_t PdeSolverBase::get_initial_conditions_in_polar_coords(const PdeSettings& set)
+void PdeSolverBase::begin_profiling(const PdeSettings& set)
 {
-    qDebug() << "PdeSolverBase::get_initial_conditions invoked";
+    m_Profiler.start(set.profile || !set.trace_file.isEmpty());
+    m_SolveBegin = m_Profiler.now_ns();
 
-    const PdeSettings::CoordGridSet_t& coordF = *set.get_coord_by_label("F1");
-    const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
+    m_ProgressTimer.invalidate();
+    m_LastProgressText.clear();
+    m_LastProgress = -1;
+}
 
-    GraphDataSlice_t graph_data_slice;
-    graph_data_slice.u = new QSurfaceDataArray();
-    graph_data_slice.u_t = new QSurfaceDataArray();  // partial 𝛿u/𝛿t
+void PdeSolverBase::end_profiling(GraphSolution_t& solution)
+{
+    solution.profile_summary.clear();
+    if (!m_Profiler.enabled()) return;
+
+    m_Profiler.record(Profiler::Solve, m_SolveBegin, m_Profiler.now_ns());
+    m_Profiler.stop();
+
+    solution.profile_summary = m_Profiler.summary();
+    qDebug().noquote() << "PdeSolverBase: the phase timings\n" << solution.profile_summary;
+    if (!solution.set.trace_file.isEmpty()) m_Profiler.write_trace(solution.set.trace_file);
+}
+
+bool PdeSolverBase::read_checkpoint(const PdeSettings& set, SolutionMethod_t method, Checkpoint_t& checkpoint, int level_count, int rows, int cols)
+{
+    if (!set.resume || set.checkpoint_file.isEmpty()) return false;
+
+    // a checkpoint which cannot be used is only a lost shortcut: the solve starts over
+    bool loaded = false;
+    try
+    {
+        loaded = load_checkpoint(set.checkpoint_file, set, method, metaObject()->className(), checkpoint);
+    }
+    catch (const char* msg)
+    {
+        qDebug() << "PdeSolverBase:" << msg << ", starting from the initial conditions";
+        return false;
+    }
+    if (!loaded)
+    {
+        qDebug() << "PdeSolverBase: no checkpoint of the problem, starting from the initial conditions";
+        return false;
+    }
+
+    if ((int(checkpoint.levels.size()) != level_count) || (checkpoint.levels.front().rows() != rows) || (checkpoint.levels.front().cols() != cols))
+    {
+        qDebug() << "PdeSolverBase: the checkpoint was written by another solver, starting from the initial conditions";
+        return false;
+    }
+
+    qDebug() << "PdeSolverBase: resuming from the time level" << checkpoint.t_count;
+    return true;
+}
+
+void PdeSolverBase::write_checkpoint(const PdeSettings& set, SolutionMethod_t method, const GraphSolution_t& solution, int t_count,
+                                     const std::vector<const Field_t*>& levels, bool force)
+{
+    if (set.checkpoint_file.isEmpty()) return;
+    if (!force && ((set.checkpoint_every <= 0) || (t_count % set.checkpoint_every != 0))) return;
+
+    ScopedTimer timer(m_Profiler, Profiler::Checkpoint);
+    save_checkpoint(set.checkpoint_file, set, method, metaObject()->className(), t_count, solution.graph_data.t_list, levels);
+}
+
+void PdeSolverBase::cancel_solution(GraphSolution_t& solution, double t)
+{
+    end_output();
+
+    report_progress("Cancelled at T = " + QString::number(t), 100);
+    end_profiling(solution);
+    qDebug() << "PdeSolverBase: the solve is cancelled";
+
+    // a partial solution is not the solution of the problem
+    m_CacheKey.clear();
 
-    graph_data_slice.u->reserve(coordR.count);
-    graph_data_slice.u_t->reserve(coordR.count);
+    if (solution.set.keep_partial)
+    {
+        emit solution_generated(solution);
+    }
+    else
+    {
+        solution.graph_data = GraphData_t();
+        emit solution_cancelled();
+    }
+}
 
-    int R_count = 0, F_count = 0;
-    for (float R_val = coordR.min; R_val < coordR.max; R_val += coordR.step)
+void PdeSolverBase::report_progress(const QString& text, int percent)
+{
+    if ((text == m_LastProgressText) && (percent != 100))
     {
-        emit solution_progress_update("Computing initial conditions...", int(float(R_count * 100) / coordR.count));
+        if (percent == m_LastProgress) return;
+        if (m_ProgressTimer.isValid() && (m_ProgressTimer.elapsed() < ProgressInterval)) return;
+    }
+    m_ProgressTimer.start();
+    m_LastProgressText = text;
+    m_LastProgress = percent;
 
-        auto row = new QSurfaceDataRow();
-        auto row_t = new QSurfaceDataRow();
+    ScopedTimer timer(m_Profiler, Profiler::SignalDelivery);
+    m_Profiler.count(Profiler::ProgressSignals);
+    emit solution_progress_update(text, percent);
+}
 
-        row->reserve(coordR.count);
-        row_t->reserve(coordR.count);
+void PdeSolverBase::get_solution(const PdeSettings& set, SolutionMethod_t method)
+{
+    throw("Error: calling PdeSolverBase::get_solution method (it is a base class)");
+}
 
-        F_count = 0;
-        for (float F_val = coordF.min; F_val < coordF.max; F_val += coordF.step)
+void PdeSolverBase::solve_or_load(const PdeSettings& set, SolutionMethod_t method)
+{
+    m_CacheKey.clear();
+    m_HeldSolution.reset();
+    try
+    {
+        if (m_SolutionCache && SolutionCache::is_cacheable(set))
         {
-            row->push_back(QVector3D(F_val, set.V1(QVector2D(R_val, F_val)), R_val));
-            row_t->push_back(QVector3D(F_val, set.V2(QVector2D(R_val, F_val)), R_val));
-            ++F_count;
+            QString key = SolutionCache::key(set, method, metaObject()->className());
+            if (load_cached_solution(set, key)) return;
+            m_CacheKey = key;
         }
-        graph_data_slice.u->push_back(row);
-        graph_data_slice.u_t->push_back(row_t);
-        ++R_count;
+
+        get_solution(set, method);
+        store_held_solution();
     }
-    qDebug() << "PdeSolverBase::get_initial_conditions returned";
+    catch (const char* msg)
+    {
+        fail_solution(msg);
+    }
+    catch (const std::exception& e)
+    {
+        fail_solution(QString::fromStdString(e.what()));
+    }
+}
 
-    return graph_data_slice;
+void PdeSolverBase::fail_solution(const QString& error)
+{
+    end_output();
+    m_CacheKey.clear();
+    m_HeldSolution.reset();
+
+    qDebug() << "PdeSolverBase: the solve failed:" << error;
+    emit solution_failed(error);
 }
 
-void PdeSolverBase::get_solution(const PdeSettings& set, SolutionMethod_t method)
+bool PdeSolverBase::load_cached_solution(const PdeSettings& set, const QString& key)
 {
-    throw("Error: calling PdeSolverBase::get_solution method (it is a base class)");
+    // the cache only saves time: if it fails, the problem is solved
+    std::shared_ptr<SnapshotStore> cached;
+    try
+    {
+        cached = m_SolutionCache->load(key);
+    }
+    catch (const char* msg)
+    {
+        qDebug() << "PdeSolverBase: cannot read the solution cache:" << msg;
+    }
+    if (!cached) return false;
+
+    begin_profiling(set);
+
+    GraphSolution_t solution;
+    solution.set = set;
+    if (set.output_file.isEmpty() && (set.compression != "none"))
+    {
+        // the cached store is coded the way the settings ask for
+        solution.graph_data.store = cached;
+        for (int i = 0; i < cached->slice_count(); ++i) solution.graph_data.t_list.push_back(cached->time(i));
+    }
+    else
+    {
+        begin_output(set, solution, cached->rows(), cached->cols(), cached->has_u_t(), cached->slice_count());
+        Field_t u, u_t;
+        for (int i = 0; i < cached->slice_count(); ++i)
+        {
+            cached->read_u(i, u);
+            if (cached->has_u_t()) cached->read_u_t(i, u_t);
+            output_slice(solution, cached->time(i), u, cached->has_u_t() ? &u_t : NULL);
+        }
+        end_output();
+    }
+
+    report_progress("Loaded from the solution cache", 100);
+    qDebug() << "PdeSolverBase: the solution is loaded from the cache";
+    emit solution_generated(solution);
+    return true;
+}
+
+void PdeSolverBase::hold_solution(GraphSolution_t solution)
+{
+    // the slices are shared, so holding the solution copies no data
+    if (!m_CacheKey.isEmpty()) m_HeldSolution.reset(new GraphSolution_t(solution));
+}
+
+void PdeSolverBase::store_held_solution()
+{
+    std::unique_ptr<GraphSolution_t> solution(std::move(m_HeldSolution));
+    QString key = m_CacheKey;
+    m_CacheKey.clear();
+    if (!solution || key.isEmpty()) return;
+
+    try
+    {
+        m_SolutionCache->store(key, *solution);
+    }
+    catch (const char* msg)
+    {
+        qDebug() << "PdeSolverBase: cannot store the solution in the cache:" << msg;
+    }
 }
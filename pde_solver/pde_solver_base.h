@@ -24,20 +24,23 @@
 #ifndef PDE_SOLVER_H
 #define PDE_SOLVER_H
 
-#include <QtDataVisualization/Q3DSurface>
-#include <QtDataVisualization/QSurface3DSeries>
-#include <QtDataVisualization/QValue3DAxis>
 #include <QVector>
 #include <QList>
 #include <QThread>
 #include <QObject>
+#include <QElapsedTimer>
 
+#include <atomic>
 #include <memory>
 #include <functional>
 #include <sys/types.h>
 
 #include "pde_settings.h"
 #include "pde_solver_structs.h"
+#include "pde_solution_file.h"
+#include "pde_profiler.h"
+#include "pde_checkpoint.h"
+#include "pde_solution_cache.h"
 
 /**
  * @brief The base class for pde solvers.
@@ -55,13 +58,47 @@ public:
 
     virtual QVector<PdeSolver::SolutionMethod_t> get_implemented_methods();
 
+    /**
+     * @brief Checks the stability limits of the method (the explicit schemes limit the time step).
+     * @return an empty string if the method is stable with the settings, otherwise why it is not
+     */
+    virtual QString check_stability(const PdeSettings& set, PdeSolver::SolutionMethod_t method);
+
 public slots:
     /**
      * @brief The method which just emits the solve_invoked(const PdeSettings&) signal.
      */
     void solve(const PdeSettings& set, PdeSolver::SolutionMethod_t method);
 
+public:
+    /**
+     * @brief Asks the running solve to stop after the current time step (can be called from any thread).
+     *
+     * The solve then writes a checkpoint (if set.checkpoint_file is set) and emits solution_generated with the slices
+     * computed so far if set.keep_partial, otherwise solution_cancelled.
+     */
+    void cancel();
+
+    /**
+     * @brief Sets the cache the solves are looked up in before they run and stored to when they complete (NULL turns it off).
+     * @see PdeSolver::SolutionCache::is_cacheable
+     */
+    void set_solution_cache(const std::shared_ptr<PdeSolver::SolutionCache>& cache) { m_SolutionCache = cache; }
+
 private slots:
+    /**
+     * @brief Emits the cached solution of the problem if there is one, otherwise calls get_solution.
+     *
+     * An error of the solve is emitted as solution_failed: in the GUI the slot runs queued in the solver thread,
+     * where an exception would terminate the application.
+     */
+    void solve_or_load(const PdeSettings& set, PdeSolver::SolutionMethod_t method);
+
+    /**
+     * @brief Keeps a complete solution of the running solve to store in the cache after get_solution returns (connected to solution_generated).
+     */
+    void hold_solution(PdeSolver::GraphSolution_t solution);
+
     /**
      * @brief The method which is called when a solution generation is requested.
      *
@@ -82,11 +119,24 @@ signals:
      * @brief The signal which is emmited when the solve(const PdeSettings& set) method is invoked.
      *
      * The signal is meant to be emmited when a request for a solution is recieved.\n
-     * It is connected in the base constructor to the get_solution(const PdeSettings& set) method.
+     * It is connected in the base constructor to the get_solution(const PdeSettings& set) method (through the solution cache).
      * @see solve(const PdeSettings& set)
      */
     void solve_invoked(const PdeSettings&, PdeSolver::SolutionMethod_t);
 
+    /**
+     * @brief The signal which is emmited instead of solution_generated when a solve is cancelled and its slices are freed.
+     * @see cancel()
+     */
+    void solution_cancelled();
+
+    /**
+     * @brief The signal which is emmited instead of solution_generated when a solve fails (e.g. the Krylov solve of
+     * a time step does not converge or the solution file cannot be created).
+     * @param QString why the solve failed
+     */
+    void solution_failed(QString);
+
     /**
      * @brief Used for sending data progress.
      * @param QString the current process description
@@ -100,12 +150,117 @@ protected:
      */
     PdeSolver::GraphDataSlice_t get_initial_conditions_in_polar_coords(const PdeSettings& set);
 
+    /**
+     * @brief On a 3d grid (with X3) the slices are 3d fields: a row per (X1, X2) node, X1 major, the X3 nodes along the rows.
+     */
     PdeSolver::GraphDataSlice_t get_initial_conditions_in_cartesian_coords(const PdeSettings& set);
 
     /**
-     * @brief The method is used for clearing a slice. If not use it, memory leacks will appear.
+     * @brief Evaluates u(x, 0) and 𝛿u/𝛿t(x, 0) on the grid coord_row x coord_col (the rows go along coord_row).
+     */
+    PdeSolver::GraphDataSlice_t get_initial_conditions(const PdeSettings& set, const PdeSettings::CoordGridSet_t& coord_row,
+                                                       const PdeSettings::CoordGridSet_t& coord_col);
+
+    /**
+     * @brief Evaluates u(x, 0) and 𝛿u/𝛿t(x, 0) on the 3d grid coord_row x coord_col x coord_depth
+     * (a row per (coord_row, coord_col) node, the coord_depth nodes along the rows).
+     */
+    PdeSolver::GraphDataSlice_t get_initial_conditions(const PdeSettings& set, const PdeSettings::CoordGridSet_t& coord_row,
+                                                       const PdeSettings::CoordGridSet_t& coord_col, const PdeSettings::CoordGridSet_t& coord_depth);
+
+    /**
+     * @brief Starts the output of a solution: creates the solution file if set.output_file is set,
+     * otherwise a snapshot store if set.compression is not "none".
+     * @param has_u_t if the solver computes 𝛿u/𝛿t for the output slices
+     * @param slice_count the expected number of output slices (used for reserving memory)
+     * @param resume if set, the solve continues from the checkpoint: the solution file keeps the slices written up to it
+     * (the slices kept in memory are lost with the process, so then the output starts at the checkpoint)
+     */
+    void begin_output(const PdeSettings& set, PdeSolver::GraphSolution_t& solution, int rows, int cols, bool has_u_t, int slice_count,
+                      const PdeSolver::Checkpoint_t* resume = NULL);
+
+    /**
+     * @brief Adds an output time slice: appends it to the solution file or the snapshot store, or keeps a copy in solution.graph_data.
+     */
+    void output_slice(PdeSolver::GraphSolution_t& solution, double t, const PdeSolver::Field_t& u, const PdeSolver::Field_t* u_t);
+
+    void end_output();
+
+    /**
+     * @brief Starts the profiling of a solve (if set.profile is true or set.trace_file is set) and resets the progress rate limit.
+     */
+    void begin_profiling(const PdeSettings& set);
+
+    /**
+     * @brief Ends the profiling of a solve: puts the summary into solution.profile_summary and writes the trace file if set.
+     */
+    void end_profiling(PdeSolver::GraphSolution_t& solution);
+
+    /**
+     * @brief Emits solution_progress_update if the text changes, the process is complete or the percentage changes
+     * and at least ProgressInterval ms passed since the last one (so it can be called on every step).
+     */
+    void report_progress(const QString& text, int percent);
+
+    static const int ProgressInterval = 50;
+
+    /**
+     * @brief Loads the checkpoint to resume from if set.resume is true and set.checkpoint_file was written for the same problem
+     * by the same method of this solver.
+     * @return false if the solve has to start from the initial conditions (also if the file is corrupted or was written by another solver)
+     */
+    bool read_checkpoint(const PdeSettings& set, PdeSolver::SolutionMethod_t method, PdeSolver::Checkpoint_t& checkpoint, int level_count, int rows, int cols);
+
+    /**
+     * @brief Saves the working time levels (the newest first) if set.checkpoint_file is set and a checkpoint is due
+     * (every set.checkpoint_every steps or if force).
+     */
+    void write_checkpoint(const PdeSettings& set, PdeSolver::SolutionMethod_t method, const PdeSolver::GraphSolution_t& solution, int t_count,
+                          const std::vector<const PdeSolver::Field_t*>& levels, bool force = false);
+
+    /**
+     * @brief If true, the solve must stop after the current time step and call cancel_solution.
+     */
+    bool cancel_requested() const { return m_CancelRequested.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Ends a cancelled solve: emits the slices computed so far or frees them (see PdeSettings::keep_partial).
+     * @param t the time of the last computed level
+     */
+    void cancel_solution(PdeSolver::GraphSolution_t& solution, double t);
+
+    PdeSolver::Profiler m_Profiler;     /**< The phase timings of the current solve (disabled unless set.profile) */
+
+private:
+    /**
+     * @brief Emits the solution stored in the cache with the key (in the form the settings ask for: in memory, compressed
+     * or written to set.output_file).
+     * @return false if there is none
+     */
+    bool load_cached_solution(const PdeSettings& set, const QString& key);
+
+    /**
+     * @brief Ends a solve which threw: closes the output and emits solution_failed.
+     */
+    void fail_solution(const QString& error);
+
+    /**
+     * @brief Stores the held solution in the cache. It is called once the solution is emitted, so the receivers do not wait for the write.
      */
-    void clear_graph_data_slice(PdeSolver::GraphDataSlice_t& data_slice);
+    void store_held_solution();
+
+    PdeSolver::SolutionFileWriter m_SolutionFile;
+
+    std::shared_ptr<PdeSolver::SolutionCache> m_SolutionCache;
+    QString m_CacheKey;     /**< The key the running solve is stored with when it completes (empty if it is not cached) */
+    std::unique_ptr<PdeSolver::GraphSolution_t> m_HeldSolution;     /**< The solution emitted by the running solve, stored in the cache by store_held_solution */
+
+    std::atomic<bool> m_CancelRequested;
+
+    qint64 m_SolveBegin = 0;
+    QElapsedTimer m_ProgressTimer;
+    QString m_LastProgressText;
+    int m_LastProgress = -1;
 };
 
 #endif //PDE_SOLVER_H
@@ -23,10 +23,95 @@
 
 #include "pde_solver_heat_equation.h"
 #include "../math_module/math_module.h"
+#include "../math_module/vector_math.h"
+
+#include <algorithm>
+#include <cmath>
 
-using namespace QtDataVisualization;
 using namespace PdeSolver;
 
+static const char* const ImplicitMethodName = "Alternating direction implicit";
+static const char* const ExplicitMethodName = "Forward time centered space";
+static const char* const CrankNicolsonMethodName = "Crank-Nicolson";
+static const char* const DouglasGottliebMethodName = "Douglas-Gottlieb ADI";
+
+/**
+ * @brief A row of the explicit scheme: the 5-point stencil and 𝜏 f (f is NULL if the right part is zero).
+ */
+static inline void explicit_row(const float* u, const float* u_up, const float* u_down, const float* f, float* u_new, int cols,
+                                float center, float along, float across, float tau)
+{
+    MathModule::vector_stencil5(u, u_up, u_down, u_new, cols, center, along, across);
+    if (f)
+    {
+        for (int j = 0; j < cols; ++j) u_new[j] += tau * f[j];
+    }
+}
+
+/**
+ * @brief The explicit part of an ADI half-step on a row without f: center u + r (u_(j-1) + u_(j+1)) with the neighbours along
+ * the row, or center u + r (u_up + u_down) with the adjacent rows if across is true (NULL outside the grid, where u is zero).
+ * It is summed in Compute, so the cancellation of the large terms of fine grids is exact with double.
+ */
+template<typename Compute>
+static void adi_explicit_part(const float* u, const float* u_up, const float* u_down, bool across, float* rhs, int cols,
+                              Compute center, Compute r)
+{
+    if (!across)
+    {
+        rhs[0] = center * u[0] + r * ((cols > 1) ? u[1] : 0.0f);
+        for (int j = 1; j < cols - 1; ++j) rhs[j] = center * u[j] + r * (Compute(u[j - 1]) + u[j + 1]);
+        if (cols > 1) rhs[cols - 1] = center * u[cols - 1] + r * u[cols - 2];
+    }
+    else if (u_up && u_down)
+    {
+        for (int j = 0; j < cols; ++j) rhs[j] = center * u[j] + r * (Compute(u_up[j]) + u_down[j]);
+    }
+    else
+    {
+        for (int j = 0; j < cols; ++j) rhs[j] = center * u[j] + r * (Compute(u_up ? u_up[j] : 0.0f) + (u_down ? u_down[j] : 0.0f));
+    }
+}
+
+/**
+ * @brief A row of the right part of the first Douglas–Gottlieb sweep: center u + r3 (u_(k-1) + u_(k+1)) with the neighbours
+ * along the row (X3), r1 (x1_prev + x1_next) + r2 (x2_prev + x2_next) with the neighbouring rows along X1 and X2 and 2 f.
+ * The rows outside the grid are passed as a row of zeros (the Dirichlet boundary condition), so is f if it is zero.
+ */
+template<typename Compute>
+static void douglas_gottlieb_row(const float* u, const float* x1_prev, const float* x1_next, const float* x2_prev, const float* x2_next,
+                                 const float* f, float* rhs, int cols, Compute center, Compute r1, Compute r2, Compute r3)
+{
+    auto node = [&](int k, Compute along)
+    {
+        rhs[k] = center * u[k] + r1 * (Compute(x1_prev[k]) + x1_next[k]) + r2 * (Compute(x2_prev[k]) + x2_next[k]) + r3 * along + 2 * Compute(f[k]);
+    };
+
+    node(0, (cols > 1) ? Compute(u[1]) : Compute(0));
+    for (int k = 1; k < cols - 1; ++k) node(k, Compute(u[k - 1]) + u[k + 1]);
+    if (cols > 1) node(cols - 1, Compute(u[cols - 2]));
+}
+
+/**
+ * @brief A row of the right part of the second or the third Douglas–Gottlieb sweep: scale u_sweep - r 𝛿^2 u with the second
+ * difference of u^n across the rows (u_prev and u_next, a row of zeros outside the grid) or along the row if across is false.
+ * rhs may be u_sweep.
+ */
+template<typename Compute>
+static void douglas_gottlieb_correction(const float* u_sweep, const float* u, const float* u_prev, const float* u_next, bool across,
+                                        float* rhs, int cols, Compute scale, Compute r)
+{
+    if (across)
+    {
+        for (int k = 0; k < cols; ++k) rhs[k] = scale * u_sweep[k] - r * (Compute(u_prev[k]) + u_next[k] - 2 * Compute(u[k]));
+        return;
+    }
+
+    rhs[0] = scale * u_sweep[0] - r * (((cols > 1) ? Compute(u[1]) : Compute(0)) - 2 * Compute(u[0]));
+    for (int k = 1; k < cols - 1; ++k) rhs[k] = scale * u_sweep[k] - r * (Compute(u[k - 1]) + u[k + 1] - 2 * Compute(u[k]));
+    if (cols > 1) rhs[cols - 1] = scale * u_sweep[cols - 1] - r * (Compute(u[cols - 2]) - 2 * Compute(u[cols - 1]));
+}
+
 PdeSolverHeatEquation::PdeSolverHeatEquation() : PdeSolverBase()
 {
 
@@ -40,143 +125,757 @@ PdeSolverHeatEquation::~PdeSolverHeatEquation()
 QVector<SolutionMethod_t> PdeSolverHeatEquation::get_implemented_methods()
 {
     QVector<SolutionMethod_t> methods;
-    methods.push_back(PdeSolver::SolutionMethod_t("Alternating direction implicit", "Cartesian"));
+    methods.push_back(PdeSolver::SolutionMethod_t(ImplicitMethodName, "Cartesian"));
+    methods.push_back(PdeSolver::SolutionMethod_t(ExplicitMethodName, "Cartesian"));
+    methods.push_back(PdeSolver::SolutionMethod_t(CrankNicolsonMethodName, "Cartesian"));
+    methods.push_back(PdeSolver::SolutionMethod_t(DouglasGottliebMethodName, "Cartesian", 3));
     return methods;
 }
 
+QString PdeSolverHeatEquation::check_stability(const PdeSettings& set, SolutionMethod_t method)
+{
+    if (method.name != ExplicitMethodName) return QString();
+
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+    const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+
+    // the steps are floats, so a step set right at the limit is not rejected for its rounding
+    const double limit = 0.5 / (double(set.c) * set.c * (1 / (double(coordX1.step) * coordX1.step) + 1 / (double(coordX2.step) * coordX2.step)));
+    if (coordT.step <= limit * (1 + 1e-6)) return QString();
+
+    return QString("The T step %1 is above the stability limit %2 of the explicit scheme (𝜏 c^2 (1 / 𝛿X1^2 + 1 / 𝛿X2^2) <= 1 / 2)")
+        .arg(coordT.step).arg(limit);
+}
+
 void PdeSolverHeatEquation::get_solution(const PdeSettings& set, SolutionMethod_t method)
 {
     if (method.coord_system != "Cartesian") throw("This method can be used only in Cartesian coords");
+    if (set.m_Dim != method.dim) throw("The number of the space axes of the grid does not match the method");
+    const bool explicit_scheme = (method.name == ExplicitMethodName);
+    m_UnsplitStep = (method.name == CrankNicolsonMethodName);
+    m_VolumeStep = (method.name == DouglasGottliebMethodName);
+    if (!check_stability(set, method).isEmpty()) throw("The T step is above the stability limit of the explicit scheme");
+
+    begin_profiling(set);
 
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+    const PdeSettings::CoordGridSet_t* coordX3 = set.get_coord_by_label("X3");
     const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+    if (m_VolumeStep && !coordX3) throw("The Douglas-Gottlieb method needs the X3 axis");
+
+    // a 3d field has a row per (X1, X2) node
+    const int rows = m_VolumeStep ? coordX1.count * coordX2.count : coordX1.count;
+    const int cols = m_VolumeStep ? coordX3->count : coordX2.count;
+
+    RetentionPolicy_t retention(set.output_every, set.output_max_slices, coordT.count);
 
     GraphSolution_t solution;
     solution.set = set;
-    solution.graph_data.u_list.reserve(coordT.count);
-    solution.graph_data.u_t_list.reserve(coordT.count);
 
-    GraphDataSlice_t init_slice = get_initial_conditions_in_cartesian_coords(set);
-    solution.graph_data.u_list.push_back(init_slice.u);
-    solution.graph_data.u_t_list.push_back(init_slice.u_t);
+    // the scheme needs only the current level: u^n -> u^(n+1/2) -> u^(n+1)
+    TimeLevelRing<float> levels(1, rows, cols);
+
+    Checkpoint_t checkpoint;
+    const bool resumed = read_checkpoint(set, method, checkpoint, 1, rows, cols);
 
-    GraphDataSlice_t cur_graph_data_slice;
-    GraphDataSlice_t half_new_graph_data_slice;
-    GraphDataSlice_t new_graph_data_slice;
-    int t_count = 1;
-    for (float t_val = coordT.min + coordT.step; t_val < coordT.max; t_val += coordT.step)
+    // the scheme does not compute 𝛿u/𝛿t
+    begin_output(set, solution, rows, cols, false, retention.retained_count(), resumed ? &checkpoint : NULL);
+    if (resumed)
     {
-        cur_graph_data_slice.u = solution.graph_data.u_list.at(t_count - 1);
-        cur_graph_data_slice.u_t = solution.graph_data.u_t_list.at(t_count - 1);
+        levels.level(0) = checkpoint.levels[0];
+    }
+    else
+    {
+        GraphDataSlice_t init_slice = get_initial_conditions_in_cartesian_coords(set);
+        output_slice(solution, coordT.min, *init_slice.u, NULL);
+        levels.level(0) = *init_slice.u;
+    }
+
+    m_ThreadPool.resize(set.threads);
 
-        half_new_graph_data_slice = alternating_direction_method(set, cur_graph_data_slice, 'x', t_count);
-        new_graph_data_slice = alternating_direction_method(set, half_new_graph_data_slice, 'y', t_count + 0.5);
+    // with the adaptive step (of the implicit scheme) a step spans 2^step_level levels of the T grid, but never jumps over an output level
+    int step_level = 0;
+    int t_count = checkpoint.t_count;
+    while (t_count < retention.last)
+    {
+        const double t_val = coordT.min + t_count * coordT.step;
+        int steps = 1;
+        if (explicit_scheme)
+        {
+            // the blocked steps stop at the output levels, as the adaptive step does
+            steps = std::min(set.time_block, retention.next_retained(t_count) - t_count);
+            if (steps > 1) explicit_steps(set, levels.level(0), levels.next(), t_count, steps);
+            else explicit_method(set, levels.level(0), levels.next(), t_val, coordT.step);
+        }
+        else if (set.adaptive_step) steps = adaptive_time_step(set, levels.level(0), levels.next(), t_val, retention.next_retained(t_count) - t_count, step_level);
+        else time_step(set, levels.level(0), levels.next(), t_val, coordT.step);
+        levels.advance();
 
-        solution.graph_data.u_list.push_back(new_graph_data_slice.u);
-        solution.graph_data.u_t_list.push_back(new_graph_data_slice.u_t);
+        const int prev_count = t_count;
+        t_count += steps;
 
-        clear_graph_data_slice(half_new_graph_data_slice);
+        if (retention.retains(t_count))
+        {
+            output_slice(solution, coordT.min + t_count * coordT.step, levels.level(0), NULL);
+        }
+
+        m_Profiler.count(Profiler::TimeSteps, explicit_scheme ? steps : 1);
+
+        // a cancelled solve always leaves a checkpoint to resume from (an adaptive or blocked step may jump over the checkpoint levels)
+        const bool cancelled = cancel_requested();
+        const bool checkpoint_due = (set.checkpoint_every > 0) && (t_count / set.checkpoint_every != prev_count / set.checkpoint_every);
+        write_checkpoint(set, method, solution, t_count, { &levels.level(0) }, cancelled || checkpoint_due);
+        if (cancelled)
+        {
+            cancel_solution(solution, coordT.min + t_count * coordT.step);
+            return;
+        }
 
-        emit solution_progress_update("Computing the equation...", int(float(t_count * 100) / coordT.count));
-        ++t_count;
+        report_progress("Computing the equation...", int(float(t_count * 100) / coordT.count));
     }
 
-    emit solution_progress_update("", 100);
+    end_output();
+
+    report_progress("", 100);
+    end_profiling(solution);
     qDebug() << "PdeSolverHeatEquation: Data generated";
     emit solution_generated(solution);
 }
 
-GraphDataSlice_t PdeSolverHeatEquation::alternating_direction_method(const PdeSettings& set,
-                                                                     const GraphDataSlice_t& prev_graph_data_slice, char stencil, double t_count)
+void PdeSolverHeatEquation::explicit_method(const PdeSettings& set, const Field_t& prev_field, Field_t& new_field, double t_val, double t_step)
+{
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+    const float tau = float(t_step);
+
+    const int rows = coordX1.count;
+    const int cols = coordX2.count;
+
+    // u^(n+1) = (1 - 2 r1 - 2 r2) u + r2 (the neighbours along X2, in the row) + r1 (the neighbours along X1, the rows above and below)
+    const float r1 = tau * set.c * set.c / coordX1.step / coordX1.step;
+    const float r2 = tau * set.c * set.c / coordX2.step / coordX2.step;
+    const float center = 1 - 2 * r1 - 2 * r2;
+
+    Field_t f_field;
+    evaluate_right_part(set, t_val, f_field);
+
+    m_ThreadPool.parallel_for(rows, 1, [&](int begin, int end)
+    {
+        ScopedTimer timer(m_Profiler, Profiler::RightPart);
+        for (int i = begin; i < end; ++i)
+        {
+            // the nodes outside the grid are zero (the Dirichlet boundary condition)
+            explicit_row(prev_field.row(i), (i > 0) ? prev_field.row(i - 1) : NULL, (i < rows - 1) ? prev_field.row(i + 1) : NULL,
+                         f_field.empty() ? NULL : f_field.row(i), new_field.row(i), cols, center, r2, r1, tau);
+        }
+    });
+}
+
+void PdeSolverHeatEquation::explicit_steps(const PdeSettings& set, const Field_t& prev_field, Field_t& new_field, int t_count, int steps)
 {
     const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
     const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
     const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+    const float tau = coordT.step;
+
+    const int rows = coordX1.count;
+    const int cols = coordX2.count;
+
+    // the coefficients and the times of f are computed as in explicit_method and get_solution, so the results are the same
+    const float r1 = tau * set.c * set.c / coordX1.step / coordX1.step;
+    const float r2 = tau * set.c * set.c / coordX2.step / coordX2.step;
+    const float center = 1 - 2 * r1 - 2 * r2;
+
+    const bool has_f = !set.f_is_zero();
+    std::vector<float> x1_nodes = coordX1.nodes();
+    std::vector<float> x2_nodes = coordX2.nodes();
+
+    // the tiles with their halos (two levels and f) fit TimeBlockBytes; the columns are split only if the rows are too long,
+    // in whole cache lines, and the rows are split so that every thread gets a tile at least
+    const int lanes = FieldAlignment / sizeof(float);
+    const int side = std::max(int(std::sqrt(double(TimeBlockBytes / (3 * sizeof(float))))), 4 * steps);
+    int tile_cols = cols;
+    if (cols + 2 * steps > side) tile_cols = std::max(lanes, (side - 2 * steps) / lanes * lanes);
+    const int col_tiles = (cols + tile_cols - 1) / tile_cols;
+    int tile_rows = std::max(int(TimeBlockBytes / (3 * sizeof(float))) / (tile_cols + 2 * steps) - 2 * steps, steps);
+    const int row_tiles_min = (m_ThreadPool.size() + col_tiles - 1) / col_tiles;
+    tile_rows = std::max(1, std::min(tile_rows, (rows + row_tiles_min - 1) / row_tiles_min));
+    const int row_tiles = (rows + tile_rows - 1) / tile_rows;
+
+    m_ThreadPool.parallel_for(row_tiles * col_tiles, 1, [&](int begin, int end)
+    {
+        ScopedTimer timer(m_Profiler, Profiler::RightPart);
+
+        // the levels between the steps and f of a tile with its halo: the element (k, l) stands for the node
+        // (first_row - steps + k, first_col - steps + l) of the grid
+        const int halo_rows = tile_rows + 2 * steps;
+        const int halo_cols = tile_cols + 2 * steps;
+        Field_t levels[2] = { Field_t(halo_rows, halo_cols), Field_t(halo_rows, halo_cols) };
+        Field_t f_tile;
+        if (has_f) f_tile.resize(halo_rows, halo_cols);
+
+        for (int tile = begin; tile < end; ++tile)
+        {
+            const int first_row = (tile / col_tiles) * tile_rows;
+            const int last_row = std::min(rows, first_row + tile_rows);
+            const int first_col = (tile % col_tiles) * tile_cols;
+            const int last_col = std::min(cols, first_col + tile_cols);
+            const int base_row = first_row - steps;
+            const int base_col = first_col - steps;
+
+            for (int s = 1; s <= steps; ++s)
+            {
+                // the rows of the step are exactly the ones the next steps depend on. The columns take one more on both sides:
+                // the stencil of a row takes the nodes outside it as zero, so the end columns inside the grid are wrong,
+                // but no later step of the tile reads them
+                const int lo = std::max(0, first_row - (steps - s));
+                const int hi = std::min(rows, last_row + (steps - s));
+                const int col_lo = std::max(0, first_col - (steps - s) - 1);
+                const int col_hi = std::min(cols, last_col + (steps - s) + 1);
+                const int width = col_hi - col_lo;
+
+                // the first step reads the field, the next ones the level of the previous step; the rows outside the grid are zero
+                auto source_row = [&](int i) -> const float*
+                {
+                    if ((i < 0) || (i >= rows)) return NULL;
+                    return (s == 1) ? prev_field.row(i) + col_lo : levels[(s - 1) % 2].row(i - base_row) + (col_lo - base_col);
+                };
+
+                if (has_f)
+                {
+                    const double t_val = coordT.min + (t_count + s - 1) * coordT.step;
+                    set.f_grid(x1_nodes.data() + lo, hi - lo, x2_nodes.data() + col_lo, width, t_val,
+                               f_tile.row(lo - base_row) + (col_lo - base_col), f_tile.stride());
+                }
+
+                Field_t& level = levels[s % 2];
+                for (int i = lo; i < hi; ++i)
+                {
+                    float* u_new = level.row(i - base_row) + (col_lo - base_col);
+                    explicit_row(source_row(i), source_row(i - 1), source_row(i + 1), has_f ? f_tile.row(i - base_row) + (col_lo - base_col) : NULL,
+                                 u_new, width, center, r2, r1, tau);
+                }
+            }
+
+            // the last step is computed on the tile and one column around it, only the tile itself is valid
+            const Field_t& level = levels[steps % 2];
+            for (int i = first_row; i < last_row; ++i)
+            {
+                std::copy_n(level.row(i - base_row) + (first_col - base_col), last_col - first_col, new_field.row(i) + first_col);
+            }
+        }
+    });
+}
+
+void PdeSolverHeatEquation::evaluate_right_part(const PdeSettings& set, double t_val, Field_t& f_field)
+{
+    if (set.f_is_zero()) return;
+
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+    const PdeSettings::CoordGridSet_t* coordX3 = set.get_coord_by_label("X3");
+
+    std::vector<float> x1_nodes = coordX1.nodes();
+    std::vector<float> x2_nodes = coordX2.nodes();
+    if (coordX3)
+    {
+        std::vector<float> x3_nodes = coordX3->nodes();
+        f_field.resize(coordX1.count * coordX2.count, coordX3->count);
+        m_ThreadPool.parallel_for(coordX1.count, 1, [&](int begin, int end)
+        {
+            ScopedTimer timer(m_Profiler, Profiler::RightPart);
+            set.f_grid(x1_nodes.data() + begin, end - begin, x2_nodes.data(), coordX2.count, x3_nodes.data(), coordX3->count, t_val,
+                       f_field.row(begin * coordX2.count), f_field.stride());
+        });
+        return;
+    }
+
+    f_field.resize(coordX1.count, coordX2.count);
+    m_ThreadPool.parallel_for(coordX1.count, 1, [&](int begin, int end)
+    {
+        ScopedTimer timer(m_Profiler, Profiler::RightPart);
+        set.f_grid(x1_nodes.data() + begin, end - begin, x2_nodes.data(), coordX2.count, t_val, f_field.row(begin), f_field.stride());
+    });
+}
+
+void PdeSolverHeatEquation::time_step(const PdeSettings& set, const Field_t& prev_field, Field_t& new_field, double t_val, double t_step)
+{
+    if (m_UnsplitStep)
+    {
+        crank_nicolson_method(set, prev_field, new_field, t_val, t_step);
+        return;
+    }
+    if (m_VolumeStep)
+    {
+        douglas_gottlieb_method(set, prev_field, new_field, t_val, t_step);
+        return;
+    }
+
+    m_HalfStepField.resize(prev_field.rows(), prev_field.cols());
+
+    // both half-steps take f in the middle of the time step
+    alternating_direction_method(set, prev_field, m_HalfStepField, 'x', t_val + t_step / 2, t_step);
+    alternating_direction_method(set, m_HalfStepField, new_field, 'y', t_val + t_step / 2, t_step);
+}
+
+int PdeSolverHeatEquation::adaptive_time_step(const PdeSettings& set, const Field_t& prev_field, Field_t& new_field, double t_val,
+                                              int max_steps, int& step_level)
+{
+    const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+
+    m_FullStepField.resize(prev_field.rows(), prev_field.cols());
+    m_HalfTimeField.resize(prev_field.rows(), prev_field.cols());
+
+    for (;;)
+    {
+        const int steps = std::min(1 << step_level, max_steps);
+        const double t_step = steps * coordT.step;
+
+        // step doubling: one step of t_step and two of t_step / 2, the difference estimates the error of the two steps
+        time_step(set, prev_field, m_FullStepField, t_val, t_step);
+        time_step(set, prev_field, m_HalfTimeField, t_val, t_step / 2);
+        time_step(set, m_HalfTimeField, new_field, t_val + t_step / 2, t_step / 2);
+
+        const float error = step_error(set, m_FullStepField, new_field);
+        if ((error > 1) && (steps > 1))
+        {
+            // rejected: retry with the largest power of two below the step
+            step_level = 0;
+            while ((2 << step_level) < steps) ++step_level;
+            m_Profiler.count(Profiler::RejectedSteps);
+            continue;
+        }
 
-    int max_index1, max_index2;
-    float step1, step2;
+        // the local error of the scheme is O(𝜏^3), so a doubled step has about 8 times the error
+        if ((error < StepGrowthError) && (steps == (1 << step_level)) && (step_level < MaxStepLevel)) ++step_level;
+        return steps;
+    }
+}
+
+float PdeSolverHeatEquation::step_error(const PdeSettings& set, const Field_t& full_step, const Field_t& half_steps)
+{
+    const int rows = full_step.rows();
+    const int cols = full_step.cols();
+
+    // the maxima of every row, so the threads never write to the same element
+    std::vector<float> row_diff(rows, 0.0f);
+    std::vector<float> row_value(rows, 0.0f);
+    m_ThreadPool.parallel_for(rows, 1, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            const float* a = full_step.row(i);
+            const float* b = half_steps.row(i);
+            float diff = 0.0f, value = 0.0f;
+            for (int j = 0; j < cols; ++j)
+            {
+                diff = std::max(diff, std::abs(a[j] - b[j]));
+                value = std::max(value, std::abs(b[j]));
+            }
+            row_diff[i] = diff;
+            row_value[i] = value;
+        }
+    });
+
+    const float diff = rows ? *std::max_element(row_diff.begin(), row_diff.end()) : 0.0f;
+    const float value = rows ? *std::max_element(row_value.begin(), row_value.end()) : 0.0f;
+    return diff / (set.step_tolerance * std::max(1.0f, value));
+}
+
+void PdeSolverHeatEquation::alternating_direction_method(const PdeSettings& set, const Field_t& prev_field, Field_t& new_field,
+                                                         char stencil, double t_val, double t_step)
+{
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+    const float tau = float(t_step);
+
+    const int rows = coordX1.count;
+    const int cols = coordX2.count;
+
+    // 'x': implicit along X1 (along the columns of the field), explicit along X2
+    // 'y': implicit along X2 (along the rows of the field), explicit along X1
+    float explicit_step;
+    int line_count;
     if (stencil == 'x')
     {
-        max_index1 = coordX2.count;
-        max_index2 = coordX1.count;
-        step1 = coordX1.step;
-        step2 = coordX2.step;
+        explicit_step = coordX2.step;
+        line_count = cols;
     }
     else if (stencil == 'y')
     {
-        max_index1 = coordX1.count;
-        max_index2 = coordX2.count;
-        step1 = coordX2.step;
-        step2 = coordX1.step;
+        explicit_step = coordX1.step;
+        line_count = rows;
     }
     else throw("Wrong stencil");
 
-    GraphDataSlice_t cur_graph_data_slice;
-    cur_graph_data_slice.u = new QSurfaceDataArray();
-    cur_graph_data_slice.u_t = new QSurfaceDataArray();
-    cur_graph_data_slice.u->reserve(max_index1);
+    const float r_expl = set.c * set.c / explicit_step / explicit_step;
+    const float center = 2 / tau - 2 * r_expl;
+    const bool mixed = (set.precision == "mixed");
+    const double r_mixed = double(set.c) * set.c / explicit_step / explicit_step;
+    const double center_mixed = 2 / t_step - 2 * r_mixed;
 
-    std::vector<float> a(max_index1, -set.c * set.c / step1 / step1);
-    std::vector<float> b(max_index1, 2 / coordT.step + 2 * set.c * set.c / step1 / step1);
-    std::vector<float> c(max_index1, -set.c * set.c / step1 / step1);
-    std::vector<float> d;
+    // the chunks handed to the threads are whole cache lines, so the threads never write to the same line
+    const int lanes = FieldAlignment / sizeof(float);
 
-    int prev_ind1 = 0, next_ind1 = 0, prev_ind2 = 0, next_ind2 = 0;
+    // the right part of the equation on the whole grid at once
+    Field_t f_field;
+    evaluate_right_part(set, t_val, f_field);
 
-    float z_val = 0.0f, u1, u2, u3;
-	float index1_val = coordX1.min;
-	float index2_val = coordX2.min;
-    for (int index1 = 0; index1 < max_index1; ++index1)
+    // the explicit part of the i-th row. The nodes outside the grid are zero (the Dirichlet boundary condition).
+    auto explicit_row = [&](int i, float* rhs)
     {
-        QSurfaceDataRow *row = new QSurfaceDataRow();
-        row->reserve(max_index2);
+        const float* u = prev_field.row(i);
+        const bool across = (stencil == 'y');
+        const float* u_up = (across && i > 0) ? prev_field.row(i - 1) : NULL;
+        const float* u_down = (across && i < rows - 1) ? prev_field.row(i + 1) : NULL;
+        if (mixed) adi_explicit_part(u, u_up, u_down, across, rhs, cols, center_mixed, r_mixed);
+        else adi_explicit_part(u, u_up, u_down, across, rhs, cols, center, r_expl);
+        if (!f_field.empty())
+        {
+            const float* f = f_field.row(i);
+            for (int j = 0; j < cols; ++j) rhs[j] += f[j];
+        }
+    };
+
+    const Operators_t& operators = prepare_operators(set, t_step);
+    const MathModule::TridiagonalFactorization<float>& implicit_operator = (stencil == 'x') ? operators.x1 : operators.x2;
+    const MathModule::TridiagonalFactorization<float, double>& mixed_operator = (stencil == 'x') ? operators.x1_mixed : operators.x2_mixed;
 
-        d.clear();
-        for (int index2 = 0; index2 < max_index2; ++index2)
+    if (stencil == 'x')
+    {
+        // the batched solver wants the k-th element of every line in one row, which is the layout of the field here:
+        // the explicit part is written to new_field and the lines are solved in place
+        m_ThreadPool.parallel_for(rows, 1, [&](int begin, int end)
         {
-            if (index1 == 0) prev_ind1 = index1;
-            else prev_ind1 = index1 - 1;
-            if (index2 == 0) prev_ind2 = index2;
-            else prev_ind2 = index2 - 1;
+            ScopedTimer timer(m_Profiler, Profiler::RightPart);
+            for (int i = begin; i < end; ++i) explicit_row(i, new_field.row(i));
+        });
 
-            if (index1 >= max_index1 - 1) next_ind1 = index1;
-            else next_ind1 = index1 + 1;
-            if (index2 >= max_index2 - 1) next_ind2 = index2;
-            else next_ind2 = index2 + 1;
+        m_ThreadPool.parallel_for(line_count, lanes, [&](int begin, int end)
+        {
+            ScopedTimer timer(m_Profiler, Profiler::TridiagonalSolve);
+            if (mixed) mixed_operator.solve_batch(new_field.data() + begin, new_field.data() + begin, end - begin, new_field.stride());
+            else implicit_operator.solve_batch(new_field.data() + begin, new_field.data() + begin, end - begin, new_field.stride());
+        });
+    }
+    else
+    {
+        // the lines are the rows, so they are solved in blocks of `lanes` rows: the explicit part of a block goes
+        // to a small buffer, is transposed to a tile (a column per row), solved and transposed straight back to new_field.
+        // The buffers stay in cache, so the grid is read and written once, as in the 'x' half-step
+        m_ThreadPool.parallel_for(line_count, lanes, [&](int begin, int end)
+        {
+            Field_t block(lanes, cols);
+            Field_t tile(cols, lanes);
 
-            if ((index1 == 0) || (index2 == 0) || (index1 == max_index1 - 1) || (index2 == max_index2 - 1))
+            for (int first = begin; first < end; first += lanes)
             {
-                u1 = 0;
-                u2 = (2 / coordT.step - 2 * set.c * set.c / step2 / step2) * prev_graph_data_slice.u->at(index1)->at(index2).y();
-                u3 = 0;
+                const int count = std::min(lanes, end - first);
+
+                {
+                    ScopedTimer timer(m_Profiler, Profiler::RightPart);
+                    for (int l = 0; l < count; ++l) explicit_row(first + l, block.row(l));
+                }
+
+                ScopedTimer timer(m_Profiler, Profiler::TridiagonalSolve);
+                MathModule::vector_transpose(block.data(), block.stride(), tile.data(), tile.stride(), count, cols);
+
+                if (mixed) mixed_operator.solve_batch(tile.data(), tile.data(), count, tile.stride());
+                else implicit_operator.solve_batch(tile.data(), tile.data(), count, tile.stride());
+
+                MathModule::vector_transpose(tile.data(), tile.stride(), new_field.row(first), new_field.stride(), cols, count);
             }
-            else if (stencil == 'x')
+        });
+    }
+}
+
+void PdeSolverHeatEquation::douglas_gottlieb_method(const PdeSettings& set, const Field_t& prev_field, Field_t& new_field, double t_val, double t_step)
+{
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+    const PdeSettings::CoordGridSet_t& coordX3 = *set.get_coord_by_label("X3");
+
+    const int n1 = coordX1.count;
+    const int n2 = coordX2.count;
+    const int n3 = coordX3.count;
+    const int rows = n1 * n2;
+
+    // r_k = c^2 / h_k^2, the coefficients are taken in fp64 with the "mixed" precision, as in alternating_direction_method
+    const bool mixed = (set.precision == "mixed");
+    const double r1 = double(set.c) * set.c / coordX1.step / coordX1.step;
+    const double r2 = double(set.c) * set.c / coordX2.step / coordX2.step;
+    const double r3 = double(set.c) * set.c / coordX3.step / coordX3.step;
+    const double scale = 2 / t_step;
+    const double center = scale - 2 * r1 - 4 * r2 - 4 * r3;
+    const float r1_single = set.c * set.c / coordX1.step / coordX1.step;
+    const float r2_single = set.c * set.c / coordX2.step / coordX2.step;
+    const float r3_single = set.c * set.c / coordX3.step / coordX3.step;
+    const float scale_single = 2 / float(t_step);
+    const float center_single = scale_single - 2 * r1_single - 4 * r2_single - 4 * r3_single;
+
+    const int lanes = FieldAlignment / sizeof(float);
+
+    // the neighbours outside the grid and a zero f
+    const std::vector<float> zeros(n3, 0.0f);
+    Field_t f_field;
+    evaluate_right_part(set, t_val + t_step / 2, f_field);
+
+    const Operators_t& operators = prepare_operators(set, t_step);
+
+    Field_t& sweep = m_HalfStepField;
+    sweep.resize(rows, n3);
+
+    // the first sweep: the explicit operator on the whole grid, then the X1 lines. The X1 lines through the row j of the
+    // first plane are the rows j, j + n2, ..., so each j is a batch of n3 lines with the stride of n2 rows
+    m_ThreadPool.parallel_for(rows, 1, [&](int begin, int end)
+    {
+        ScopedTimer timer(m_Profiler, Profiler::RightPart);
+        for (int row = begin; row < end; ++row)
+        {
+            const int i = row / n2;
+            const int j = row % n2;
+            const float* x1_prev = (i > 0) ? prev_field.row(row - n2) : zeros.data();
+            const float* x1_next = (i < n1 - 1) ? prev_field.row(row + n2) : zeros.data();
+            const float* x2_prev = (j > 0) ? prev_field.row(row - 1) : zeros.data();
+            const float* x2_next = (j < n2 - 1) ? prev_field.row(row + 1) : zeros.data();
+            const float* f = f_field.empty() ? zeros.data() : f_field.row(row);
+            if (mixed) douglas_gottlieb_row(prev_field.row(row), x1_prev, x1_next, x2_prev, x2_next, f, sweep.row(row), n3, center, r1, 2 * r2, 2 * r3);
+            else douglas_gottlieb_row(prev_field.row(row), x1_prev, x1_next, x2_prev, x2_next, f, sweep.row(row), n3,
+                                      center_single, r1_single, 2 * r2_single, 2 * r3_single);
+        }
+    });
+
+    m_ThreadPool.parallel_for(n2, 1, [&](int begin, int end)
+    {
+        ScopedTimer timer(m_Profiler, Profiler::TridiagonalSolve);
+        for (int j = begin; j < end; ++j)
+        {
+            if (mixed) operators.x1_mixed.solve_batch(sweep.row(j), sweep.row(j), n3, n2 * sweep.stride());
+            else operators.x1.solve_batch(sweep.row(j), sweep.row(j), n3, n2 * sweep.stride());
+        }
+    });
+
+    // the second sweep: the X2 lines of the plane i are its n2 rows, a batch of n3 lines. The right part only needs
+    // the plane itself, so a plane is corrected and solved at once while it is in cache
+    m_ThreadPool.parallel_for(n1, 1, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
             {
-                u1 = set.c * set.c / step2 / step2 * prev_graph_data_slice.u->at(index1)->at(prev_ind2).y();
-                u2 = (2 / coordT.step - 2 * set.c * set.c / step2 / step2) * prev_graph_data_slice.u->at(index1)->at(index2).y();
-                u3 = set.c * set.c / step2 / step2 * prev_graph_data_slice.u->at(index1)->at(next_ind2).y();
+                ScopedTimer timer(m_Profiler, Profiler::RightPart);
+                for (int j = 0; j < n2; ++j)
+                {
+                    const int row = i * n2 + j;
+                    const float* u_prev = (j > 0) ? prev_field.row(row - 1) : zeros.data();
+                    const float* u_next = (j < n2 - 1) ? prev_field.row(row + 1) : zeros.data();
+                    if (mixed) douglas_gottlieb_correction(sweep.row(row), prev_field.row(row), u_prev, u_next, true, sweep.row(row), n3, scale, r2);
+                    else douglas_gottlieb_correction(sweep.row(row), prev_field.row(row), u_prev, u_next, true, sweep.row(row), n3, scale_single, r2_single);
+                }
             }
-            else if (stencil == 'y')
+
+            ScopedTimer timer(m_Profiler, Profiler::TridiagonalSolve);
+            if (mixed) operators.x2_mixed.solve_batch(sweep.row(i * n2), sweep.row(i * n2), n3, sweep.stride());
+            else operators.x2.solve_batch(sweep.row(i * n2), sweep.row(i * n2), n3, sweep.stride());
+        }
+    });
+
+    // the third sweep: the X3 lines are the rows, they are corrected and solved in blocks of `lanes` rows transposed
+    // to tiles, as in the 'y' half-step of alternating_direction_method
+    m_ThreadPool.parallel_for(rows, lanes, [&](int begin, int end)
+    {
+        Field_t block(lanes, n3);
+        Field_t tile(n3, lanes);
+
+        for (int first = begin; first < end; first += lanes)
+        {
+            const int count = std::min(lanes, end - first);
+
             {
-                u1 = set.c * set.c / step2 / step2 * prev_graph_data_slice.u->at(prev_ind1)->at(index2).y();
-                u2 = (2 / coordT.step - 2 * set.c * set.c / step2 / step2) * prev_graph_data_slice.u->at(index1)->at(index2).y();
-                u3 = set.c * set.c / step2 / step2 * prev_graph_data_slice.u->at(next_ind1)->at(index2).y();
+                ScopedTimer timer(m_Profiler, Profiler::RightPart);
+                for (int l = 0; l < count; ++l)
+                {
+                    const int row = first + l;
+                    if (mixed) douglas_gottlieb_correction(sweep.row(row), prev_field.row(row), NULL, NULL, false, block.row(l), n3, scale, r3);
+                    else douglas_gottlieb_correction(sweep.row(row), prev_field.row(row), NULL, NULL, false, block.row(l), n3, scale_single, r3_single);
+                }
             }
-            else throw("Wrong stencil");
 
-            d.push_back(u1 + u2 + u3 + set.f(QVector2D(index1_val, index2_val), t_count));
-			index1_val += coordX1.step;
-			index2_val += coordX2.step;
+            ScopedTimer timer(m_Profiler, Profiler::TridiagonalSolve);
+            MathModule::vector_transpose(block.data(), block.stride(), tile.data(), tile.stride(), count, n3);
+
+            if (mixed) operators.x3_mixed.solve_batch(tile.data(), tile.data(), count, tile.stride());
+            else operators.x3.solve_batch(tile.data(), tile.data(), count, tile.stride());
+
+            MathModule::vector_transpose(tile.data(), tile.stride(), new_field.row(first), new_field.stride(), n3, count);
+        }
+    });
+}
+
+const PdeSolverHeatEquation::Operators_t& PdeSolverHeatEquation::prepare_operators(const PdeSettings& set, double t_step)
+{
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+    const PdeSettings::CoordGridSet_t* coordX3 = set.get_coord_by_label("X3");
+    const float tau = float(t_step);
+
+    const bool mixed = (set.precision == "mixed");
+
+    std::vector<double> key = { set.c, coordX1.step, double(coordX1.count), coordX2.step, double(coordX2.count), tau, double(mixed),
+                                coordX3 ? coordX3->step : 0.0, coordX3 ? double(coordX3->count) : 0.0 };
+    for (size_t k = 0; k < m_Operators.size(); ++k)
+    {
+        if (m_Operators[k].key == key)
+        {
+            // the most recently used ones go first
+            std::rotate(m_Operators.begin(), m_Operators.begin() + k, m_Operators.begin() + k + 1);
+            return m_Operators.front();
+        }
+    }
+
+    // the implicit part of a half-step: (2 / 𝜏 + 2 r) u_k - r (u_(k-1) + u_(k+1)), r = c^2 / h^2
+    auto factorize = [&](MathModule::TridiagonalFactorization<float>& lu, float step, int size)
+    {
+        const float r = set.c * set.c / step / step;
+        const std::vector<float> a(size, -r);
+        const std::vector<float> b(size, 2 / tau + 2 * r);
+        lu.factorize(a.data(), b.data(), a.data(), size);
+    };
+    auto factorize_mixed = [&](MathModule::TridiagonalFactorization<float, double>& lu, double step, int size)
+    {
+        const double r = double(set.c) * set.c / step / step;
+        const std::vector<double> a(size, -r);
+        const std::vector<double> b(size, 2 / t_step + 2 * r);
+        lu.factorize(a.data(), b.data(), a.data(), size);
+    };
+
+    if (m_Operators.size() < OperatorsCacheSize) m_Operators.emplace_back();
+    std::rotate(m_Operators.begin(), m_Operators.end() - 1, m_Operators.end());
+    Operators_t& operators = m_Operators.front();
+    operators.x3.clear();
+    operators.x3_mixed.clear();
+    if (mixed)
+    {
+        operators.x1.clear();
+        operators.x2.clear();
+        factorize_mixed(operators.x1_mixed, coordX1.step, coordX1.count);
+        factorize_mixed(operators.x2_mixed, coordX2.step, coordX2.count);
+        if (coordX3) factorize_mixed(operators.x3_mixed, coordX3->step, coordX3->count);
+    }
+    else
+    {
+        factorize(operators.x1, coordX1.step, coordX1.count);
+        factorize(operators.x2, coordX2.step, coordX2.count);
+        if (coordX3) factorize(operators.x3, coordX3->step, coordX3->count);
+        operators.x1_mixed.clear();
+        operators.x2_mixed.clear();
+    }
+    operators.key = key;
+
+    return operators;
+}
+
+void PdeSolverHeatEquation::crank_nicolson_method(const PdeSettings& set, const Field_t& prev_field, Field_t& new_field, double t_val, double t_step)
+{
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+
+    const int rows = coordX1.count;
+    const int cols = coordX2.count;
+
+    // the explicit half: (2 / 𝜏 - 2 r1 - 2 r2) u + r1 (the rows above and below) + r2 (the neighbours in the row) + 2 f, in fp64
+    const double r1 = double(set.c) * set.c / coordX1.step / coordX1.step;
+    const double r2 = double(set.c) * set.c / coordX2.step / coordX2.step;
+    const double center = 2 / t_step - 2 * r1 - 2 * r2;
+
+    Field_t f_field;
+    evaluate_right_part(set, t_val + t_step / 2, f_field);
+
+    m_KrylovRhs.resize(size_t(rows) * cols);
+    m_KrylovSolution.resize(size_t(rows) * cols);
+    m_ThreadPool.parallel_for(rows, 1, [&](int begin, int end)
+    {
+        ScopedTimer timer(m_Profiler, Profiler::RightPart);
+        for (int i = begin; i < end; ++i)
+        {
+            // the nodes outside the grid are zero (the Dirichlet boundary condition)
+            const float* u = prev_field.row(i);
+            const float* u_up = (i > 0) ? prev_field.row(i - 1) : NULL;
+            const float* u_down = (i < rows - 1) ? prev_field.row(i + 1) : NULL;
+            const float* f = f_field.empty() ? NULL : f_field.row(i);
+            double* rhs = m_KrylovRhs.data() + size_t(i) * cols;
+            for (int j = 0; j < cols; ++j)
+            {
+                const double along = ((j > 0) ? double(u[j - 1]) : 0.0) + ((j < cols - 1) ? u[j + 1] : 0.0f);
+                const double across = (u_up ? double(u_up[j]) : 0.0) + (u_down ? u_down[j] : 0.0f);
+                rhs[j] = center * u[j] + r1 * across + r2 * along + (f ? 2.0 * f[j] : 0.0);
+            }
+            std::copy(u, u + cols, m_KrylovSolution.data() + size_t(i) * cols);
         }
+    });
 
-        MathModule::solve_tridiagonal_equation(a, b, c, d, max_index1);
-        for (int index2 = 0; index2 < max_index2; ++index2)
+    const SparseOperator_t& op = prepare_sparse_operator(set, t_step);
+
+    MathModule::KrylovResult_t result;
+    {
+        ScopedTimer timer(m_Profiler, Profiler::KrylovSolve);
+        if (set.linear_solver == "bicgstab")
+        {
+            result = MathModule::bicgstab(op.matrix, op.preconditioner.get(), m_KrylovRhs.data(), m_KrylovSolution.data(),
+                                          set.residual_tolerance, set.max_iterations, &m_ThreadPool);
+        }
+        else
         {
-            auto& prev_vector = prev_graph_data_slice.u->at(index2)->at(index1);
-            z_val = d[index2];
-            row->push_back(QVector3D(prev_vector.x(), z_val, prev_vector.z()));
+            result = MathModule::conjugate_gradient(op.matrix, op.preconditioner.get(), m_KrylovRhs.data(), m_KrylovSolution.data(),
+                                                    set.residual_tolerance, set.max_iterations, &m_ThreadPool);
         }
-        cur_graph_data_slice.u->push_back(row);
     }
+    m_Profiler.count(Profiler::KrylovIterations, result.iterations);
+    if (!result.converged) throw("The linear solver of the Crank-Nicolson step did not converge (raise maxIterations or change the preconditioner)");
+
+    for (int i = 0; i < rows; ++i)
+    {
+        const double* x = m_KrylovSolution.data() + size_t(i) * cols;
+        float* u_new = new_field.row(i);
+        for (int j = 0; j < cols; ++j) u_new[j] = float(x[j]);
+    }
+}
+
+const PdeSolverHeatEquation::SparseOperator_t& PdeSolverHeatEquation::prepare_sparse_operator(const PdeSettings& set, double t_step)
+{
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+
+    std::vector<double> key = { set.c, coordX1.step, double(coordX1.count), coordX2.step, double(coordX2.count), t_step };
+    if ((m_SparseOperator.key == key) && (m_SparseOperator.preconditioner_name == set.preconditioner)) return m_SparseOperator;
+
+    // the implicit half: (2 / 𝜏 + 2 r1 + 2 r2) u - r1 (the rows above and below) - r2 (the neighbours in the row)
+    const int rows = coordX1.count;
+    const int cols = coordX2.count;
+    const double r1 = double(set.c) * set.c / coordX1.step / coordX1.step;
+    const double r2 = double(set.c) * set.c / coordX2.step / coordX2.step;
+
+    std::vector<MathModule::SparseMatrix::Entry_t> entries;
+    entries.reserve(size_t(rows) * cols * 5);
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            const int k = i * cols + j;
+            if (i > 0) entries.push_back({ k, k - cols, -r1 });
+            if (j > 0) entries.push_back({ k, k - 1, -r2 });
+            entries.push_back({ k, k, 2 / t_step + 2 * r1 + 2 * r2 });
+            if (j < cols - 1) entries.push_back({ k, k + 1, -r2 });
+            if (i < rows - 1) entries.push_back({ k, k + cols, -r1 });
+        }
+    }
+
+    m_SparseOperator.preconditioner.reset();
+    m_SparseOperator.matrix.assemble(rows * cols, rows * cols, entries);
+    m_SparseOperator.preconditioner = MathModule::make_preconditioner(set.preconditioner.toStdString(), m_SparseOperator.matrix, &m_ThreadPool);
+    m_SparseOperator.preconditioner_name = set.preconditioner;
+    m_SparseOperator.key = key;
 
-    return cur_graph_data_slice;
+    return m_SparseOperator;
 }
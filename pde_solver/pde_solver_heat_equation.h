@@ -25,9 +25,15 @@
 #define PDE_SOLVER_HEAT_EQUATION_H
 
 #include "pde_solver_base.h"
+#include "pde_thread_pool.h"
+#include "../math_module/math_module.h"
+#include "../math_module/sparse_matrix.h"
 
 /**
- * @brief A class for solving the 2d heat equation.
+ * @brief A class for solving the 2d and 3d heat equation.
+ *
+ * A 3d solution is kept in fields of (X1 count * X2 count) rows of X3 count nodes: the row i * (X2 count) + j holds the nodes
+ * (i, j, k), so the output, the solution files and the checkpoints store it as a 2d field.
  */
 class PdeSolverHeatEquation : public PdeSolverBase
 {
@@ -39,11 +45,148 @@ public:
 
     virtual QVector<PdeSolver::SolutionMethod_t> get_implemented_methods();
 
+    /**
+     * @brief The explicit scheme is stable while 𝜏 c^2 (1 / 𝛿X1^2 + 1 / 𝛿X2^2) <= 1 / 2 (von Neumann), the implicit ones always.
+     */
+    virtual QString check_stability(const PdeSettings& set, PdeSolver::SolutionMethod_t method);
+
 public slots:
     virtual void get_solution(const PdeSettings& set, PdeSolver::SolutionMethod_t method);
 
 protected:
-    PdeSolver::GraphDataSlice_t alternating_direction_method(const PdeSettings& set, const PdeSolver::GraphDataSlice_t& prev_graph_data_slice, char stencil, double t_count);
+    /**
+     * @brief A half-step of the Peaceman-Rachford alternating direction implicit scheme.
+     *
+     * The grid lines are independent, so they are split across m_ThreadPool. Every stage returns only when
+     * all the threads are done, which is also the barrier between the two half-steps. With the "mixed" precision
+     * the explicit part is summed and the lines are eliminated in fp64.
+     * @param stencil 'x' (implicit along X1, explicit along X2) or 'y' (implicit along X2, explicit along X1)
+     * @param t_val the time the right part of the equation is taken at
+     * @param t_step the time step (of both half-steps)
+     */
+    void alternating_direction_method(const PdeSettings& set, const PdeSolver::Field_t& prev_field, PdeSolver::Field_t& new_field,
+                                      char stencil, double t_val, double t_step);
+
+    /**
+     * @brief A step of the Douglas–Gottlieb alternating direction implicit scheme on a 3d grid, with A_k = c^2 𝛿^2/𝛿X_k^2:\n
+     * (2 / 𝜏 - A1) u* = (2 / 𝜏 + A1 + 2 A2 + 2 A3) u^n + 2 f(t_val + 𝜏 / 2),\n
+     * (2 / 𝜏 - A2) u** = 2 / 𝜏 u* - A2 u^n,\n
+     * (2 / 𝜏 - A3) u^(n+1) = 2 / 𝜏 u** - A3 u^n.
+     *
+     * It is second order in time and unconditionally stable (the three-dimensional Peaceman-Rachford scheme is not).
+     * Every sweep solves a batch of lines at once: the X1 and X2 lines are strided across the rows of the field and
+     * solved in place, the X3 lines (the rows) are transposed to tiles, as in the 'y' half-step of alternating_direction_method.
+     */
+    void douglas_gottlieb_method(const PdeSettings& set, const PdeSolver::Field_t& prev_field, PdeSolver::Field_t& new_field,
+                                 double t_val, double t_step);
+
+    /**
+     * @brief A step of the unsplit Crank–Nicolson scheme from t_val to t_val + t_step:
+     * (2 / 𝜏 - c^2 𝛥) u^(n+1) = (2 / 𝜏 + c^2 𝛥) u^n + 2 f(t_val + 𝜏 / 2).
+     *
+     * The 5-point system is solved in fp64 by set.linear_solver with set.preconditioner, from u^n until the residual
+     * is below set.residual_tolerance of the right part. Unlike the ADI scheme it has no splitting error.
+     */
+    void crank_nicolson_method(const PdeSettings& set, const PdeSolver::Field_t& prev_field, PdeSolver::Field_t& new_field,
+                               double t_val, double t_step);
+
+    /**
+     * @brief A step of the explicit forward time centered space scheme from t_val to t_val + t_step:
+     * u^(n+1) = u^n + 𝜏 (c^2 𝛥u^n + f(t_val)).
+     *
+     * The rows are independent, so they are split across m_ThreadPool; a row is a single pass of the 5-point stencil.
+     */
+    void explicit_method(const PdeSettings& set, const PdeSolver::Field_t& prev_field, PdeSolver::Field_t& new_field, double t_val, double t_step);
+
+    /**
+     * @brief steps steps of explicit_method from the level t_count of the T grid, with the same results.
+     *
+     * The grid is split into tiles which are advanced by all the steps while they stay in cache (trapezoid tiling):
+     * step s of a tile is computed on the tile widened by steps - s nodes on every side, the nodes the later steps depend on,
+     * so the tiles are independent and the whole grid is read and written once instead of once per step.
+     */
+    void explicit_steps(const PdeSettings& set, const PdeSolver::Field_t& prev_field, PdeSolver::Field_t& new_field, int t_count, int steps);
+
+    /**
+     * @brief f on the whole grid (2d or 3d) at t_val (split across m_ThreadPool). f_field is left empty if f is zero.
+     */
+    void evaluate_right_part(const PdeSettings& set, double t_val, PdeSolver::Field_t& f_field);
+
+    /**
+     * @brief A whole step of the implicit scheme from t_val to t_val + t_step: both ADI half-steps, a Crank–Nicolson step
+     * or the three sweeps of a Douglas–Gottlieb step.
+     */
+    void time_step(const PdeSettings& set, const PdeSolver::Field_t& prev_field, PdeSolver::Field_t& new_field, double t_val, double t_step);
+
+    /**
+     * @brief A step with the error control of set.step_tolerance (by step doubling).
+     *
+     * The step is T.step * 2^step_level, but at most max_steps levels of the T grid (so the output levels are hit exactly).
+     * A step with a too large error is retried with a smaller one, down to T.step, which is always accepted.
+     * @param step_level the current step level, lowered after a rejection and raised after a step with a small error
+     * @return the number of levels of the T grid the step spans
+     */
+    int adaptive_time_step(const PdeSettings& set, const PdeSolver::Field_t& prev_field, PdeSolver::Field_t& new_field, double t_val,
+                           int max_steps, int& step_level);
+
+    /**
+     * @brief The estimated error of two half steps in units of the tolerance: max|full - half| / (tolerance * max(1, max|half|)).
+     */
+    float step_error(const PdeSettings& set, const PdeSolver::Field_t& full_step, const PdeSolver::Field_t& half_steps);
+
+    /**
+     * @brief The factorized implicit operators of both half-steps (and of the X3 sweep of a 3d grid) for a time step.
+     * Only the ones of the precision of the settings are factorized.
+     */
+    struct Operators_t
+    {
+        std::vector<double> key;                    /**< the settings the operators were built for */
+        MathModule::TridiagonalFactorization<float> x1;  /**< the operator of the 'x' half-step */
+        MathModule::TridiagonalFactorization<float> x2;  /**< the operator of the 'y' half-step */
+        MathModule::TridiagonalFactorization<float, double> x1_mixed;  /**< x1 eliminated in fp64 (the "mixed" precision) */
+        MathModule::TridiagonalFactorization<float, double> x2_mixed;  /**< x2 eliminated in fp64 (the "mixed" precision) */
+        MathModule::TridiagonalFactorization<float> x3;  /**< the operator of the X3 sweep (empty on a 2d grid) */
+        MathModule::TridiagonalFactorization<float, double> x3_mixed;  /**< x3 eliminated in fp64 (the "mixed" precision) */
+    };
+
+    /**
+     * @brief Factorizes the implicit operators of the sweeps. The last OperatorsCacheSize factorizations are kept
+     * (the adaptive step switches between a few time steps).
+     */
+    const Operators_t& prepare_operators(const PdeSettings& set, double t_step);
+
+    /**
+     * @brief The matrix of a Crank–Nicolson step (the nodes are numbered row by row) and its preconditioner.
+     */
+    struct SparseOperator_t
+    {
+        std::vector<double> key;            /**< the settings the matrix was built for */
+        QString preconditioner_name;
+        MathModule::SparseMatrix matrix;
+        std::unique_ptr<MathModule::Preconditioner> preconditioner;     /**< NULL for "none" */
+    };
+
+    /**
+     * @brief Assembles the matrix of a Crank–Nicolson step of t_step and its preconditioner, unless they are built already.
+     */
+    const SparseOperator_t& prepare_sparse_operator(const PdeSettings& set, double t_step);
+
+private:
+    static const size_t OperatorsCacheSize = 4;
+    static const int TimeBlockBytes = 512 * 1024;   /**< The size of the levels of a tile of explicit_steps (about an L2 cache) */
+    static const int MaxStepLevel = 16;             /**< The adaptive step is at most T.step * 2^MaxStepLevel */
+    static constexpr float StepGrowthError = 0.1f;  /**< The adaptive step is doubled after a step with a smaller error */
+
+    std::vector<Operators_t> m_Operators;       /**< the cached operators, the most recently used first */
+    SparseOperator_t m_SparseOperator;          /**< the operator of the last Crank–Nicolson step (the preconditioner may refer to the matrix, so it is not moved) */
+    std::vector<double> m_KrylovRhs;            /**< the right part of a Crank–Nicolson step */
+    std::vector<double> m_KrylovSolution;       /**< the new level of a Crank–Nicolson step in fp64 */
+    bool m_UnsplitStep = false;                 /**< time_step takes a Crank–Nicolson step instead of the ADI half-steps */
+    bool m_VolumeStep = false;                  /**< time_step takes a Douglas–Gottlieb step (the grid is 3d) */
+    PdeSolver::Field_t m_HalfStepField;         /**< the level between the half-steps (the one between the sweeps of a 3d step) */
+    PdeSolver::Field_t m_FullStepField;         /**< the adaptive step: the result of the whole step */
+    PdeSolver::Field_t m_HalfTimeField;         /**< the adaptive step: the result of the first half of the step */
+    PdeSolver::ThreadPool m_ThreadPool;         /**< the workers the grid lines are split across */
 };
 
 #endif // PDE_SOLVER_HEAT_EQUATION_H
@@ -0,0 +1,410 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "pde_solver_poisson_equation.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace PdeSolver;
+
+static const char* const VCycleMethodName = "Multigrid V-cycle";
+static const char* const WCycleMethodName = "Multigrid W-cycle";
+
+/**
+ * @brief A Gauss–Seidel pass over the nodes first, first + 2, ... of a row: u = (f + the couplings with the neighbours) / the diagonal.
+ * up and down are the rows above and below (a zero row outside the grid). The last node has its own coupling and diagonal
+ * (see PdeSolverPoissonEquation::Level_t::gap_cols).
+ */
+static inline void relax_row(double* u, const double* up, const double* down, const double* f, int cols, int first,
+                             double coef_rows, double coef_cols, double inv_diag, double coef_cols_last, double inv_diag_last)
+{
+    const int last = cols - 1;
+    int j = first;
+    if ((j == 0) && (last > 0))
+    {
+        u[0] = (f[0] + coef_rows * (up[0] + down[0]) + coef_cols * u[1]) * inv_diag;
+        j = 2;
+    }
+    for (; j < last; j += 2) u[j] = (f[j] + coef_rows * (up[j] + down[j]) + coef_cols * (u[j - 1] + u[j + 1])) * inv_diag;
+    if (j == last) u[j] = (f[j] + coef_rows * (up[j] + down[j]) + coef_cols_last * ((j > 0) ? u[j - 1] : 0.0)) * inv_diag_last;
+}
+
+/**
+ * @brief The Shortley–Weller second difference at a node one step from the previous node and gap steps from the boundary:
+ * the coupling with the previous node is 2 / (1 + gap) and the diagonal 2 / gap (times the coefficient), 1 and 2 for gap = 1.
+ */
+static inline double last_coupling(double coef, double gap) { return coef * 2 / (1 + gap); }
+static inline double last_diagonal(double coef, double gap) { return coef * 2 / gap; }
+
+/**
+ * @brief The interpolation weight of the last coarse node at the fine node after it (the boundary is gap fine steps further).
+ */
+static inline double end_weight(double gap) { return gap / (1 + gap); }
+
+/**
+ * @brief The restriction weight of fine node 2 * coarse_index + 2 (1/4 inside, the transposed interpolation weight at the end).
+ */
+static inline double far_weight(int coarse_index, int fine_count, double fine_gap)
+{
+    const int fine_index = 2 * coarse_index + 2;
+    if (fine_index < fine_count - 1) return 0.25;
+    return (fine_index == fine_count - 1) ? 0.5 * end_weight(fine_gap) : 0.0;
+}
+
+PdeSolverPoissonEquation::PdeSolverPoissonEquation() : PdeSolverBase()
+{
+
+}
+
+PdeSolverPoissonEquation::~PdeSolverPoissonEquation()
+{
+
+}
+
+QVector<SolutionMethod_t> PdeSolverPoissonEquation::get_implemented_methods()
+{
+    QVector<SolutionMethod_t> methods;
+    methods.push_back(PdeSolver::SolutionMethod_t(VCycleMethodName, "Cartesian"));
+    methods.push_back(PdeSolver::SolutionMethod_t(WCycleMethodName, "Cartesian"));
+    return methods;
+}
+
+void PdeSolverPoissonEquation::get_solution(const PdeSettings& set, SolutionMethod_t method)
+{
+    if (method.coord_system != "Cartesian") throw("This method can be used only in Cartesian coords");
+    if (set.m_Dim != method.dim) throw("The number of the space axes of the grid does not match the method");
+    if ((method.name != VCycleMethodName) && (method.name != WCycleMethodName)) throw("Wrong method");
+    const int gamma = (method.name == WCycleMethodName) ? 2 : 1;
+
+    begin_profiling(set);
+
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+    const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+    const int rows = coordX1.count;
+    const int cols = coordX2.count;
+
+    m_ThreadPool.resize(set.threads);
+    build_levels(set);
+    Level_t& finest = m_Levels.front();
+
+    // f at T.min, u starts from zero
+    double f_norm2 = 0.0;
+    if (!set.f_is_zero())
+    {
+        std::vector<float> x1_nodes = coordX1.nodes();
+        std::vector<float> x2_nodes = coordX2.nodes();
+        Field_t f_field(rows, cols);
+        std::vector<double> row_norm2(rows, 0.0);
+        m_ThreadPool.parallel_for(rows, 1, [&](int begin, int end)
+        {
+            ScopedTimer timer(m_Profiler, Profiler::RightPart);
+            set.f_grid(x1_nodes.data() + begin, end - begin, x2_nodes.data(), cols, coordT.min, f_field.row(begin), f_field.stride());
+            for (int i = begin; i < end; ++i)
+            {
+                const float* src = f_field.row(i);
+                double* dst = finest.f.row(i);
+                for (int j = 0; j < cols; ++j)
+                {
+                    dst[j] = src[j];
+                    row_norm2[i] += dst[j] * dst[j];
+                }
+            }
+        });
+        for (double value : row_norm2) f_norm2 += value;
+    }
+    const double f_norm = std::sqrt(f_norm2);
+
+    GraphSolution_t solution;
+    solution.set = set;
+    begin_output(set, solution, rows, cols, false, 1);
+
+    // the relative residual of every cycle is reported, the percentage is the part of the way to the tolerance (on a log scale)
+    const double log_tolerance = std::log(double(set.residual_tolerance));
+    double relative_residual = (f_norm > 0) ? 1.0 : 0.0;
+    int cycles = 0;
+    while ((relative_residual > set.residual_tolerance) && (cycles < set.max_cycles))
+    {
+        cycle(0, gamma);
+        ++cycles;
+        m_Profiler.count(Profiler::MultigridCycles);
+
+        relative_residual = std::sqrt(residual(finest)) / f_norm;
+        const int percent = qBound(0, int(100 * std::log(relative_residual) / log_tolerance), 99);
+        report_progress(QString("Cycle %1: the relative residual %2").arg(cycles).arg(relative_residual, 0, 'e', 2), percent);
+
+        if (cancel_requested() && (relative_residual > set.residual_tolerance))
+        {
+            Field_t u(rows, cols);
+            for (int i = 0; i < rows; ++i) std::copy(finest.u.row(i), finest.u.row(i) + cols, u.row(i));
+            output_slice(solution, coordT.min, u, NULL);
+            cancel_solution(solution, coordT.min);
+            return;
+        }
+    }
+
+    Field_t u(rows, cols);
+    for (int i = 0; i < rows; ++i) std::copy(finest.u.row(i), finest.u.row(i) + cols, u.row(i));
+    output_slice(solution, coordT.min, u, NULL);
+
+    end_output();
+
+    if (relative_residual <= set.residual_tolerance)
+        report_progress(QString("Converged in %1 cycles, the relative residual %2").arg(cycles).arg(relative_residual, 0, 'e', 2), 100);
+    else
+        report_progress(QString("Not converged in %1 cycles, the relative residual %2").arg(cycles).arg(relative_residual, 0, 'e', 2), 100);
+    end_profiling(solution);
+    qDebug() << "PdeSolverPoissonEquation: Data generated";
+    emit solution_generated(solution);
+}
+
+void PdeSolverPoissonEquation::build_levels(const PdeSettings& set)
+{
+    const PdeSettings::CoordGridSet_t& coordX1 = *set.get_coord_by_label("X1");
+    const PdeSettings::CoordGridSet_t& coordX2 = *set.get_coord_by_label("X2");
+
+    int rows = coordX1.count;
+    int cols = coordX2.count;
+    double step_rows = coordX1.step;
+    double step_cols = coordX2.step;
+    double gap_rows = 1.0;
+    double gap_cols = 1.0;
+    const double c2 = double(set.c) * set.c;
+
+    m_Levels.clear();
+    while (true)
+    {
+        m_Levels.emplace_back();
+        Level_t& level = m_Levels.back();
+        level.rows = rows;
+        level.cols = cols;
+        level.coef_rows = c2 / (step_rows * step_rows);
+        level.coef_cols = c2 / (step_cols * step_cols);
+        level.gap_rows = gap_rows;
+        level.gap_cols = gap_cols;
+        level.u.resize(rows, cols);
+        level.f.resize(rows, cols);
+        level.r.resize(rows, cols);
+
+        // only the dimensions with the smaller steps are halved (semi-coarsening), the steps are compared with some slack
+        const bool halve_rows = (rows >= 3);
+        const bool halve_cols = (cols >= 3);
+        if (!halve_rows && !halve_cols) break;
+        const double min_step = std::min(halve_rows ? step_rows : step_cols, halve_cols ? step_cols : step_rows);
+        level.coarse_rows = halve_rows && (step_rows <= 2.5 * min_step);
+        level.coarse_cols = halve_cols && (step_cols <= 2.5 * min_step);
+
+        // the coarse node k is the fine node 2 k + 1, the first one stays a step from the boundary, the last one may get closer
+        if (level.coarse_rows)
+        {
+            gap_rows = (rows - 2 * (rows / 2) + gap_rows) / 2;
+            rows /= 2;
+            step_rows *= 2;
+        }
+        if (level.coarse_cols)
+        {
+            gap_cols = (cols - 2 * (cols / 2) + gap_cols) / 2;
+            cols /= 2;
+            step_cols *= 2;
+        }
+    }
+}
+
+void PdeSolverPoissonEquation::cycle(int level_index, int gamma)
+{
+    Level_t& level = m_Levels[level_index];
+    if (level_index == int(m_Levels.size()) - 1)
+    {
+        smooth(level, CoarsestSweeps);
+        return;
+    }
+
+    Level_t& coarse = m_Levels[level_index + 1];
+    smooth(level, PreSweeps);
+    residual(level);
+    restrict_residual(level, coarse);
+    coarse.u.fill(0.0);
+    for (int k = 0; k < gamma; ++k) cycle(level_index + 1, gamma);
+    interpolate_correction(coarse, level);
+    smooth(level, PostSweeps);
+}
+
+void PdeSolverPoissonEquation::smooth(Level_t& level, int sweeps)
+{
+    const int rows = level.rows;
+    const int cols = level.cols;
+    const std::vector<double> zero_row(cols, 0.0);
+
+    // the nodes of a color depend only on the other color, so the rows of a color are independent
+    for (int sweep = 0; sweep < sweeps; ++sweep)
+    {
+        for (int color = 0; color < 2; ++color)
+        {
+            for_rows(rows, cols, [&](int begin, int end)
+            {
+                ScopedTimer timer(m_Profiler, Profiler::Smoothing);
+                for (int i = begin; i < end; ++i)
+                {
+                    const bool last_row = (i == rows - 1);
+                    const double coef_rows = last_row ? last_coupling(level.coef_rows, level.gap_rows) : level.coef_rows;
+                    const double diag_rows = last_row ? last_diagonal(level.coef_rows, level.gap_rows) : 2 * level.coef_rows;
+                    const double* up = (i > 0) ? level.u.row(i - 1) : zero_row.data();
+                    const double* down = last_row ? zero_row.data() : level.u.row(i + 1);
+                    relax_row(level.u.row(i), up, down, level.f.row(i), cols, (i + color) % 2, coef_rows, level.coef_cols,
+                              1 / (diag_rows + 2 * level.coef_cols), last_coupling(level.coef_cols, level.gap_cols),
+                              1 / (diag_rows + last_diagonal(level.coef_cols, level.gap_cols)));
+                }
+            });
+        }
+    }
+}
+
+double PdeSolverPoissonEquation::residual(Level_t& level)
+{
+    const int rows = level.rows;
+    const int cols = level.cols;
+    const std::vector<double> zero_row(cols, 0.0);
+
+    // the partial sums are added in the order of the rows, so the norm does not depend on the number of threads
+    std::vector<double> row_norm2(rows, 0.0);
+    for_rows(rows, cols, [&](int begin, int end)
+    {
+        ScopedTimer timer(m_Profiler, Profiler::GridTransfer);
+        for (int i = begin; i < end; ++i)
+        {
+            const bool last_row = (i == rows - 1);
+            const double coef_rows = last_row ? last_coupling(level.coef_rows, level.gap_rows) : level.coef_rows;
+            const double diag_rows = last_row ? last_diagonal(level.coef_rows, level.gap_rows) : 2 * level.coef_rows;
+            const double diag = diag_rows + 2 * level.coef_cols;
+            const double* u = level.u.row(i);
+            const double* up = (i > 0) ? level.u.row(i - 1) : zero_row.data();
+            const double* down = last_row ? zero_row.data() : level.u.row(i + 1);
+            const double* f = level.f.row(i);
+            double* r = level.r.row(i);
+
+            const int last = cols - 1;
+            if (last > 0) r[0] = f[0] - diag * u[0] + coef_rows * (up[0] + down[0]) + level.coef_cols * u[1];
+            for (int j = 1; j < last; ++j) r[j] = f[j] - diag * u[j] + coef_rows * (up[j] + down[j]) + level.coef_cols * (u[j - 1] + u[j + 1]);
+            r[last] = f[last] - (diag_rows + last_diagonal(level.coef_cols, level.gap_cols)) * u[last] + coef_rows * (up[last] + down[last])
+                    + last_coupling(level.coef_cols, level.gap_cols) * ((last > 0) ? u[last - 1] : 0.0);
+
+            double sum = 0.0;
+            for (int j = 0; j < cols; ++j) sum += r[j] * r[j];
+            row_norm2[i] = sum;
+        }
+    });
+
+    double norm2 = 0.0;
+    for (double value : row_norm2) norm2 += value;
+    return norm2;
+}
+
+void PdeSolverPoissonEquation::restrict_residual(const Level_t& fine, Level_t& coarse)
+{
+    // the weights are (1/4, 1/2, 1/4) along a halved dimension (the transposed interpolation at the end) and 1 along a kept one
+    for_rows(coarse.rows, coarse.cols, [&](int begin, int end)
+    {
+        ScopedTimer timer(m_Profiler, Profiler::GridTransfer);
+        std::vector<double> line(fine.cols);
+        for (int I = begin; I < end; ++I)
+        {
+            if (fine.coarse_rows)
+            {
+                const double* r0 = fine.r.row(2 * I);
+                const double* r1 = fine.r.row(2 * I + 1);
+                const double w2 = far_weight(I, fine.rows, fine.gap_rows);
+                const double* r2 = (w2 > 0) ? fine.r.row(2 * I + 2) : r0;
+                for (int j = 0; j < fine.cols; ++j) line[j] = 0.25 * r0[j] + 0.5 * r1[j] + w2 * r2[j];
+            }
+            else std::copy(fine.r.row(I), fine.r.row(I) + fine.cols, line.begin());
+
+            double* f = coarse.f.row(I);
+            if (fine.coarse_cols)
+            {
+                for (int J = 0; J < coarse.cols; ++J)
+                {
+                    const double w2 = far_weight(J, fine.cols, fine.gap_cols);
+                    f[J] = 0.25 * line[2 * J] + 0.5 * line[2 * J + 1] + ((w2 > 0) ? w2 * line[2 * J + 2] : 0.0);
+                }
+            }
+            else std::copy(line.begin(), line.begin() + coarse.cols, f);
+        }
+    });
+}
+
+void PdeSolverPoissonEquation::interpolate_correction(const Level_t& coarse, Level_t& fine)
+{
+    // an odd fine node takes the value of its coarse node, an even one the mean of the coarse nodes around it
+    // (or the linear interpolation to the boundary after the last coarse node)
+    const double end_rows = end_weight(fine.gap_rows);
+    const double end_cols = end_weight(fine.gap_cols);
+    for_rows(fine.rows, fine.cols, [&](int begin, int end)
+    {
+        ScopedTimer timer(m_Profiler, Profiler::GridTransfer);
+        std::vector<double> line(coarse.cols);
+        for (int i = begin; i < end; ++i)
+        {
+            const int I = i / 2;
+            if (!fine.coarse_rows) std::copy(coarse.u.row(i), coarse.u.row(i) + coarse.cols, line.begin());
+            else if (i % 2) std::copy(coarse.u.row(I), coarse.u.row(I) + coarse.cols, line.begin());
+            else if (I == coarse.rows)
+            {
+                const double* e0 = coarse.u.row(I - 1);
+                for (int J = 0; J < coarse.cols; ++J) line[J] = end_rows * e0[J];
+            }
+            else
+            {
+                const double* e1 = coarse.u.row(I);
+                if (I > 0)
+                {
+                    const double* e0 = coarse.u.row(I - 1);
+                    for (int J = 0; J < coarse.cols; ++J) line[J] = 0.5 * (e0[J] + e1[J]);
+                }
+                else for (int J = 0; J < coarse.cols; ++J) line[J] = 0.5 * e1[J];
+            }
+
+            double* u = fine.u.row(i);
+            if (fine.coarse_cols)
+            {
+                for (int j = 0; j < fine.cols; ++j)
+                {
+                    const int J = j / 2;
+                    if (j % 2) u[j] += line[J];
+                    else if (J == coarse.cols) u[j] += end_cols * line[J - 1];
+                    else u[j] += 0.5 * (((J > 0) ? line[J - 1] : 0.0) + line[J]);
+                }
+            }
+            else
+            {
+                for (int j = 0; j < fine.cols; ++j) u[j] += line[j];
+            }
+        }
+    });
+}
+
+void PdeSolverPoissonEquation::for_rows(int rows, int cols, const std::function<void(int, int)>& task)
+{
+    if (size_t(rows) * cols >= size_t(ParallelNodes)) m_ThreadPool.parallel_for(rows, 1, task);
+    else task(0, rows);
+}
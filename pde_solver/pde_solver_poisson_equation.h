@@ -0,0 +1,128 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_SOLVER_POISSON_EQUATION_H
+#define PDE_SOLVER_POISSON_EQUATION_H
+
+#include "pde_solver_base.h"
+#include "pde_thread_pool.h"
+
+/**
+ * @brief A class for solving the 2d Poisson equation c^2 𝛥u + f = 0, the steady state of the heat equation
+ * (u = 0 outside the grid as well). f is taken at T.min, the solution is a single slice.
+ *
+ * The 5-point scheme is solved by geometric multigrid: red-black Gauss–Seidel smoothing, full weighting restriction,
+ * bilinear interpolation and the operator rediscretized on every coarser grid, in V- or W-cycles until the residual
+ * drops below PdeSettings::residual_tolerance. A cycle costs O(N), so does the solve. The relative residual of every
+ * cycle goes to the progress signal.
+ */
+class PdeSolverPoissonEquation : public PdeSolverBase
+{
+    Q_OBJECT
+
+public:
+    PdeSolverPoissonEquation();
+    virtual ~PdeSolverPoissonEquation();
+
+    virtual QVector<PdeSolver::SolutionMethod_t> get_implemented_methods();
+
+public slots:
+    virtual void get_solution(const PdeSettings& set, PdeSolver::SolutionMethod_t method);
+
+protected:
+    /**
+     * @brief The fields of the multigrid levels are fp64: the residual of an fp32 u cannot drop below
+     * about eps 4 c^2 / h^2 |u|, which is far above the usual tolerances on fine grids.
+     */
+    typedef PdeSolver::GridField<double> LevelField_t;
+
+    /**
+     * @brief A grid of the multigrid hierarchy, the finest one first.
+     */
+    struct Level_t
+    {
+        int rows = 0;
+        int cols = 0;
+        double coef_rows = 0.0;     /**< c^2 / 𝛿X1^2, the coupling with the rows above and below */
+        double coef_cols = 0.0;     /**< c^2 / 𝛿X2^2, the coupling with the neighbours in the row */
+        bool coarse_rows = false;   /**< If the next level halves the rows */
+        bool coarse_cols = false;   /**< If the next level halves the columns */
+        double gap_rows = 1.0;      /**< The distance from the last row to the zero boundary in steps (below 1 on the coarse levels of even counts) */
+        double gap_cols = 1.0;      /**< The same for the last column */
+        LevelField_t u;             /**< The solution on the finest level, the correction on the others */
+        LevelField_t f;             /**< The right part on the finest level, the restricted residual on the others */
+        LevelField_t r;             /**< The residual f - A u */
+    };
+
+    /**
+     * @brief Builds the levels for the X1 x X2 grid. The coarse nodes are the odd fine ones, so halving an even count moves
+     * the last node closer to the boundary; the second difference at the last node accounts for that (Shortley–Weller).
+     * A dimension is halved while it has at least 3 nodes and its step
+     * is at most twice the smallest step of the dimensions still being halved, so the coarse grids stay about
+     * isotropic and the point smoother keeps working. The coarsest level has at most 2 x 2 nodes.
+     */
+    void build_levels(const PdeSettings& set);
+
+    /**
+     * @brief A multigrid cycle on the level and the coarser ones: gamma = 1 is a V-cycle, gamma = 2 a W-cycle.
+     */
+    void cycle(int level, int gamma);
+
+    /**
+     * @brief Red-black Gauss–Seidel sweeps (the red nodes, i + j even, first).
+     */
+    void smooth(Level_t& level, int sweeps);
+
+    /**
+     * @brief Computes the residual of the level.
+     * @return its squared L2 norm
+     */
+    double residual(Level_t& level);
+
+    /**
+     * @brief The full weighting restriction of the residual of fine to the right part of coarse.
+     */
+    void restrict_residual(const Level_t& fine, Level_t& coarse);
+
+    /**
+     * @brief Adds the bilinear interpolation of the correction of coarse to the solution of fine.
+     */
+    void interpolate_correction(const Level_t& coarse, Level_t& fine);
+
+    /**
+     * @brief Calls task(begin, end) for the rows of a level, split across m_ThreadPool if the level is large enough.
+     */
+    void for_rows(int rows, int cols, const std::function<void(int, int)>& task);
+
+    std::vector<Level_t> m_Levels;
+
+private:
+    static const int PreSweeps = 2;             /**< The smoothing sweeps before the coarse grid correction */
+    static const int PostSweeps = 2;            /**< The smoothing sweeps after the coarse grid correction */
+    static const int CoarsestSweeps = 32;       /**< The sweeps solving the coarsest level (at most 2 x 2 nodes) */
+    static const int ParallelNodes = 16384;     /**< The smaller levels are not split across the threads */
+
+    PdeSolver::ThreadPool m_ThreadPool;         /**< the workers the rows are split across */
+};
+
+#endif // PDE_SOLVER_POISSON_EQUATION_H
@@ -24,12 +24,13 @@
 #ifndef PDE_SOLVER_STRUCTS_H
 #define PDE_SOLVER_STRUCTS_H
 
-#include <QtDataVisualization/Q3DSurface>
-#include <QtDataVisualization/QSurface3DSeries>
-#include <QtDataVisualization/QValue3DAxis>
 #include <QString>
+#include <QList>
 
 #include "pde_settings.h"
+#include "pde_field.h"
+#include "pde_time_levels.h"
+#include "pde_snapshot_store.h"
 
 namespace PdeSolver
 {
@@ -38,8 +39,8 @@ namespace PdeSolver
      */
     struct GraphDataSlice_t
     {
-        QtDataVisualization::QSurfaceDataArray* u;      /**< The pointer to the u(x, t) data slice (with a fixed t) */
-        QtDataVisualization::QSurfaceDataArray* u_t;    /**< The pointer to the partial derivative 𝛿u/𝛿t(x, t) data slice (with a fixed t) */
+        FieldPtr_t u;      /**< The u(x, t) data slice (with a fixed t) */
+        FieldPtr_t u_t;    /**< The partial derivative 𝛿u/𝛿t(x, t) data slice (with a fixed t), may be null if not computed */
     };
 
     /**
@@ -47,8 +48,10 @@ namespace PdeSolver
      */
     struct GraphData_t
     {
-        QList<QtDataVisualization::QSurfaceDataArray*> u_list;      /**< A list of slices. Here the index of Qlist is time and the array pointers are time slices of the u(x, t) function */
-        QList<QtDataVisualization::QSurfaceDataArray*> u_t_list;    /**< A list of slices. Here the index of Qlist is time and the array pointers are time slices of the partial 𝛿u/𝛿t(x, t) function */
+        QList<FieldPtr_t> u_list;      /**< A list of slices. Here the index of Qlist is time and the fields are time slices of the u(x, t) function */
+        QList<FieldPtr_t> u_t_list;    /**< A list of slices. Here the index of Qlist is time and the fields are time slices of the partial 𝛿u/𝛿t(x, t) function (null if not computed) */
+        QList<double> t_list;          /**< The times of the slices (only the levels chosen by the retention policy are kept, so it is not always the T grid) */
+        std::shared_ptr<SnapshotStore> store;  /**< If set, the slices are compressed here and u_list and u_t_list are empty */
     };
 
     /**
@@ -59,16 +62,19 @@ namespace PdeSolver
     {
         GraphData_t graph_data;         /**< main graph data */
         PdeSettings set;                /**< settings used when solving pde */
+        QString solution_file;          /**< If not empty, the slices are in this solution file (see SolutionFileReader) and graph_data has only t_list */
+        QString profile_summary;        /**< The phase timings of the solve if set.profile (see Profiler::summary) */
     };
 
     struct SolutionMethod_t
     {
         QString name;
         QString coord_system;
+        int dim;            /**< The number of the space axes of the grid the method solves on (PdeSettings::m_Dim) */
 
-        SolutionMethod_t() { name = "<method_name>"; coord_system = "<coord_system>"; }
+        SolutionMethod_t() { name = "<method_name>"; coord_system = "<coord_system>"; dim = 2; }
 //        ~SolutionMethod_t() {}
-        SolutionMethod_t(QString name_, QString coord_system_) { name = name_; coord_system = coord_system_; }
+        SolutionMethod_t(QString name_, QString coord_system_, int dim_ = 2) { name = name_; coord_system = coord_system_; dim = dim_; }
     };
 }
 
@@ -23,10 +23,44 @@ SOFTWARE.
 
 #include "pde_solver_wave_equation.h"
 #include "../math_module/math_module.h"
+#include "../math_module/vector_math.h"
+
+#include <algorithm>
+#include <limits>
 
-using namespace QtDataVisualization;
 using namespace PdeSolver;
 
+static const char* const ImplicitMethodName = "Crank-Nicolson Symmetric";
+static const char* const ExplicitMethodName = "Leapfrog";
+static const char* const AdiMethodName = "Crank-Nicolson ADI";
+
+/**
+ * The coefficients of the polar Laplacian at the ring i of the ADI scheme: of u(R - 𝛿R), u(R + 𝛿R) and u(F ± 𝛿F) as
+ * differences with u(R, F). They are the finite volume fluxes of the ring, so the radial and the angular parts take
+ * the same radius R_i: the ring is the annulus R_i ± 𝛿R / 2, the center ring (R_i < 𝛿R / 2) is the disk of radius 𝛿R / 2.
+ */
+static void adi_ring_coefs(const PdeSettings& set, int i, double& lower, double& upper, double& angular)
+{
+	const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
+	const PdeSettings::CoordGridSet_t& coordF = *set.get_coord_by_label("F1");
+	const double c2 = double(set.c) * set.c;
+	const double h = coordR.step;
+	const double R_val = coordR.node(i);
+
+	if (R_val < h / 2)
+	{
+		// a sector of the disk: the outer arc is (𝛿R / 2) 𝛿F long and the area is 𝛿R^2 𝛿F / 8, the neighbouring
+		// sectors are 𝛿R / 3 𝛿F apart (at their centroids) across the sides of the length 𝛿R / 2
+		lower = 0;
+		upper = 4 * c2 / (h * h);
+		angular = 12 * c2 / qPow(h * coordF.step, 2);
+		return;
+	}
+	lower = c2 * (R_val - h / 2) / (R_val * h * h);
+	upper = c2 * (R_val + h / 2) / (R_val * h * h);
+	angular = c2 / qPow(R_val * coordF.step, 2);
+}
+
 PdeSolverWaveEquation::PdeSolverWaveEquation() : PdeSolverBase()
 {
 
@@ -40,141 +74,577 @@ PdeSolverWaveEquation::~PdeSolverWaveEquation()
 QVector<SolutionMethod_t> PdeSolverWaveEquation::get_implemented_methods()
 {
 	QVector<SolutionMethod_t> methods;
-	methods.push_back(PdeSolver::SolutionMethod_t("Crank-Nicolson Symmetric", "Polar"));
+	methods.push_back(PdeSolver::SolutionMethod_t(ImplicitMethodName, "Polar"));
+	methods.push_back(PdeSolver::SolutionMethod_t(ExplicitMethodName, "Polar"));
+	methods.push_back(PdeSolver::SolutionMethod_t(AdiMethodName, "Polar"));
 	return methods;
 }
 
+QString PdeSolverWaveEquation::check_stability(const PdeSettings& set, SolutionMethod_t method)
+{
+	const bool adi = (method.name == AdiMethodName);
+	if (adi)
+	{
+		// the rings are periodic: the node after the last one is the first one
+		const PdeSettings::CoordGridSet_t& coordF = *set.get_coord_by_label("F1");
+		if ((coordF.count < 3) || (qAbs(coordF.count * double(coordF.step) - 2 * M_PI) > 1e-3 * 2 * M_PI))
+			return QString("The ADI method needs the F1 grid to cover the circle: F1 count (at least 3) x F1 step = 2π, not %1").arg(coordF.count * coordF.step);
+	}
+	else if (method.name != ExplicitMethodName) return QString();
+
+	const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
+	const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+
+	// the largest row sum (|diagonal| + the off-diagonals) of the radial operator bounds its eigenvalues,
+	// the boundary rows take the missing neighbour as the node itself, as leapfrog_method does.
+	// The factors of the ADI scheme do not commute (𝛬_F grows as 1 / R^2 towards the center), so its radial operator
+	// limits it in the same way, although the F step does not enter it. That operator is symmetric in the ring areas,
+	// so the off-diagonals of its rows are taken as sqrt(upper_(i-1) lower_i) and sqrt(upper_i lower_(i+1)):
+	// the bound is then much closer for the center ring
+	std::vector<double> adi_lower(adi ? coordR.count : 0), adi_upper(adi ? coordR.count : 0);
+	for (int i = 0; i < int(adi_lower.size()); ++i)
+	{
+		double angular = 0;
+		adi_ring_coefs(set, i, adi_lower[i], adi_upper[i], angular);
+	}
+
+	const double c2_R2 = double(set.c) * set.c / (double(coordR.step) * coordR.step);
+	double max_row_sum = 0;
+	for (int i = 0; i < coordR.count; ++i)
+	{
+		if (adi)
+		{
+			double row_sum = 0;
+			if (i > 0) row_sum += adi_lower[i] + qSqrt(adi_upper[i - 1] * adi_lower[i]);
+			if (i < coordR.count - 1) row_sum += adi_upper[i] + qSqrt(adi_upper[i] * adi_lower[i + 1]);
+			max_row_sum = qMax(max_row_sum, row_sum);
+			continue;
+		}
+
+		const double c2_RR = double(set.c) * set.c / (double(coordR.step) * (i + 1) * coordR.step);
+		double diagonal = -2 * c2_R2 - c2_RR;
+		double off_diagonal = 0;
+		if (i > 0) off_diagonal += c2_R2;
+		else diagonal += c2_R2;
+		if (i < coordR.count - 1) off_diagonal += c2_R2 + c2_RR;
+		else diagonal += c2_R2 + c2_RR;
+		max_row_sum = qMax(max_row_sum, qAbs(diagonal) + off_diagonal);
+	}
+
+	// the steps are floats, so a step set right at the limit is not rejected for its rounding
+	const double limit = (max_row_sum > 0) ? 2 / qSqrt(max_row_sum) : std::numeric_limits<double>::infinity();
+	if (coordT.step <= limit * (1 + 1e-6)) return QString();
+
+	return QString("The T step %1 is above the stability limit %2 of the %3 scheme (about %4 𝛿R / c)").arg(coordT.step).arg(limit).arg(adi ? "ADI" : "leapfrog").arg(adi ? 0.86 : 0.89);
+}
+
 void PdeSolverWaveEquation::get_solution(const PdeSettings& set, SolutionMethod_t method)
 {
 	if (method.coord_system != "Polar") throw("This method can be used only in polar coords");
+	if (set.m_Dim != method.dim) throw("The number of the space axes of the grid does not match the method");
+	const bool explicit_scheme = (method.name == ExplicitMethodName);
+	const bool symmetric = (method.name != AdiMethodName);
+	if (!check_stability(set, method).isEmpty()) throw("The settings are outside the stability limits of the method");
+
+	begin_profiling(set);
 
 	const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
 
+	RetentionPolicy_t retention(set.output_every, set.output_max_slices, coordT.count);
+
 	GraphSolution_t solution;
 	solution.set = set;
-	solution.graph_data.u_list.reserve(coordT.count);
-	solution.graph_data.u_t_list.reserve(coordT.count);
 
-	GraphDataSlice_t init_slice = get_initial_conditions_in_polar_coords(set);
-	solution.graph_data.u_list.push_back(init_slice.u);
-	solution.graph_data.u_t_list.push_back(init_slice.u_t);
+	// the symmetric schemes assume the solution does not depend on the angle, so their levels and output slices
+	// are radial profiles (a single column at the first F node), the 2D surface is expanded from them when it is shown
+	PdeSettings::CoordGridSet_t coordF = *set.get_coord_by_label("F1");
+	if (symmetric) coordF.count = 1;
+	GraphDataSlice_t init_slice = get_initial_conditions(set, *set.get_coord_by_label("R"), coordF);
+
+	const int rows = init_slice.u->rows();
+	const int cols = init_slice.u->cols();
+
+	// the scheme needs two levels: u^(n-1) and u^n
+	TimeLevelRing<float> levels(2, rows, cols);
+	Field_t new_u_t(rows, cols);
+
+	Checkpoint_t checkpoint;
+	const bool resumed = read_checkpoint(set, method, checkpoint, 2, rows, cols);
+
+	begin_output(set, solution, rows, cols, true, retention.retained_count(), resumed ? &checkpoint : NULL);
+	if (resumed)
+	{
+		levels.level(0) = checkpoint.levels[0];
+		levels.level(1) = checkpoint.levels[1];
+	}
+	else
+	{
+		output_slice(solution, coordT.min, *init_slice.u, init_slice.u_t.get());
+		levels.level(0) = *init_slice.u;
+	}
+
+	m_ThreadPool.resize(set.threads);
 
-	GraphDataSlice_t new_graph_data_slice;
-	int t_count = 1;
-	for (float t_val = coordT.min + coordT.step; t_val < coordT.max; t_val += coordT.step)
+	for (int t_count = checkpoint.t_count + 1; t_count < coordT.count; ++t_count)
 	{
-		new_graph_data_slice = crank_nicolson_method(set, solution.graph_data, t_count);
+		bool retained = retention.retains(t_count);
+		const Field_t* prev_u = (t_count > 1) ? &levels.level(1) : NULL;
 
-		solution.graph_data.u_list.push_back(new_graph_data_slice.u);
-		solution.graph_data.u_t_list.push_back(new_graph_data_slice.u_t);
+		if (explicit_scheme)
+		{
+			leapfrog_method(set, prev_u, levels.level(0), *init_slice.u_t, levels.next(), retained ? &new_u_t : NULL,
+							coordT.min + t_count * coordT.step);
+		}
+		else if (symmetric)
+		{
+			crank_nicolson_method(set, prev_u, levels.level(0), *init_slice.u_t, levels.next(), retained ? &new_u_t : NULL,
+								  coordT.min + t_count * coordT.step);
+		}
+		else
+		{
+			adi_method(set, prev_u, levels.level(0), *init_slice.u_t, levels.next(), retained ? &new_u_t : NULL,
+					   coordT.min + t_count * coordT.step);
+		}
+		levels.advance();
 
-		emit solution_progress_update("Computing the equation...", int(float(t_count * 100) / coordT.count));
-		++t_count;
+		if (retained)
+		{
+			output_slice(solution, coordT.min + t_count * coordT.step, levels.level(0), &new_u_t);
+		}
+
+		m_Profiler.count(Profiler::TimeSteps);
+
+		// a cancelled solve always leaves a checkpoint to resume from
+		const bool cancelled = cancel_requested();
+		write_checkpoint(set, method, solution, t_count, { &levels.level(0), &levels.level(1) }, cancelled);
+		if (cancelled)
+		{
+			cancel_solution(solution, coordT.min + t_count * coordT.step);
+			return;
+		}
+
+		report_progress("Computing the equation...", int(float(t_count * 100) / coordT.count));
 	}
 
-	emit solution_progress_update("", 100);
+	end_output();
+
+	report_progress("", 100);
+	end_profiling(solution);
 	qDebug() << "PdeSolverWaveEquation: Data generated";
 	emit solution_generated(solution);
 }
 
-GraphDataSlice_t PdeSolverWaveEquation::crank_nicolson_method(const PdeSettings& set, const GraphData_t& graph_data, int t_count)
+void PdeSolverWaveEquation::crank_nicolson_method(const PdeSettings& set, const Field_t* prev_u, const Field_t& cur_u, const Field_t& init_u_t,
+												  Field_t& new_u, Field_t* new_u_t, double t_val)
 {
-	const PdeSettings::CoordGridSet_t& coordF = *set.get_coord_by_label("F1");
 	const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
 	const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
 
-	GraphDataSlice_t cur_graph_data_slice_reversed;
-	cur_graph_data_slice_reversed.u = new QSurfaceDataArray();
-	cur_graph_data_slice_reversed.u_t = new QSurfaceDataArray();
-	cur_graph_data_slice_reversed.u->reserve(coordF.count);
-	cur_graph_data_slice_reversed.u_t->reserve(coordF.count);
+	prepare_operators(set);
 
-	std::vector<float> a(coordR.count, -qPow(set.c, 2) / qPow(coordR.step, 2));
-	std::vector<float> b(coordR.count);
-	std::vector<float> c(coordR.count);
-	std::vector<float> d;
+	if (set.precision == "mixed")
+	{
+		std::vector<double> d(coordR.count);
+		{
+			ScopedTimer timer(m_Profiler, Profiler::RightPart);
+
+			std::vector<float> f_values;
+			right_part(set, t_val, f_values);
+
+			// the explicit part of the method below, with c^2 𝛥u taken on the differences, so the 1 / 𝜏^2 terms are
+			// summed separately and cancel exactly
+			const double inv_t_step2 = 1 / (double(coordT.step) * coordT.step);
+			for (int i = 0; i < coordR.count; ++i)
+			{
+				const double u = cur_u(i, 0);
+				const double u_down = cur_u(qMax(i - 1, 0), 0);
+				const double u_up = cur_u(qMin(i + 1, coordR.count - 1), 0);
+				const double u_prev_t = prev_u ? (*prev_u)(i, 0) : (u - double(coordT.step) * init_u_t(i, 0));
+
+				d[i] = (2 * u - u_prev_t) * inv_t_step2 + double(m_ExplicitLower) * (u_down - u) +
+					double(m_ExplicitUpper[i]) * (u_up - u) + f_values[i];
+			}
+		}
+		{
+			ScopedTimer timer(m_Profiler, Profiler::TridiagonalSolve);
+			m_ImplicitMixed.solve(d.data());
+		}
+
+		store_level(std::vector<float>(d.begin(), d.end()), cur_u, new_u, new_u_t, coordT.step);
+		return;
+	}
 
-	int prev_i = 0, next_i = 0, prev_t_count = (t_count > 0) ? t_count - 1 : 0;
+	int prev_i = 0, next_i = 0;
 	float u_prev_t = 0.0f;
 
-	float z_val = 0.0f, z_val_t = 0.0f, next_R_val = 0, u1, u2, u3, u4;
-	float R_val = coordR.min, F_val = coordF.min;
+	std::vector<float> d(coordR.count);
+	{
+		ScopedTimer timer(m_Profiler, Profiler::RightPart);
 
-	QSurfaceDataRow row;
-	QSurfaceDataRow row_t;
-	d.clear();
-	d.reserve(coordR.count);
-	R_val = coordR.min;
-	next_R_val = 0;
-	for (int i = 0; i < coordR.count; ++i)
+		std::vector<float> f_values;
+		right_part(set, t_val, f_values);
+
+		const float inv_t_step2 = 1 / qPow(coordT.step, 2);
+		for (int i = 0; i < coordR.count; ++i)
+		{
+			if (i == 0) prev_i = i;
+			else prev_i = i - 1;
+			if (i >= coordR.count - 1) next_i = i;
+			else next_i = i + 1;
+
+			// on the first step the previous level is extrapolated with the initial 𝛿u/𝛿t
+			u_prev_t = prev_u ? (*prev_u)(i, 0) : (cur_u(i, 0) - coordT.step * init_u_t(i, 0));
+
+			d[i] = m_ExplicitLower * cur_u(prev_i, 0) + m_ExplicitCenter[i] * cur_u(i, 0) + m_ExplicitUpper[i] * cur_u(next_i, 0) -
+				inv_t_step2 * u_prev_t + f_values[i];
+		}
+	}
 	{
-		if (i == 0) prev_i = i;
-		else prev_i = i - 1;
-		if (i >= coordR.count - 1) next_i = i;
-		else next_i = i + 1;
+		ScopedTimer timer(m_Profiler, Profiler::TridiagonalSolve);
+		m_Implicit.solve(d.data());
+	}
+
+	store_level(d, cur_u, new_u, new_u_t, coordT.step);
+}
+
+void PdeSolverWaveEquation::leapfrog_method(const PdeSettings& set, const Field_t* prev_u, const Field_t& cur_u, const Field_t& init_u_t,
+											Field_t& new_u, Field_t* new_u_t, double t_val)
+{
+	const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
+	const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+	const float t_step = coordT.step;
+	const float t_step2 = t_step * t_step;
+	const int count = coordR.count;
+
+	prepare_operators(set);
 
-		u_prev_t = (prev_t_count > 0) ? graph_data.u_list[prev_t_count - 1]->at(i)->at(0).y() :
-			(graph_data.u_list[0]->at(i)->at(0).y() - coordT.step * graph_data.u_t_list[0]->at(i)->at(0).y());
+	std::vector<float> profile(count);
+	{
+		ScopedTimer timer(m_Profiler, Profiler::RightPart);
 
-		next_R_val += coordR.step;
-		b[i] = 1 / qPow(coordT.step, 2) + 2 * qPow(set.c, 2) / qPow(coordR.step, 2) + qPow(set.c, 2) / (coordR.step * next_R_val);
-		c[i] = -(qPow(set.c, 2) / qPow(coordR.step, 2) + qPow(set.c, 2) / (coordR.step * next_R_val));
+		// f is taken at the current level
+		std::vector<float> f_values;
+		right_part(set, t_val - t_step, f_values);
 
-		u1 = qPow(set.c, 2) / qPow(coordR.step, 2) * graph_data.u_list[prev_t_count]->at(prev_i)->at(0).y();
-		u2 = ((-2 * qPow(set.c, 2) / qPow(coordR.step, 2)) + 2 / qPow(coordT.step, 2) - qPow(set.c, 2) / (coordR.step * next_R_val)) *
-			graph_data.u_list[prev_t_count]->at(i)->at(0).y();
-		u3 = (qPow(set.c, 2) / qPow(coordR.step, 2) + qPow(set.c, 2) / (coordR.step * next_R_val)) * graph_data.u_list[prev_t_count]->at(next_i)->at(0).y();
-		u4 = -(1 / qPow(coordT.step, 2)) * u_prev_t;
+		// the radial profiles (a column of the fields) are gathered to contiguous buffers, so the stencil is vectorized.
+		// The operator is applied to the differences u(R +- 𝛿R) - u(R): the 2 / 𝜏^2 u terms of the explicit part
+		// of Crank-Nicolson would cancel out in float for small steps
+		std::vector<float> u(count), u_prev(count), lap(count);
+		for (int i = 0; i < count; ++i)
+		{
+			u[i] = cur_u(i, 0);
+			u_prev[i] = prev_u ? (*prev_u)(i, 0) : init_u_t(i, 0);
+		}
 
-		d.push_back(u1 + u2 + u3 + u4 + set.f(QVector2D(R_val, F_val), t_count));
-		R_val += coordR.step;
+		// the missing neighbours of the boundary nodes are the nodes themselves
+		const float lower = m_ExplicitLower;
+		const float* upper = m_ExplicitUpper.data();
+		const float* u_data = u.data();
+		float* lap_data = lap.data();
+		lap[0] = (count > 1) ? upper[0] * (u[1] - u[0]) : 0.0f;
+#pragma omp simd
+		for (int i = 1; i < count - 1; ++i) lap_data[i] = lower * (u_data[i - 1] - u_data[i]) + upper[i] * (u_data[i + 1] - u_data[i]);
+		if (count > 1) lap[count - 1] = lower * (u[count - 2] - u[count - 1]);
+
+		const float* u_prev_data = u_prev.data();
+		const float* f_data = f_values.data();
+		float* out = profile.data();
+		if (prev_u)
+		{
+#pragma omp simd
+			for (int i = 0; i < count; ++i) out[i] = 2 * u_data[i] - u_prev_data[i] + t_step2 * (lap_data[i] + f_data[i]);
+		}
+		else
+		{
+			// u_prev holds the initial 𝛿u/𝛿t on the first step
+#pragma omp simd
+			for (int i = 0; i < count; ++i) out[i] = u_data[i] + t_step * u_prev_data[i] + t_step2 / 2 * (lap_data[i] + f_data[i]);
+		}
 	}
-	MathModule::solve_tridiagonal_equation(a, b, c, d, coordR.count);
 
+	store_level(profile, cur_u, new_u, new_u_t, t_step);
+}
 
-	for (int j = 0; j < coordF.count; ++j)
+void PdeSolverWaveEquation::adi_method(const PdeSettings& set, const Field_t* prev_u, const Field_t& cur_u, const Field_t& init_u_t,
+									   Field_t& new_u, Field_t* new_u_t, double t_val)
+{
+	const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
+	const PdeSettings::CoordGridSet_t& coordF = *set.get_coord_by_label("F1");
+	const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+	const float t_step = coordT.step;
+	const int rows = cur_u.rows();
+	const int cols = cur_u.cols();
+
+	prepare_adi_operators(set);
+	const bool mixed = (set.precision == "mixed");
+
+	// the chunks handed to the threads are whole cache lines, so the threads never write to the same line
+	const int lanes = FieldAlignment / sizeof(float);
+
+	// f is taken at the current level
+	Field_t f_field;
+	if (!set.f_is_zero())
 	{
-		QSurfaceDataRow *row = new QSurfaceDataRow();
-		QSurfaceDataRow *row_t = new QSurfaceDataRow();
-		row->reserve(coordR.count);
-		row_t->reserve(coordR.count);
+		std::vector<float> R_nodes = coordR.nodes();
+		std::vector<float> F_nodes = coordF.nodes();
+		f_field.resize(rows, cols);
+		m_ThreadPool.parallel_for(rows, 1, [&](int begin, int end)
+		{
+			ScopedTimer timer(m_Profiler, Profiler::RightPart);
+			set.f_grid(R_nodes.data() + begin, end - begin, F_nodes.data(), cols, t_val - t_step, f_field.row(begin), f_field.stride());
+		});
+	}
 
-		for (int i = 0; i < coordR.count; ++i)
+	// the right part 𝜏^2 (𝛬_R u + 𝛬_F u + f), halved on the first step. As in leapfrog_method the operators are applied
+	// to the differences with the neighbours, the missing radial neighbours are the nodes themselves
+	const float scale = prev_u ? t_step * t_step : t_step * t_step / 2;
+	Field_t delta(rows, cols);
+	m_ThreadPool.parallel_for(rows, 1, [&](int begin, int end)
+	{
+		ScopedTimer timer(m_Profiler, Profiler::RightPart);
+		for (int i = begin; i < end; ++i)
 		{
-			auto& prev_vector = graph_data.u_list[prev_t_count]->at(i)->at(j);
-			z_val = d[i];
-			row->push_back(QVector3D(prev_vector.x(), z_val, prev_vector.z()));
+			const float* u = cur_u.row(i);
+			const float* u_up = cur_u.row((i > 0) ? i - 1 : i);
+			const float* u_down = cur_u.row((i < rows - 1) ? i + 1 : i);
+			const float lower = m_AdiLower[i];
+			const float upper = m_AdiUpper[i];
+			const float angular = m_AngularCoef[i];
+			float* out = delta.row(i);
+
+			// the rings are periodic, so the first and the last nodes take their neighbours from the other end
+			out[0] = angular * (u[cols - 1] + u[1]);
+			out[cols - 1] = angular * (u[cols - 2] + u[0]);
+#pragma omp simd
+			for (int j = 1; j < cols - 1; ++j) out[j] = angular * (u[j - 1] + u[j + 1]);
+#pragma omp simd
+			for (int j = 0; j < cols; ++j) out[j] = scale * (out[j] + lower * (u_up[j] - u[j]) + upper * (u_down[j] - u[j]) - 2 * angular * u[j]);
+
+			if (!f_field.empty())
+			{
+				const float* f = f_field.row(i);
+#pragma omp simd
+				for (int j = 0; j < cols; ++j) out[j] += scale * f[j];
+			}
+		}
+	});
 
-			z_val_t = (z_val - prev_vector.y()) / (coordT.step / 2);
-			row_t->push_back(QVector3D(prev_vector.x(), z_val_t, prev_vector.z()));
+	// the radial lines: the k-th element of every line is in the k-th row, so they are solved in place
+	m_ThreadPool.parallel_for(cols, lanes, [&](int begin, int end)
+	{
+		ScopedTimer timer(m_Profiler, Profiler::TridiagonalSolve);
+		if (mixed) m_AdiRadialMixed.solve_batch(delta.data() + begin, delta.data() + begin, end - begin, delta.stride());
+		else m_AdiRadial.solve_batch(delta.data() + begin, delta.data() + begin, end - begin, delta.stride());
+	});
+
+	// the rings are rows, so they are solved in blocks of `lanes` rings transposed to a tile (a column per ring),
+	// then the block of the new level is formed while it is in cache
+	m_ThreadPool.parallel_for(rows, lanes, [&](int begin, int end)
+	{
+		ScopedTimer timer(m_Profiler, Profiler::TridiagonalSolve);
+		Field_t tile(cols, lanes);
+
+		for (int first = begin; first < end; first += lanes)
+		{
+			const int count = std::min(lanes, end - first);
+
+			MathModule::vector_transpose(delta.row(first), delta.stride(), tile.data(), tile.stride(), count, cols);
+			if (mixed) m_AdiAngularMixed.solve(tile.data(), tile.data(), tile.stride(), first, count);
+			else m_AdiAngular.solve(tile.data(), tile.data(), tile.stride(), first, count);
+			MathModule::vector_transpose(tile.data(), tile.stride(), delta.row(first), delta.stride(), cols, count);
+
+			for (int i = first; i < first + count; ++i)
+			{
+				const float* u = cur_u.row(i);
+				const float* d = delta.row(i);
+				float* u_new = new_u.row(i);
+				if (prev_u && mixed)
+				{
+					const float* u_prev = prev_u->row(i);
+					for (int j = 0; j < cols; ++j) u_new[j] = 2.0 * u[j] - u_prev[j] + d[j];
+				}
+				else if (prev_u)
+				{
+					const float* u_prev = prev_u->row(i);
+					for (int j = 0; j < cols; ++j) u_new[j] = 2 * u[j] - u_prev[j] + d[j];
+				}
+				else
+				{
+					const float* u_t = init_u_t.row(i);
+					for (int j = 0; j < cols; ++j) u_new[j] = u[j] + t_step * u_t[j] + d[j];
+				}
+
+				if (new_u_t)
+				{
+					float* row_t = new_u_t->row(i);
+					for (int j = 0; j < cols; ++j) row_t[j] = (u_new[j] - u[j]) / t_step;
+				}
+			}
 		}
-		cur_graph_data_slice_reversed.u->push_back(row);
-		cur_graph_data_slice_reversed.u_t->push_back(row_t);
+	});
+}
+
+void PdeSolverWaveEquation::right_part(const PdeSettings& set, double t_val, std::vector<float>& f_values)
+{
+	const PdeSettings::CoordGridSet_t& coordF = *set.get_coord_by_label("F1");
+	const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
+
+	// the solution is symmetric, so F is fixed
+	f_values.assign(coordR.count, 0.0f);
+	if (set.f_is_zero()) return;
+
+	std::vector<float> R_nodes = coordR.nodes();
+	std::vector<float> F_nodes(coordR.count, coordF.min);
+	set.f(R_nodes.data(), F_nodes.data(), t_val, f_values.data(), coordR.count);
+}
+
+void PdeSolverWaveEquation::store_level(const std::vector<float>& profile, const Field_t& cur_u, Field_t& new_u, Field_t* new_u_t, float t_step)
+{
+	for (int i = 0; i < int(profile.size()); ++i)
+	{
+		new_u(i, 0) = profile[i];
+		if (new_u_t) (*new_u_t)(i, 0) = (profile[i] - cur_u(i, 0)) / t_step;
 	}
+}
+
+void PdeSolverWaveEquation::prepare_operators(const PdeSettings& set)
+{
+	const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
+	const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+
+	const bool mixed = (set.precision == "mixed");
 
-	// Reversing the slice:
-	GraphDataSlice_t cur_graph_data_slice;
-	cur_graph_data_slice.u = new QSurfaceDataArray();
-	cur_graph_data_slice.u_t = new QSurfaceDataArray();
-	cur_graph_data_slice.u->reserve(coordR.count);
-	cur_graph_data_slice.u_t->reserve(coordR.count);
+	std::vector<double> key = { set.c, coordR.step, double(coordR.count), coordT.step, double(mixed) };
+	if (key == m_OperatorsKey) return;
+
+	const float c2_R2 = qPow(set.c, 2) / qPow(coordR.step, 2);
+	std::vector<float> a(coordR.count, -c2_R2);
+	std::vector<float> b(coordR.count);
+	std::vector<float> c(coordR.count);
+
+	m_ExplicitLower = c2_R2;
+	m_ExplicitCenter.resize(coordR.count);
+	m_ExplicitUpper.resize(coordR.count);
 
 	for (int i = 0; i < coordR.count; ++i)
 	{
-		QSurfaceDataRow *row = new QSurfaceDataRow();
-		QSurfaceDataRow *row_t = new QSurfaceDataRow();
-		row->reserve(coordF.count);
-		row_t->reserve(coordF.count);
+		float next_R_val = (i + 1) * coordR.step;
+		float c2_RR = qPow(set.c, 2) / (coordR.step * next_R_val);
+
+		b[i] = 1 / qPow(coordT.step, 2) + 2 * c2_R2 + c2_RR;
+		c[i] = -(c2_R2 + c2_RR);
 
-		for (int j = 0; j < coordF.count; ++j)
+		m_ExplicitCenter[i] = -2 * c2_R2 + 2 / qPow(coordT.step, 2) - c2_RR;
+		m_ExplicitUpper[i] = c2_R2 + c2_RR;
+	}
+
+	if (mixed)
+	{
+		// the same operator with the 1 / 𝜏^2 term added in fp64
+		const double inv_t_step2 = 1 / (double(coordT.step) * coordT.step);
+		std::vector<double> a_mixed(coordR.count, -double(m_ExplicitLower));
+		std::vector<double> b_mixed(coordR.count);
+		std::vector<double> c_mixed(coordR.count);
+		for (int i = 0; i < coordR.count; ++i)
 		{
-			auto& reversed_vector = cur_graph_data_slice_reversed.u->at(j)->at(i);
-			row->push_back(QVector3D(reversed_vector.x(), reversed_vector.y(), reversed_vector.z()));
+			b_mixed[i] = inv_t_step2 + double(m_ExplicitLower) + double(m_ExplicitUpper[i]);
+			c_mixed[i] = -double(m_ExplicitUpper[i]);
 		}
-		cur_graph_data_slice.u->push_back(row);
-		cur_graph_data_slice.u_t->push_back(row_t);
+		m_ImplicitMixed.factorize(a_mixed.data(), b_mixed.data(), c_mixed.data(), coordR.count);
+		m_Implicit.clear();
+	}
+	else
+	{
+		m_Implicit.factorize(a.data(), b.data(), c.data(), coordR.count);
+		m_ImplicitMixed.clear();
+	}
+
+	m_OperatorsKey = key;
+}
+
+void PdeSolverWaveEquation::prepare_adi_operators(const PdeSettings& set)
+{
+	const PdeSettings::CoordGridSet_t& coordR = *set.get_coord_by_label("R");
+	const PdeSettings::CoordGridSet_t& coordF = *set.get_coord_by_label("F1");
+	const PdeSettings::CoordGridSet_t& coordT = *set.get_coord_by_label("T");
+
+	const bool mixed = (set.precision == "mixed");
+
+	std::vector<double> key = { set.c, coordR.min, coordR.step, double(coordR.count), coordF.step, double(coordF.count), coordT.step,
+								double(mixed) };
+	if (key == m_AdiKey) return;
+
+	const int rows = coordR.count;
+	const int cols = coordF.count;
+	const float theta = qPow(coordT.step, 2) / 4;
+
+	// the coefficients of every ring, from a single radius of the ring
+	m_AdiLower.resize(rows);
+	m_AdiUpper.resize(rows);
+	m_AngularCoef.resize(rows);
+	for (int i = 0; i < rows; ++i)
+	{
+		double lower = 0, upper = 0, angular = 0;
+		adi_ring_coefs(set, i, lower, upper, angular);
+		m_AdiLower[i] = lower;
+		m_AdiUpper[i] = upper;
+		m_AngularCoef[i] = angular;
+	}
+
+	// I - 𝜏^2 / 4 𝛬_R, the missing neighbours of the boundary nodes are the nodes themselves
+	std::vector<float> a(rows, 0.0f), b(rows), c(rows, 0.0f);
+	std::vector<double> a_mixed(rows, 0.0), b_mixed(rows), c_mixed(rows, 0.0);
+	for (int i = 0; i < rows; ++i)
+	{
+		if (i > 0) a[i] = -theta * m_AdiLower[i];
+		if (i < rows - 1) c[i] = -theta * m_AdiUpper[i];
+		b[i] = 1 - a[i] - c[i];
+
+		if (i > 0) a_mixed[i] = -double(theta) * m_AdiLower[i];
+		if (i < rows - 1) c_mixed[i] = -double(theta) * m_AdiUpper[i];
+		b_mixed[i] = 1 - a_mixed[i] - c_mixed[i];
+	}
+	if (mixed)
+	{
+		m_AdiRadialMixed.factorize(a_mixed.data(), b_mixed.data(), c_mixed.data(), rows);
+		m_AdiRadial.clear();
+	}
+	else
+	{
+		m_AdiRadial.factorize(a.data(), b.data(), c.data(), rows);
+		m_AdiRadialMixed.clear();
+	}
+
+	// I - 𝜏^2 / 4 𝛬_F for every ring, interleaved by the ring. The center sectors are strongly coupled, which evens out
+	// the values at the center
+	std::vector<float> a_F(mixed ? 0 : size_t(rows) * cols), b_F(mixed ? 0 : size_t(rows) * cols);
+	std::vector<double> a_F_mixed(mixed ? size_t(rows) * cols : 0), b_F_mixed(mixed ? size_t(rows) * cols : 0);
+	for (int i = 0; i < rows; ++i)
+	{
+		for (int k = 0; k < cols; ++k)
+		{
+			if (mixed)
+			{
+				a_F_mixed[size_t(k) * rows + i] = -double(theta) * m_AngularCoef[i];
+				b_F_mixed[size_t(k) * rows + i] = 1 + 2 * double(theta) * m_AngularCoef[i];
+			}
+			else
+			{
+				a_F[size_t(k) * rows + i] = -theta * m_AngularCoef[i];
+				b_F[size_t(k) * rows + i] = 1 + 2 * theta * m_AngularCoef[i];
+			}
+		}
+	}
+	if (mixed)
+	{
+		m_AdiAngularMixed.factorize(a_F_mixed.data(), b_F_mixed.data(), a_F_mixed.data(), cols, rows);
+		m_AdiAngular.clear();
+	}
+	else
+	{
+		m_AdiAngular.factorize(a_F.data(), b_F.data(), a_F.data(), cols, rows);
+		m_AdiAngularMixed.clear();
 	}
-	clear_graph_data_slice(cur_graph_data_slice_reversed);
 
-	return cur_graph_data_slice;
+	m_AdiKey = key;
 }
@@ -25,6 +25,8 @@
 #define PDE_SOLVER_WAVE_EQUATION_H
 
 #include "pde_solver_base.h"
+#include "pde_thread_pool.h"
+#include "../math_module/math_module.h"
 
 /**
  * @brief A class for solving the 2d wave equation.
@@ -39,11 +41,92 @@ public:
 
     virtual QVector<PdeSolver::SolutionMethod_t> get_implemented_methods();
 
+    /**
+     * @brief The leapfrog scheme is stable while 𝜏^2 times the largest eigenvalue of the radial operator is at most 4
+     * (the eigenvalue is bounded by the largest row sum, c 𝜏 / 𝛿R <= 2 / sqrt(5) near the center), Crank-Nicolson always.
+     * The ADI method has the limit of leapfrog (whatever the F1 step is) and its angular grid is periodic, so it must cover
+     * the circle (F1 count x F1 step = 2π).
+     */
+    virtual QString check_stability(const PdeSettings& set, PdeSolver::SolutionMethod_t method);
+
 public slots:
     virtual void get_solution(const PdeSettings& set, PdeSolver::SolutionMethod_t method);
 
 protected:
-    PdeSolver::GraphDataSlice_t crank_nicolson_method(const PdeSettings& set, const PdeSolver::GraphData_t& graph_data, int t_count);
+    /**
+     * @brief A step of the center-symmetric Crank-Nicolson scheme. The levels are radial profiles (R.count x 1 fields),
+     * only their first column is used.
+     * @param prev_u the level before cur_u (NULL on the first step, then the level is extrapolated with init_u_t)
+     * @param new_u_t the 𝛿u/𝛿t output (not computed if NULL)
+     * @param t_val the time of the new level
+     *
+     * With the "mixed" precision the explicit part is summed and the system is solved in fp64: the terms 2 u / 𝜏^2
+     * and u^(n-1) / 𝜏^2 nearly cancel, which costs fp32 its accuracy for small T steps.
+     */
+    void crank_nicolson_method(const PdeSettings& set, const PdeSolver::Field_t* prev_u, const PdeSolver::Field_t& cur_u, const PdeSolver::Field_t& init_u_t,
+                               PdeSolver::Field_t& new_u, PdeSolver::Field_t* new_u_t, double t_val);
+
+    /**
+     * @brief A step of the explicit leapfrog scheme: u^(n+1) = 2 u^n - u^(n-1) + 𝜏^2 (c^2 𝛥u^n + f), with the radial
+     * operator of crank_nicolson_method. The parameters are the ones of crank_nicolson_method.
+     *
+     * The first step is u^1 = u^0 + 𝜏 𝛿u/𝛿t + 𝜏^2 / 2 (c^2 𝛥u^0 + f), so the scheme stays second order.
+     */
+    void leapfrog_method(const PdeSettings& set, const PdeSolver::Field_t* prev_u, const PdeSolver::Field_t& cur_u, const PdeSolver::Field_t& init_u_t,
+                         PdeSolver::Field_t& new_u, PdeSolver::Field_t* new_u_t, double t_val);
+
+    /**
+     * @brief A step of the ADI scheme on the whole polar grid (the solution may depend on the angle):
+     * (I - 𝜏^2 / 4 𝛬_R)(I - 𝜏^2 / 4 𝛬_F) 𝛿 = 𝜏^2 (c^2 𝛥u^n + f), u^(n+1) = 2 u^n - u^(n-1) + 𝛿, where 𝛬_R is the radial operator
+     * of leapfrog_method and 𝛬_F = c^2 / R^2 𝛿^2/𝛿F^2 is periodic in F (the center ring is taken at R = 𝛿R / 2).
+     * The scheme is second order. The parameters are the ones of crank_nicolson_method,
+     * but the levels are R.count x F1.count fields.
+     *
+     * The first step is u^1 = u^0 + 𝜏 𝛿u/𝛿t + 𝛿 / 2. The radial lines are solved in place (the field is their interleaved
+     * layout), the rings in blocks transposed to tiles, by MathModule::CyclicTridiagonalBatch; both are split across m_ThreadPool.
+     */
+    void adi_method(const PdeSettings& set, const PdeSolver::Field_t* prev_u, const PdeSolver::Field_t& cur_u, const PdeSolver::Field_t& init_u_t,
+                    PdeSolver::Field_t& new_u, PdeSolver::Field_t* new_u_t, double t_val);
+
+    /**
+     * @brief f along the radius at t_val.
+     */
+    void right_part(const PdeSettings& set, double t_val, std::vector<float>& f_values);
+
+    /**
+     * @brief Stores the radial profile to the first column of new_u and computes 𝛿u/𝛿t if new_u_t is not NULL.
+     */
+    void store_level(const std::vector<float>& profile, const PdeSolver::Field_t& cur_u, PdeSolver::Field_t& new_u, PdeSolver::Field_t* new_u_t, float t_step);
+
+    /**
+     * @brief Factorizes the implicit operator and computes the coefficients of the explicit part. The cached ones
+     * are kept while c, the R and T steps, the R size and the precision stay the same. Only the operator of
+     * the precision of the settings is factorized.
+     */
+    void prepare_operators(const PdeSettings& set);
+
+    /**
+     * @brief Factorizes the radial and the angular operators of adi_method (cached like prepare_operators).
+     */
+    void prepare_adi_operators(const PdeSettings& set);
+
+private:
+    std::vector<double> m_OperatorsKey;                      /**< the settings the operators were built for */
+    MathModule::TridiagonalFactorization<float> m_Implicit;  /**< the operator of the new level */
+    MathModule::TridiagonalFactorization<double> m_ImplicitMixed;  /**< m_Implicit in fp64, for the "mixed" precision */
+    float m_ExplicitLower = 0.0f;                            /**< the coefficient of u(R - 𝛿R) in the explicit part */
+    std::vector<float> m_ExplicitCenter;                     /**< the coefficients of u(R) in the explicit part */
+    std::vector<float> m_ExplicitUpper;                      /**< the coefficients of u(R + 𝛿R) in the explicit part */
+
+    std::vector<double> m_AdiKey;                            /**< the settings the ADI operators were built for */
+    MathModule::TridiagonalFactorization<float> m_AdiRadial; /**< I - 𝜏^2 / 4 𝛬_R */
+    MathModule::CyclicTridiagonalBatch<float> m_AdiAngular;  /**< I - 𝜏^2 / 4 𝛬_F, a matrix per ring */
+    MathModule::TridiagonalFactorization<float, double> m_AdiRadialMixed; /**< m_AdiRadial eliminated in fp64 */
+    MathModule::CyclicTridiagonalBatch<float, double> m_AdiAngularMixed;  /**< m_AdiAngular eliminated in fp64 */
+    std::vector<float> m_AdiLower;                           /**< the coefficient of u(R - 𝛿R) of every ring in adi_method */
+    std::vector<float> m_AdiUpper;                           /**< the coefficient of u(R + 𝛿R) of every ring in adi_method */
+    std::vector<float> m_AngularCoef;                        /**< c^2 / (R 𝛿F)^2 of every ring (see adi_ring_coefs) */
+    PdeSolver::ThreadPool m_ThreadPool;                      /**< the workers the lines and rings of adi_method are split across */
 };
 
 #endif // PDE_SOLVER_WAVE_EQUATION_H
@@ -0,0 +1,272 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "pde_sweep.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QJsonArray>
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+#include "pde_thread_pool.h"
+
+using namespace PdeSolver;
+
+Sweep::Sweep(const PdeSettings& base, const QVariantMap& description) :
+    m_CancelRequested(false)
+{
+    const QVariantMap base_map = base.toQVariantMap();
+    QList<QVariantMap> overrides = expand(description);
+
+    for (int i = 0; i < overrides.size(); ++i)
+    {
+        // a misspelled entry would be ignored by PdeSettings::reset, and the run would silently solve the base problem
+        for (QVariantMap::const_iterator iter = overrides[i].begin(); iter != overrides[i].end(); ++iter)
+        {
+            if (!base_map.contains(iter.key()) && !iter.key().startsWith("count") && !iter.key().startsWith("step"))
+                throw std::invalid_argument("Unknown settings entry \"" + iter.key().toStdString() + "\" in the sweep");
+        }
+
+        SweepRun_t run;
+        run.index = i;
+        run.overrides = overrides[i];
+
+        // the runs are copies of the base, so the expressions they do not override are not compiled again
+        PdeSettings set(base);
+        try
+        {
+            QVariantMap map = base_map;
+            for (QVariantMap::const_iterator iter = overrides[i].begin(); iter != overrides[i].end(); ++iter) map.insert(iter.key(), iter.value());
+            set.reset(map);
+            run.predicted_cost = predicted_cost(set);
+        }
+        catch (const char* msg)
+        {
+            run.status = "failed";
+            run.error = msg;
+        }
+        catch (const std::exception& e)
+        {
+            run.status = "failed";
+            run.error = e.what();
+        }
+
+        m_Runs.push_back(run);
+        m_Settings.push_back(set);
+        if (run.status == "pending") m_Order.push_back(i);
+    }
+
+    // the longest runs first: the short ones then fill the gaps at the end of the sweep
+    std::stable_sort(m_Order.begin(), m_Order.end(),
+                     [this](int a, int b) { return m_Runs[a].predicted_cost > m_Runs[b].predicted_cost; });
+}
+
+QList<QVariantMap> Sweep::expand(const QVariantMap& description)
+{
+    QList<QVariantMap> runs;
+    if (description.contains("runs"))
+    {
+        for (const QVariant& run : description["runs"].toList()) runs.push_back(run.toMap());
+    }
+    if (runs.isEmpty()) runs.push_back(QVariantMap());
+
+    QVariantMap grid = description["grid"].toMap();
+    for (QVariantMap::const_iterator iter = grid.begin(); iter != grid.end(); ++iter)
+    {
+        QVariantList values = iter.value().toList();
+        if (values.isEmpty()) throw std::invalid_argument("The sweep grid entry \"" + iter.key().toStdString() + "\" must be a non-empty list");
+
+        // the Cartesian product: every run so far is repeated for every value (the last grid entry changes the fastest)
+        QList<QVariantMap> expanded;
+        for (const QVariantMap& run : runs)
+        {
+            for (const QVariant& value : values)
+            {
+                QVariantMap expanded_run = run;
+                expanded_run.insert(iter.key(), value);
+                expanded.push_back(expanded_run);
+            }
+        }
+        runs = expanded;
+    }
+
+    return runs;
+}
+
+double Sweep::predicted_cost(const PdeSettings& set)
+{
+    double cost = 1;
+    for (const auto& coord : set.m_Coords) cost *= std::max(1, coord.count);
+    return cost;
+}
+
+void Sweep::run(const SolverFactory_t& make_solver, const SolutionMethod_t& method, const QString& output_dir, int jobs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const int hardware_threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    m_Jobs = std::max(1, std::min((jobs > 0) ? jobs : hardware_threads, int(m_Order.size())));
+    const int run_threads = std::max(1, hardware_threads / m_Jobs);
+
+    QDir dir(output_dir);
+    if (!dir.mkpath(".")) throw("Cannot create the sweep output directory");
+
+    SweepRun_t* runs = m_Runs.data();
+    PdeSettings* settings = m_Settings.data();
+    for (int i : m_Order)
+    {
+        PdeSettings& set = settings[i];
+        const bool compressed = (set.compression != "none");
+        runs[i].output_file = dir.filePath("run_" + QString::number(i).rightJustified(3, '0') + (compressed ? ".pdesnap" : ".pdesol"));
+        set.output_file = compressed ? QString() : runs[i].output_file;
+        set.trace_file.clear();
+        set.checkpoint_file.clear();
+        set.resume = false;
+        if (!runs[i].overrides.contains("threads")) set.threads = run_threads;
+    }
+
+    // every worker takes the next run of the cost order when it is done with one, so the work is balanced
+    // however much the predicted costs are off
+    std::atomic<int> next(0);
+    const int count = m_Order.size();
+    ThreadPool pool(m_Jobs);
+    pool.parallel_for(pool.size(), 1, [&](int, int)
+    {
+        for (int k = next.fetch_add(1); k < count; k = next.fetch_add(1))
+        {
+            const int i = m_Order[k];
+            solve_run(runs[i], settings[i], make_solver, method);
+        }
+    });
+
+    m_WallMs = timer.elapsed();
+}
+
+void Sweep::solve_run(SweepRun_t& run, const PdeSettings& set, const SolverFactory_t& make_solver, const SolutionMethod_t& method)
+{
+    if (m_CancelRequested.load(std::memory_order_relaxed))
+    {
+        run.status = "skipped";
+        run.output_file.clear();
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // nothing may escape: this runs in a pool thread
+    try
+    {
+        std::shared_ptr<PdeSolverBase> solver = make_solver();
+        QString stability_error = solver->check_stability(set, method);
+        if (!stability_error.isEmpty())
+        {
+            run.status = "failed";
+            run.error = stability_error;
+            run.output_file.clear();
+            return;
+        }
+
+        // the solver lives in this thread, so solve() runs get_solution() and emits the result right away
+        GraphSolution_t solution;
+        bool cancelled = false;
+        QString solve_error;
+        PdeSolverBase* running_solver = solver.get();
+        QObject::connect(running_solver, &PdeSolverBase::solution_generated,
+                         [&solution](GraphSolution_t generated) { solution = generated; });
+        QObject::connect(running_solver, &PdeSolverBase::solution_failed, [&solve_error](QString error) { solve_error = error; });
+        // the solvers report the progress on every step, so a cancel of the sweep reaches them there
+        QObject::connect(running_solver, &PdeSolverBase::solution_progress_update, [this, &run, &cancelled, running_solver](QString text, int)
+        {
+            run.progress = text;
+            if (!cancelled && m_CancelRequested.load(std::memory_order_relaxed))
+            {
+                cancelled = true;
+                running_solver->cancel();
+            }
+        });
+        solver->solve(set, method);
+        if (!solve_error.isEmpty())
+        {
+            run.status = "failed";
+            run.error = solve_error;
+            run.solve_ms = timer.elapsed();
+            return;
+        }
+
+        if (set.output_file.isEmpty() && solution.graph_data.store) solution.graph_data.store->save(run.output_file, solution.set);
+        run.slices = solution.graph_data.t_list.size();
+        run.status = cancelled ? "cancelled" : "done";
+    }
+    catch (const char* msg)
+    {
+        run.status = "failed";
+        run.error = msg;
+    }
+    catch (const std::exception& e)
+    {
+        run.status = "failed";
+        run.error = e.what();
+    }
+    catch (...)
+    {
+        run.status = "failed";
+        run.error = "Unknown error";
+    }
+
+    run.solve_ms = timer.elapsed();
+}
+
+QJsonObject Sweep::summary() const
+{
+    QJsonArray runs;
+    QVariantMap counts;
+    for (const SweepRun_t& run : m_Runs)
+    {
+        QJsonObject item;
+        item.insert("index", run.index);
+        item.insert("overrides", QJsonObject::fromVariantMap(run.overrides));
+        item.insert("predictedCost", run.predicted_cost);
+        item.insert("status", run.status);
+        if (!run.error.isEmpty()) item.insert("error", run.error);
+        if (!run.output_file.isEmpty()) item.insert("outputFile", run.output_file);
+        if (!run.progress.isEmpty()) item.insert("progress", run.progress);
+        item.insert("slices", run.slices);
+        item.insert("solveMs", run.solve_ms);
+        runs.append(item);
+
+        counts.insert(run.status, counts.value(run.status).toInt() + 1);
+    }
+
+    QJsonObject summary;
+    summary.insert("runs", runs);
+    summary.insert("counts", QJsonObject::fromVariantMap(counts));
+    summary.insert("jobs", m_Jobs);
+    summary.insert("wallMs", m_WallMs);
+    return summary;
+}
@@ -0,0 +1,122 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_SWEEP_H
+#define PDE_SWEEP_H
+
+#include <QList>
+#include <QVector>
+#include <QString>
+#include <QVariantMap>
+#include <QJsonObject>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "pde_solver_base.h"
+
+namespace PdeSolver
+{
+    /**
+     * @brief A run of a parameter sweep: the settings overrides and what came of them.
+     */
+    struct SweepRun_t
+    {
+        int index = 0;                  /**< The position of the run in the sweep description (the runs are solved in another order) */
+        QVariantMap overrides;          /**< The settings entries (in the format of PdeSettings::toQVariantMap) that differ from the base */
+        double predicted_cost = 0;      /**< The number of grid nodes times the number of time levels */
+        QString output_file;            /**< The solution file or the snapshot store of the run */
+        QString status = "pending";     /**< done, cancelled, failed or skipped (the sweep was cancelled before the run started) */
+        QString error;                  /**< Why the run failed */
+        QString progress;               /**< The last progress text of the solver */
+        int slices = 0;                 /**< The number of the output time slices */
+        qint64 solve_ms = 0;
+    };
+
+    typedef std::function<std::shared_ptr<PdeSolverBase>()> SolverFactory_t;
+
+    /**
+     * @brief Solves one equation for many variants of the settings at once.
+     *
+     * The runs are independent solves, so the sweep runs several of them at the same time, each with a share of the threads:
+     * for a sweep of small grids that keeps all the cores busy, which splitting the grid lines of a single solve cannot.
+     * The runs start in the order of their predicted cost (the largest first) and every worker takes the next run as soon
+     * as its previous one is done, so a long run does not end up last while the other workers are idle.
+     */
+    class Sweep
+    {
+    public:
+        /**
+         * @param base the settings the overrides of the runs are applied to
+         * @param description "runs": a list of override maps (one run each, by default a single run without overrides) and
+         * "grid": a map of a settings entry to a list of values; every run is repeated for every combination of the grid values
+         */
+        Sweep(const PdeSettings& base, const QVariantMap& description);
+
+        /**
+         * @brief Expands a sweep description into the override maps of the runs (see Sweep(const PdeSettings&, const QVariantMap&)).
+         */
+        static QList<QVariantMap> expand(const QVariantMap& description);
+
+        /**
+         * @brief The cost model the runs are ordered by: the number of grid nodes times the number of time levels.
+         */
+        static double predicted_cost(const PdeSettings& set);
+
+        /**
+         * @brief Solves the runs and writes their solutions to output_dir (run_000.pdesol etc., .pdesnap if compressed).
+         *
+         * The checkpoint and the trace files of the base settings are not used (the runs would write the same file).
+         * @param make_solver creates a solver of the equation (a run gets its own solver in the thread it is solved in)
+         * @param jobs the number of runs solved at the same time, 0 means one per hardware thread.
+         * The hardware threads are split between them, unless a run sets "threads" itself.
+         */
+        void run(const SolverFactory_t& make_solver, const SolutionMethod_t& method, const QString& output_dir, int jobs = 0);
+
+        /**
+         * @brief Cancels the running solves and skips the runs that have not started (only sets an atomic flag,
+         * so it can be called from any thread or a signal handler).
+         */
+        void cancel() { m_CancelRequested.store(true, std::memory_order_relaxed); }
+
+        const QVector<SweepRun_t>& runs() const { return m_Runs; }
+
+        /**
+         * @brief The runs (in the order of the description) and the totals, for writing summary.json.
+         */
+        QJsonObject summary() const;
+
+    private:
+        void solve_run(SweepRun_t& run, const PdeSettings& set, const SolverFactory_t& make_solver, const SolutionMethod_t& method);
+
+        QVector<SweepRun_t> m_Runs;
+        QVector<PdeSettings> m_Settings;    /**< The settings of the runs (invalid overrides fail the run) */
+        QList<int> m_Order;                 /**< The indexes of the runs by the predicted cost, the largest first */
+        std::atomic<bool> m_CancelRequested;
+        qint64 m_WallMs = 0;
+        int m_Jobs = 0;
+    };
+}
+
+#endif // PDE_SWEEP_H
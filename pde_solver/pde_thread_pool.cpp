@@ -0,0 +1,116 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#include "pde_thread_pool.h"
+
+#include <algorithm>
+
+using namespace PdeSolver;
+
+ThreadPool::ThreadPool(int threads)
+{
+    resize(threads);
+}
+
+ThreadPool::~ThreadPool()
+{
+    resize(1);
+}
+
+void ThreadPool::resize(int threads)
+{
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    if (threads == size()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_StartCondition.notify_all();
+    for (auto& worker : m_Workers) worker.join();
+    m_Workers.clear();
+
+    m_Stop = false;
+    for (int i = 1; i < threads; ++i) m_Workers.emplace_back(&ThreadPool::worker_loop, this, i, m_Generation);
+}
+
+void ThreadPool::parallel_for(int count, int granularity, const std::function<void(int, int)>& task)
+{
+    if (count <= 0) return;
+
+    if (m_Workers.empty() || count <= granularity)
+    {
+        task(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Task = &task;
+        m_Count = count;
+        m_Granularity = std::max(1, granularity);
+        m_Pending = int(m_Workers.size());
+        ++m_Generation;
+    }
+    m_StartCondition.notify_all();
+
+    run_chunk(0);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_DoneCondition.wait(lock, [this] { return m_Pending == 0; });
+    m_Task = nullptr;
+}
+
+void ThreadPool::worker_loop(int index, unsigned generation)
+{
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_StartCondition.wait(lock, [&] { return m_Stop || m_Generation != generation; });
+            if (m_Stop) return;
+            generation = m_Generation;
+        }
+
+        run_chunk(index);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            --m_Pending;
+        }
+        m_DoneCondition.notify_one();
+    }
+}
+
+void ThreadPool::run_chunk(int index)
+{
+    // the range is split into blocks of m_Granularity and the blocks are distributed evenly
+    const int threads = size();
+    const int blocks = (m_Count + m_Granularity - 1) / m_Granularity;
+    const int begin_block = int((long long)blocks * index / threads);
+    const int end_block = int((long long)blocks * (index + 1) / threads);
+
+    const int begin = std::min(m_Count, begin_block * m_Granularity);
+    const int end = std::min(m_Count, end_block * m_Granularity);
+    if (begin < end) (*m_Task)(begin, end);
+}
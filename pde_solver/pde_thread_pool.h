@@ -0,0 +1,82 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_THREAD_POOL_H
+#define PDE_THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PdeSolver
+{
+    /**
+     * @brief A fixed pool of worker threads for splitting a loop over independent grid lines.
+     *
+     * parallel_for splits a range into one contiguous chunk per thread, the calling thread takes the first chunk.
+     * It returns only when all the chunks are done, so consecutive calls are separated by a barrier
+     * (e.g. the two half-steps of an ADI scheme).
+     */
+    class ThreadPool
+    {
+    public:
+        /**
+         * @param threads the number of threads including the calling one, 0 means one per hardware thread
+         */
+        explicit ThreadPool(int threads = 1);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        int size() const { return int(m_Workers.size()) + 1; }  /**< The number of threads including the calling one */
+        void resize(int threads);
+
+        /**
+         * @brief Calls task(begin, end) for the chunks of [0, count) and waits for all of them.
+         * @param granularity the chunk boundaries are multiples of it (e.g. a cache line worth of columns,
+         * so that the threads never write to the same cache line)
+         */
+        void parallel_for(int count, int granularity, const std::function<void(int, int)>& task);
+
+    private:
+        void worker_loop(int index, unsigned generation);
+        void run_chunk(int index);
+
+        std::vector<std::thread> m_Workers;
+        std::mutex m_Mutex;
+        std::condition_variable m_StartCondition;
+        std::condition_variable m_DoneCondition;
+
+        const std::function<void(int, int)>* m_Task = nullptr;
+        int m_Count = 0;
+        int m_Granularity = 1;
+        unsigned m_Generation = 0;  /**< Incremented for every parallel_for, the workers wait for a new value */
+        int m_Pending = 0;          /**< The number of workers that have not finished the current chunk yet */
+        bool m_Stop = false;
+    };
+}
+
+#endif // PDE_THREAD_POOL_H
@@ -0,0 +1,98 @@
+/*
+    Copyright (c) 2017 Oleg Yablokov
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+**/
+
+#ifndef PDE_TIME_LEVELS_H
+#define PDE_TIME_LEVELS_H
+
+#include <algorithm>
+#include <vector>
+
+#include "pde_field.h"
+
+namespace PdeSolver
+{
+    /**
+     * @brief A fixed set of time levels the schemes work on (e.g. u^n and u^(n+1) for ADI, u^(n-1), u^n and u^(n+1) for Crank-Nicolson).
+     *
+     * The buffers are allocated once and then reused in a ring, so the working memory does not depend on the number of time steps.\n
+     * level(0) is the newest level, level(1) the one before it etc. A new level is written to next() and becomes level(0) after advance().
+     */
+    template <typename Scalar>
+    class TimeLevelRing
+    {
+    public:
+        TimeLevelRing(int levels, int rows, int cols) : m_Levels(levels + 1)
+        {
+            for (auto& level : m_Levels) level.resize(rows, cols);
+        }
+
+        int size() const { return int(m_Levels.size()) - 1; }     /**< The number of levels kept (not counting next()) */
+
+        GridField<Scalar>& level(int back) { return m_Levels[index(back)]; }
+        const GridField<Scalar>& level(int back) const { return m_Levels[index(back)]; }
+
+        GridField<Scalar>& next() { return m_Levels[index(-1)]; }
+
+        void advance() { m_Head = index(-1); }
+
+    private:
+        int index(int back) const
+        {
+            int n = int(m_Levels.size());
+            return ((m_Head - back) % n + n) % n;
+        }
+
+        std::vector<GridField<Scalar> > m_Levels;
+        int m_Head = 0;
+    };
+
+    /**
+     * @brief Decides which time levels go to the output.
+     *
+     * Every stride-th level and the last one are retained. The stride is the one set by the user
+     * or a larger one if the number of output slices is limited.
+     */
+    struct RetentionPolicy_t
+    {
+        int stride = 1;
+        int last = 0;       /**< The index of the last time level */
+
+        RetentionPolicy_t() {}
+        RetentionPolicy_t(int every, int max_slices, int level_count)
+        {
+            last = level_count - 1;
+            stride = (every > 1) ? every : 1;
+            if ((max_slices > 1) && (last > 0))
+            {
+                int min_stride = (last + max_slices - 2) / (max_slices - 1);
+                if (min_stride > stride) stride = min_stride;
+            }
+        }
+
+        bool retains(int t_count) const { return (t_count % stride == 0) || (t_count == last); }
+        int next_retained(int t_count) const { return std::min((t_count / stride + 1) * stride, last); }  /**< The first retained level after t_count */
+        int retained_count() const { return last / stride + 1 + ((last % stride) ? 1 : 0); }
+    };
+}
+
+#endif // PDE_TIME_LEVELS_H